@@ -0,0 +1,122 @@
+/*
+BufferLender.cpp
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "BufferLender.h"
+
+using namespace libmswinrtvid;
+
+
+static int clampMaxOutstanding(int maxOutstanding)
+{
+	if (maxOutstanding < 0) return 0;
+	if (maxOutstanding > BufferLender::kMaxSlots) return BufferLender::kMaxSlots;
+	return maxOutstanding;
+}
+
+
+BufferLender::BufferLender(int maxOutstanding)
+	: mMaxOutstanding(clampMaxOutstanding(maxOutstanding)), mOutstanding(0)
+{
+	for (int i = 0; i < kMaxSlots; i++) {
+		mSlots[i].buffer = NULL;
+		mSlots[i].ops = NULL;
+		mSlots[i].data = NULL;
+	}
+}
+
+BufferLender::~BufferLender()
+{
+}
+
+uint8_t * BufferLender::lend(void *buffer, const BorrowedBufferOps *ops, size_t *length)
+{
+	Slot *slot = NULL;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mOutstanding >= mMaxOutstanding) return NULL;
+		for (int i = 0; i < kMaxSlots; i++) {
+			if (mSlots[i].buffer == NULL) {
+				slot = &mSlots[i];
+				break;
+			}
+		}
+		if (slot == NULL) return NULL;
+		// Reserve the slot, its data is only known once the buffer is locked.
+		slot->buffer = buffer;
+		slot->ops = ops;
+		slot->data = NULL;
+		mOutstanding++;
+	}
+
+	ops->addRef(buffer);
+	uint8_t *data = NULL;
+	if (!ops->lock(buffer, &data, length) || (data == NULL)) {
+		ops->release(buffer);
+		std::lock_guard<std::mutex> lock(mMutex);
+		slot->buffer = NULL;
+		slot->ops = NULL;
+		mOutstanding--;
+		return NULL;
+	}
+	std::lock_guard<std::mutex> lock(mMutex);
+	slot->data = data;
+	return data;
+}
+
+bool BufferLender::giveBack(const void *data)
+{
+	Slot *slot = NULL;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (data == NULL) return false;
+		for (int i = 0; i < kMaxSlots; i++) {
+			if ((mSlots[i].buffer != NULL) && (mSlots[i].data == data)) {
+				slot = &mSlots[i];
+				// The slot stays taken until the buffer is released, so that no more than mMaxOutstanding buffers
+				// are ever held. Clearing its data keeps it from being given back twice.
+				slot->data = NULL;
+				break;
+			}
+		}
+	}
+	if (slot == NULL) return false;
+	// The owner may recycle the buffer as soon as it is released, so unlock it first.
+	slot->ops->unlock(slot->buffer);
+	slot->ops->release(slot->buffer);
+	std::lock_guard<std::mutex> lock(mMutex);
+	slot->buffer = NULL;
+	slot->ops = NULL;
+	mOutstanding--;
+	return true;
+}
+
+void BufferLender::setMaxOutstanding(int maxOutstanding)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mMaxOutstanding = clampMaxOutstanding(maxOutstanding);
+}
+
+int BufferLender::getOutstanding()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mOutstanding;
+}
@@ -0,0 +1,76 @@
+/*
+BufferLender.h
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Lends the memory of buffers owned by someone else, such as the Media Foundation buffers of the camera, so that the
+// frames are passed downstream without being copied. A lent buffer stays referenced and locked until it is given back,
+// and the number of buffers lent at a time is limited so that the owner does not run out of them.
+// Like VideoKernels, this file only depends on the standard library.
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace libmswinrtvid
+{
+	// How to reference and lock the buffers of a given kind, so that no object has to be allocated for each lent buffer.
+	struct BorrowedBufferOps {
+		void (*addRef)(void *buffer);
+		void (*release)(void *buffer);
+		bool (*lock)(void *buffer, uint8_t **data, size_t *length);
+		void (*unlock)(void *buffer);
+	};
+
+	class BufferLender {
+	public:
+		static const int kMaxSlots = 8;
+
+		// maxOutstanding is clamped to [0, kMaxSlots]. 0 disables the lending.
+		explicit BufferLender(int maxOutstanding);
+		// All the buffers must have been given back.
+		~BufferLender();
+
+		// References and locks buffer and returns its data, or NULL if maxOutstanding buffers are already lent or the lock fails.
+		// In that case the caller has to copy the data instead.
+		uint8_t * lend(void *buffer, const BorrowedBufferOps *ops, size_t *length);
+
+		// Unlocks and releases the buffer whose data has been returned by lend(). Returns false if it has not been lent by this lender.
+		bool giveBack(const void *data);
+
+		void setMaxOutstanding(int maxOutstanding);
+		int getOutstanding();
+
+	private:
+		struct Slot {
+			void *buffer;
+			const BorrowedBufferOps *ops;
+			const uint8_t *data;
+		};
+
+		std::mutex mMutex;
+		Slot mSlots[kMaxSlots];
+		int mMaxOutstanding;
+		int mOutstanding;
+	};
+}
@@ -0,0 +1,60 @@
+/*
+DuplicateFrameDetector.cpp
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "DuplicateFrameDetector.h"
+#include "VideoKernels.h"
+
+using namespace libmswinrtvid;
+
+
+DuplicateFrameDetector::DuplicateFrameDetector()
+	: mMode(Disabled), mLastFingerprint(0), mHasLastFingerprint(false), mConsecutiveSkips(0), mSkippedFrames(0)
+{
+}
+
+void DuplicateFrameDetector::setMode(Mode mode)
+{
+	mMode = mode;
+	reset();
+}
+
+bool DuplicateFrameDetector::isDuplicate(const uint8_t *const planes[3], const int strides[3], int width, int height)
+{
+	if (mMode == Disabled) return false;
+
+	uint64_t fingerprint = fingerprintI420(planes, strides, width, height, (mMode == Sampled) ? kSampledRowStep : 1);
+	if (mHasLastFingerprint && (fingerprint == mLastFingerprint) && (mConsecutiveSkips < kMaxConsecutiveSkips)) {
+		mConsecutiveSkips++;
+		mSkippedFrames++;
+		return true;
+	}
+	mLastFingerprint = fingerprint;
+	mHasLastFingerprint = true;
+	mConsecutiveSkips = 0;
+	return false;
+}
+
+void DuplicateFrameDetector::reset()
+{
+	mHasLastFingerprint = false;
+	mConsecutiveSkips = 0;
+}
@@ -0,0 +1,65 @@
+/*
+DuplicateFrameDetector.h
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Detection of the frames identical to the previous one (static screen share, frozen decoder...) so that the display
+// filters can skip their conversion. Like VideoKernels, this file only depends on the standard library.
+
+#include <stdint.h>
+
+
+namespace libmswinrtvid
+{
+	class DuplicateFrameDetector {
+	public:
+		enum Mode {
+			Disabled,
+			Sampled,	// Only one row out of kSampledRowStep is hashed.
+			Full
+		};
+
+		DuplicateFrameDetector();
+
+		Mode getMode() const { return mMode; }
+		void setMode(Mode mode);
+
+		// Returns true if the I420 picture is identical to the previous one given to this method and does not need to be displayed again.
+		// A frame is reported as new at least every kMaxConsecutiveSkips frames in case the display dropped the previous one.
+		bool isDuplicate(const uint8_t *const planes[3], const int strides[3], int width, int height);
+
+		// Forgets the previous frame, to be called when the display is restarted.
+		void reset();
+
+		unsigned int getSkippedFrames() const { return mSkippedFrames; }
+
+	private:
+		static const int kSampledRowStep = 4;
+		static const int kMaxConsecutiveSkips = 30;
+
+		Mode mMode;
+		uint64_t mLastFingerprint;
+		bool mHasLastFingerprint;
+		int mConsecutiveSkips;
+		unsigned int mSkippedFrames;
+	};
+}
@@ -0,0 +1,81 @@
+/*
+FrameDecimator.cpp
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "FrameDecimator.h"
+
+#include <math.h>
+
+using namespace libmswinrtvid;
+
+
+static const double kTimeUnitsPerSecond = 10000000.0;
+// A gap longer than this in the presentation times (or a time going backwards) restarts the grid from the next frame.
+static const int64_t kMaxGap = 10000000;
+
+
+FrameDecimator::FrameDecimator()
+	: mFps(0), mInterval(0), mNextTime(0), mStarted(false), mLastTime(0), mSourceInterval(0), mDroppedFrames(0)
+{
+}
+
+void FrameDecimator::setFps(double fps)
+{
+	mFps = (fps > 0) ? fps : 0;
+	mInterval = (mFps > 0) ? (kTimeUnitsPerSecond / mFps) : 0;
+	reset();
+}
+
+bool FrameDecimator::accept(int64_t time)
+{
+	if (mFps <= 0) return true;
+	if (!mStarted || (time < mLastTime) || ((time - mLastTime) > kMaxGap)) {
+		mStarted = true;
+		mNextTime = (double)time;
+		mSourceInterval = 0;
+	} else {
+		int64_t delta = time - mLastTime;
+		mSourceInterval = (mSourceInterval == 0) ? delta : ((7 * mSourceInterval + delta) / 8);
+	}
+	mLastTime = time;
+
+	// A frame is taken for the next point of the grid if it is the closest one to it: the frame following it would be
+	// more than half a camera frame interval late. The grid only moves when a frame is taken, so the jitter of the
+	// presentation times can delay the choice by one frame but never drops two frames in a row for the same point.
+	if (((double)time + (double)mSourceInterval / 2) < mNextTime) {
+		mDroppedFrames++;
+		return false;
+	}
+	if ((double)time >= (mNextTime + mInterval)) {
+		// The camera is slower than the target, or has skipped frames: restart the grid from this frame.
+		mNextTime = (double)time;
+	}
+	mNextTime += mInterval;
+	return true;
+}
+
+void FrameDecimator::reset()
+{
+	mStarted = false;
+	mNextTime = 0;
+	mLastTime = 0;
+	mSourceInterval = 0;
+}
@@ -0,0 +1,62 @@
+/*
+FrameDecimator.h
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Decimation of the camera frames by their presentation time, before they are copied. The frames closest to a grid of
+// the target frame interval are kept, so that a 60 fps camera decimated to 24 fps alternates 2 and 3 camera frame
+// intervals instead of following the ticks. Like VideoKernels, this file only depends on the standard library.
+
+#include <atomic>
+#include <stdint.h>
+
+
+namespace libmswinrtvid
+{
+	class FrameDecimator {
+	public:
+		FrameDecimator();
+
+		// Target frame rate, possibly fractional. 0 lets all the frames through. Restarts the decimation.
+		void setFps(double fps);
+		double getFps() const { return mFps; }
+
+		// Called for each camera frame with its presentation time in 100ns units, as given by Media Foundation.
+		// Returns false if the frame must be dropped.
+		bool accept(int64_t time);
+
+		// Forgets the previous frames, to be called when the capture is restarted.
+		void reset();
+
+		// May be read from another thread than the one calling accept().
+		unsigned int getDroppedFrames() const { return mDroppedFrames.load(); }
+
+	private:
+		double mFps;
+		double mInterval;
+		double mNextTime;
+		bool mStarted;
+		int64_t mLastTime;
+		int64_t mSourceInterval;
+		std::atomic<unsigned int> mDroppedFrames;
+	};
+}
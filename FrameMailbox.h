@@ -0,0 +1,155 @@
+/*
+FrameMailbox.h
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Mailbox holding the latest frame for the Media Foundation sample requests: the ticker publishes frames without ever
+// blocking, and a request takes the newest frame or waits for the next one. The frames are kept in a triple buffer:
+// one slot is written by the producer, one is read by the consumer and the third one holds the latest published frame.
+// Like VideoKernels, this file only depends on the standard library.
+
+#include <atomic>
+#include <stdint.h>
+
+
+namespace libmswinrtvid
+{
+	// T and R are handles to the frames and to the deferred requests, reset by assigning T() and R().
+	// There must be at most one request waiting at a time, which is how Media Foundation requests the samples of a stream:
+	// a request is answered before the next one is made.
+	template <typename T, typename R> class FrameMailbox {
+	public:
+		struct Stats {
+			uint64_t published;
+			uint64_t overwritten;	// Frames replaced by a newer one before having been taken.
+			uint64_t deferred;	// Requests that had to wait for the next frame.
+		};
+
+		FrameMailbox()
+			: mWrite(0), mRead(1), mLatest(2), mHasRequest(false), mPublished(0), mOverwritten(0), mDeferred(0)
+		{
+		}
+
+		// Producer side. Publishes frame as the latest one. If a request is waiting, it is returned in request with the
+		// frame it must be answered with, and true is returned.
+		bool publish(const T &frame, R *request, T *requestFrame)
+		{
+			mSlots[mWrite] = frame;
+			unsigned int previous = mLatest.exchange(mWrite | kFresh);
+			mWrite = previous & kIndexMask;
+			// The frame that has not been taken is released now rather than when this slot is written again.
+			mSlots[mWrite] = T();
+			mPublished++;
+			if (previous & kFresh) mOverwritten++;
+
+			if (!mHasRequest.load() || !mHasRequest.exchange(false)) return false;
+			// The request now belongs to this thread, which takes the frame on its behalf. The frame may already have been
+			// taken for the previous request, made before this one: the request is then left for the next frame.
+			if (!take(requestFrame)) {
+				mHasRequest.store(true);
+				return false;
+			}
+			*request = mPendingRequest;
+			mPendingRequest = R();
+			return true;
+		}
+
+		// Producer side. Releases the latest frame if it has not been taken, for instance when the display is stopped, and
+		// returns true. A request that is waiting is left for the next frame.
+		bool discardLatest()
+		{
+			unsigned int previous = mLatest.exchange(mWrite);
+			mWrite = previous & kIndexMask;
+			mSlots[mWrite] = T();
+			return (previous & kFresh) != 0;
+		}
+
+		// Consumer side. Returns true with the newest frame if one has been published since the previous one taken.
+		bool take(T *frame)
+		{
+			if (!hasFreshFrame()) return false;
+			unsigned int latest = mLatest.exchange(mRead);
+			mRead = latest & kIndexMask;
+			// The frame may have been discarded since it was seen: the slot obtained is then an empty one.
+			if (!(latest & kFresh)) return false;
+			*frame = mSlots[mRead];
+			mSlots[mRead] = T();
+			return true;
+		}
+
+		// Consumer side. Same as take(), but if there is no new frame the request is kept, to be returned by the next
+		// call to publish(), and false is returned.
+		bool request(const R &request, T *frame)
+		{
+			if (take(frame)) return true;
+			mPendingRequest = request;
+			mHasRequest.store(true);
+			// A frame may have been published between take() and now, without seeing the request.
+			while (hasFreshFrame() && mHasRequest.exchange(false)) {
+				if (take(frame)) {
+					mPendingRequest = R();
+					return true;
+				}
+				// The producer has discarded the frame meanwhile, the request waits for the next one.
+				mHasRequest.store(true);
+			}
+			mDeferred++;
+			return false;
+		}
+
+		// Drops the waiting request if any, returning it in request, for instance when the display is stopped.
+		bool cancelRequest(R *request)
+		{
+			if (!mHasRequest.exchange(false)) return false;
+			*request = mPendingRequest;
+			mPendingRequest = R();
+			return true;
+		}
+
+		bool hasFreshFrame() const { return (mLatest.load() & kFresh) != 0; }
+
+		Stats getStats() const
+		{
+			Stats stats;
+			stats.published = mPublished;
+			stats.overwritten = mOverwritten;
+			stats.deferred = mDeferred;
+			return stats;
+		}
+
+	private:
+		static const unsigned int kIndexMask = 3;
+		static const unsigned int kFresh = 4;
+
+		// The atomics use sequential consistency: each side writes one of mLatest and mHasRequest then reads the other,
+		// and at least one of them must see the write of the other.
+		T mSlots[3];
+		unsigned int mWrite;
+		unsigned int mRead;
+		std::atomic<unsigned int> mLatest;
+		std::atomic<bool> mHasRequest;
+		R mPendingRequest;
+		uint64_t mPublished;
+		uint64_t mOverwritten;
+		uint64_t mDeferred;
+	};
+}
@@ -0,0 +1,67 @@
+/*
+FramePacer.cpp
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "FramePacer.h"
+
+using namespace libmswinrtvid;
+
+
+FramePacer::FramePacer()
+	: mInterval(1000.0 / 15.0), mNextRelease(0), mStarted(false), mDroppedFrames(0)
+{
+}
+
+void FramePacer::setFps(float fps)
+{
+	if (fps <= 0) return;
+	mInterval = 1000.0 / fps;
+	reset();
+}
+
+bool FramePacer::select(uint64_t now, const uint64_t *captureTimes, size_t count, size_t *stale)
+{
+	*stale = 0;
+	if (count == 0) return false;
+
+	double newest = (double)captureTimes[count - 1];
+	while ((*stale < (count - 1)) && (((double)captureTimes[*stale] + mInterval) < newest)) {
+		(*stale)++;
+	}
+	mDroppedFrames += (unsigned int)*stale;
+
+	if (mStarted && ((double)now < mNextRelease)) return false;
+	if (!mStarted || ((double)now >= (mNextRelease + mInterval))) {
+		// First frame, or nothing has been released for more than one interval: restart the schedule from now.
+		mNextRelease = (double)now + mInterval;
+	} else {
+		// Keep the schedule rather than restarting it from now, the ticks do not fall exactly on it.
+		mNextRelease += mInterval;
+	}
+	mStarted = true;
+	return true;
+}
+
+void FramePacer::reset()
+{
+	mNextRelease = 0;
+	mStarted = false;
+}
@@ -0,0 +1,56 @@
+/*
+FramePacer.h
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Pacing of the captured frames: at most one frame is released per frame interval, so that a burst of frames from the
+// camera does not reach the encoder as a burst. Like VideoKernels, this file only depends on the standard library.
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace libmswinrtvid
+{
+	class FramePacer {
+	public:
+		FramePacer();
+
+		void setFps(float fps);
+
+		// Called at each tick with the current time and the capture times of the pending frames, oldest first, in ms.
+		// Sets stale to the number of frames at the front captured more than one frame interval before the newest one,
+		// which must be dropped. Returns true if the frame following them must be released now.
+		bool select(uint64_t now, const uint64_t *captureTimes, size_t count, size_t *stale);
+
+		// Forgets the release schedule, to be called when the capture is restarted.
+		void reset();
+
+		unsigned int getDroppedFrames() const { return mDroppedFrames; }
+
+	private:
+		double mInterval;
+		double mNextRelease;
+		bool mStarted;
+		unsigned int mDroppedFrames;
+	};
+}
@@ -0,0 +1,183 @@
+/*
+FramePool.cpp
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+
+#include "FramePool.h"
+
+using namespace libmswinrtvid;
+
+
+// Stored in the kAlignment bytes preceding each buffer, so that release() finds the pool from the buffer alone.
+struct FramePool::BufferHeader {
+	FramePool *pool;
+	void *allocation;
+	size_t size;
+	Key key;
+};
+
+static_assert(sizeof(void *) * 2 + sizeof(size_t) + sizeof(uint64_t) <= FramePool::kAlignment, "The buffer header must fit before the buffer");
+
+
+FramePool * FramePool::get()
+{
+	static FramePool *pool = new FramePool(kDefaultMaxIdleBytes);
+	return pool;
+}
+
+FramePool::FramePool(size_t maxIdleBytes)
+	: mMaxIdleBytes(maxIdleBytes)
+{
+	mStats.hits = 0;
+	mStats.misses = 0;
+	mStats.allocatedBytes = 0;
+	mStats.idleBytes = 0;
+}
+
+FramePool::~FramePool()
+{
+	for (std::map<Key, std::vector<BufferHeader *> >::iterator it = mIdleBuffers.begin(); it != mIdleBuffers.end(); ++it) {
+		for (size_t i = 0; i < it->second.size(); i++) {
+			free(it->second[i]->allocation);
+		}
+	}
+}
+
+size_t FramePool::frameSize(int width, int height, Format format)
+{
+	size_t chromaWidth = (width + 1) / 2;
+	size_t chromaHeight = (height + 1) / 2;
+	// Both formats have the same size, only the layout of the chroma samples differs.
+	(void)format;
+	return (size_t)width * height + 2 * chromaWidth * chromaHeight;
+}
+
+FramePool::Key FramePool::makeKey(int width, int height, Format format)
+{
+	return ((uint64_t)(uint32_t)width << 32) | ((uint64_t)(uint16_t)height << 16) | (uint64_t)(uint16_t)format;
+}
+
+uint8_t * FramePool::acquire(int width, int height, Format format)
+{
+	Key key = makeKey(width, height, format);
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		std::map<Key, std::vector<BufferHeader *> >::iterator it = mIdleBuffers.find(key);
+		if ((it != mIdleBuffers.end()) && !it->second.empty()) {
+			BufferHeader *header = it->second.back();
+			it->second.pop_back();
+			mStats.idleBytes -= header->size;
+			mStats.hits++;
+			return reinterpret_cast<uint8_t *>(header) + kAlignment;
+		}
+		mStats.misses++;
+	}
+
+	size_t size = frameSize(width, height, format);
+	void *allocation = malloc(size + 2 * kAlignment);
+	if (allocation == NULL) return NULL;
+	uintptr_t aligned = (reinterpret_cast<uintptr_t>(allocation) + kAlignment - 1) & ~(uintptr_t)(kAlignment - 1);
+	BufferHeader *header = reinterpret_cast<BufferHeader *>(aligned);
+	header->pool = this;
+	header->allocation = allocation;
+	header->size = size;
+	header->key = key;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStats.allocatedBytes += size;
+	}
+	return reinterpret_cast<uint8_t *>(header) + kAlignment;
+}
+
+void FramePool::release(void *buffer)
+{
+	if (buffer == NULL) return;
+	BufferHeader *header = reinterpret_cast<BufferHeader *>(static_cast<uint8_t *>(buffer) - kAlignment);
+	header->pool->recycle(header);
+}
+
+void FramePool::recycle(BufferHeader *header)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if ((mStats.idleBytes + header->size) > mMaxIdleBytes) {
+		evictIdleBuffers(header->key, header->size);
+	}
+	if ((mStats.idleBytes + header->size) > mMaxIdleBytes) {
+		freeBuffer(header);
+		return;
+	}
+	mIdleBuffers[header->key].push_back(header);
+	mStats.idleBytes += header->size;
+}
+
+void FramePool::freeBuffer(BufferHeader *header)
+{
+	mStats.allocatedBytes -= header->size;
+	free(header->allocation);
+}
+
+// Frees idle buffers of other sizes than keep until there is room for incomingBytes.
+void FramePool::evictIdleBuffers(Key keep, size_t incomingBytes)
+{
+	std::map<Key, std::vector<BufferHeader *> >::iterator it = mIdleBuffers.begin();
+	while ((it != mIdleBuffers.end()) && ((mStats.idleBytes + incomingBytes) > mMaxIdleBytes)) {
+		if (it->first != keep) {
+			while (!it->second.empty() && ((mStats.idleBytes + incomingBytes) > mMaxIdleBytes)) {
+				BufferHeader *header = it->second.back();
+				it->second.pop_back();
+				mStats.idleBytes -= header->size;
+				freeBuffer(header);
+			}
+		}
+		if (it->second.empty()) {
+			mIdleBuffers.erase(it++);
+		} else {
+			++it;
+		}
+	}
+}
+
+void FramePool::trim(int width, int height, Format format)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::map<Key, std::vector<BufferHeader *> >::iterator it = mIdleBuffers.find(makeKey(width, height, format));
+	if (it == mIdleBuffers.end()) return;
+	for (size_t i = 0; i < it->second.size(); i++) {
+		mStats.idleBytes -= it->second[i]->size;
+		freeBuffer(it->second[i]);
+	}
+	mIdleBuffers.erase(it);
+}
+
+void FramePool::setMaxIdleBytes(size_t maxIdleBytes)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mMaxIdleBytes = maxIdleBytes;
+	evictIdleBuffers(0, 0);
+	// Buffers of the size in use can remain above the limit, they are freed as they are released.
+}
+
+FramePool::Stats FramePool::getStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
@@ -0,0 +1,94 @@
+/*
+FramePool.h
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Pool of frame buffers recycled by (width, height, format) so that the filters do not allocate a frame each time.
+// Like VideoKernels, this file only depends on the standard library.
+
+#include <map>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+namespace libmswinrtvid
+{
+	class FramePool {
+	public:
+		enum Format {
+			FormatI420,
+			FormatNV12
+		};
+
+		struct Stats {
+			uint64_t hits;
+			uint64_t misses;
+			size_t allocatedBytes;	// Memory of all the buffers, in use or idle.
+			size_t idleBytes;	// Memory of the buffers waiting in the pool.
+		};
+
+		// Alignment of the buffers, for the aligned SIMD loads and stores and to avoid sharing cache lines between frames.
+		static const size_t kAlignment = 64;
+		static const size_t kDefaultMaxIdleBytes = 32 * 1024 * 1024;
+
+		// Pool shared by the filters of the plugin. It is never destroyed so that the buffers can be released at any time.
+		static FramePool * get();
+
+		// A pool must outlive all the buffers it has handed out.
+		explicit FramePool(size_t maxIdleBytes);
+		~FramePool();
+
+		// Size of a packed frame: the planes have no padding as the mediastreamer2 pictures and the Media Foundation samples expect.
+		static size_t frameSize(int width, int height, Format format);
+
+		// Returns a buffer of frameSize(width, height, format) bytes aligned on kAlignment, to be given back with release(),
+		// or NULL if no memory can be allocated.
+		uint8_t * acquire(int width, int height, Format format);
+
+		// Gives a buffer back to the pool it comes from. The signature matches the free function of esballoc().
+		static void release(void *buffer);
+
+		// Frees the idle buffers of a size that is not going to be used anymore, typically after a resolution change. The shared
+		// pool is used by several filters, which may still need this size: they rely on the idle memory cap instead.
+		void trim(int width, int height, Format format);
+
+		// Above this amount of idle memory, released buffers are freed instead of being kept in the pool.
+		void setMaxIdleBytes(size_t maxIdleBytes);
+		Stats getStats();
+
+	private:
+		struct BufferHeader;
+		typedef uint64_t Key;
+
+		static Key makeKey(int width, int height, Format format);
+		void recycle(BufferHeader *header);
+		void freeBuffer(BufferHeader *header);
+		void evictIdleBuffers(Key keep, size_t incomingBytes);
+
+		std::mutex mMutex;
+		std::map<Key, std::vector<BufferHeader *> > mIdleBuffers;
+		size_t mMaxIdleBytes;
+		Stats mStats;
+	};
+}
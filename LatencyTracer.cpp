@@ -0,0 +1,181 @@
+/*
+LatencyTracer.cpp
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "LatencyTracer.h"
+#include "PresentationClock.h"
+
+#include <stdio.h>
+
+using namespace libmswinrtvid;
+
+
+LatencyHistogram::LatencyHistogram()
+{
+	reset();
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t us)
+{
+	const uint64_t linear = (uint64_t)1 << kSubBucketBits;
+	if (us < linear) return (size_t)us;
+	int exponent = kSubBucketBits;
+	while ((exponent < kMaxExponent) && ((us >> (exponent + 1)) != 0)) exponent++;
+	if ((us >> (exponent + 1)) != 0) return kBucketCount - 1;
+	size_t subBucket = (size_t)((us >> (exponent - kSubBucketBits)) & (linear - 1));
+	return (size_t)linear + (size_t)(exponent - kSubBucketBits) * (size_t)linear + subBucket;
+}
+
+uint64_t LatencyHistogram::bucketValue(size_t index)
+{
+	const size_t linear = (size_t)1 << kSubBucketBits;
+	if (index < linear) return index;
+	int shift = (int)((index - linear) / linear);
+	uint64_t lowest = (uint64_t)(linear + (index - linear) % linear) << shift;
+	return lowest + (((uint64_t)1 << shift) / 2);
+}
+
+void LatencyHistogram::record(uint64_t us)
+{
+	mBuckets[bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+	mSumUs.fetch_add(us, std::memory_order_relaxed);
+	uint64_t max = mMaxUs.load(std::memory_order_relaxed);
+	while ((us > max) && !mMaxUs.compare_exchange_weak(max, us, std::memory_order_relaxed));
+}
+
+LatencyHistogram::Summary LatencyHistogram::summarize() const
+{
+	uint64_t counts[kBucketCount];
+	Summary summary = { 0, 0, 0, 0, 0, 0 };
+	for (size_t i = 0; i < kBucketCount; i++) {
+		counts[i] = mBuckets[i].load(std::memory_order_relaxed);
+		summary.count += counts[i];
+	}
+	if (summary.count == 0) return summary;
+	summary.meanUs = mSumUs.load(std::memory_order_relaxed) / summary.count;
+	summary.maxUs = mMaxUs.load(std::memory_order_relaxed);
+
+	const uint64_t ranks[3] = { (summary.count * 50 + 99) / 100, (summary.count * 90 + 99) / 100, (summary.count * 99 + 99) / 100 };
+	uint64_t *values[3] = { &summary.p50Us, &summary.p90Us, &summary.p99Us };
+	uint64_t seen = 0;
+	size_t rank = 0;
+	for (size_t i = 0; (i < kBucketCount) && (rank < 3); i++) {
+		seen += counts[i];
+		while ((rank < 3) && (seen >= ranks[rank])) {
+			// A bucket may extend beyond the largest value recorded.
+			uint64_t value = bucketValue(i);
+			*values[rank++] = (value < summary.maxUs) ? value : summary.maxUs;
+		}
+	}
+	return summary;
+}
+
+std::string LatencyHistogram::describe(const Summary &summary)
+{
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), "p50=%.1fms p90=%.1fms p99=%.1fms max=%.1fms",
+		summary.p50Us / 1000.0, summary.p90Us / 1000.0, summary.p99Us / 1000.0, summary.maxUs / 1000.0);
+	return buffer;
+}
+
+void LatencyHistogram::reset()
+{
+	for (size_t i = 0; i < kBucketCount; i++) {
+		mBuckets[i].store(0, std::memory_order_relaxed);
+	}
+	mSumUs.store(0, std::memory_order_relaxed);
+	mMaxUs.store(0, std::memory_order_relaxed);
+}
+
+
+uint32_t LatencyTracer::stamp(int64_t time)
+{
+	return (uint32_t)(uint64_t)(time / (PresentationClock::kUnitsPerSecond / 1000000));
+}
+
+uint32_t LatencyTracer::now()
+{
+	return stamp(PresentationClock::now());
+}
+
+LatencyTracer::LatencyTracer()
+	: mLastFrameStamp(0), mLastInterval(-1), mLastLogTime(-1), mHasLastFrame(false)
+{
+}
+
+void LatencyTracer::record(Stage stage, uint32_t start, uint32_t end)
+{
+	// The unsigned difference is right across the wrap of the stamps. A frame stamped by another thread just after the
+	// end stamp was taken would give a huge duration, it counts as 0.
+	uint32_t duration = end - start;
+	mStages[stage].record((duration < 0x80000000u) ? duration : 0);
+}
+
+void LatencyTracer::frameDone(uint32_t stamp)
+{
+	if (mHasLastFrame) {
+		int64_t interval = (int64_t)(uint32_t)(stamp - mLastFrameStamp);
+		if (mLastInterval >= 0) {
+			int64_t difference = interval - mLastInterval;
+			mJitter.record((uint64_t)((difference < 0) ? -difference : difference));
+		}
+		mLastInterval = interval;
+	}
+	mLastFrameStamp = stamp;
+	mHasLastFrame = true;
+}
+
+std::string LatencyTracer::describe() const
+{
+	static const char *names[StageCount] = { "handoff", "queue wait", "conversion", "total" };
+	std::string line;
+	for (int i = 0; i < StageCount; i++) {
+		line += names[i];
+		line += " ";
+		line += LatencyHistogram::describe(mStages[i].summarize());
+		line += ", ";
+	}
+	line += "jitter ";
+	line += LatencyHistogram::describe(mJitter.summarize());
+	return line;
+}
+
+bool LatencyTracer::isLogDue(int64_t now, int64_t period)
+{
+	if (mLastLogTime < 0) {
+		mLastLogTime = now;
+		return false;
+	}
+	if ((now - mLastLogTime) < period) return false;
+	mLastLogTime = now;
+	return true;
+}
+
+void LatencyTracer::reset()
+{
+	for (int i = 0; i < StageCount; i++) {
+		mStages[i].reset();
+	}
+	mJitter.reset();
+	mLastInterval = -1;
+	mLastLogTime = -1;
+	mHasLastFrame = false;
+}
@@ -0,0 +1,138 @@
+/*
+LatencyTracer.h
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Latency of the stages the frames go through in a filter, recorded in log-linear histograms that any thread can update
+// without a lock, together with the jitter of the frames leaving the filter. Like VideoKernels, this file only depends on
+// the standard library.
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+
+namespace libmswinrtvid
+{
+	// Histogram of durations in microseconds. The buckets are linear up to 16us, then each power of two is split in 16
+	// buckets, so the percentiles are within 1/16 of the recorded values.
+	class LatencyHistogram {
+	public:
+		struct Summary {
+			uint64_t count;
+			uint64_t meanUs;
+			uint64_t p50Us;
+			uint64_t p90Us;
+			uint64_t p99Us;
+			uint64_t maxUs;
+		};
+
+		LatencyHistogram();
+
+		void record(uint64_t us);
+		// The buckets are read one after the other while other threads may be recording, the summary is approximate.
+		Summary summarize() const;
+		void reset();
+
+		static size_t bucketIndex(uint64_t us);
+		// Middle of the values falling in a bucket.
+		static uint64_t bucketValue(size_t index);
+		// "p50=1.2ms p90=... p99=... max=...", in milliseconds.
+		static std::string describe(const Summary &summary);
+
+	private:
+		static const int kSubBucketBits = 4;
+		static const int kMaxExponent = 40;
+		static const size_t kBucketCount = ((size_t)1 << kSubBucketBits) * (kMaxExponent - kSubBucketBits + 2);
+
+		std::atomic<uint64_t> mBuckets[kBucketCount];
+		std::atomic<uint64_t> mSumUs;
+		std::atomic<uint64_t> mMaxUs;
+	};
+
+	class LatencyTracer {
+	public:
+		enum Stage {
+			// Capture: from the camera callback to the frame queued for the ticker, copy included.
+			// Display: from the end of the conversion to the sample handed to Media Foundation.
+			StageHandoff,
+			// Capture: from the frame queued to the ticker taking it to send it.
+			// Display: from the ticker to the sample request taking the frame.
+			StageQueueWait,
+			StageConversion,
+			// From the camera callback or the ticker to the frame leaving the filter.
+			StageTotal,
+			StageCount
+		};
+
+		// The stages of a frame are timed by stamps in microseconds modulo 2^32, small enough to be carried with the frame.
+		// The durations are correct across the wrap as long as they are shorter than 71 minutes.
+		static uint32_t stamp(int64_t time);
+		// Stamp of PresentationClock::now().
+		static uint32_t now();
+
+		// The stamps of the capture stages travel with the frames in the arrival time of their mblk, a struct timeval that
+		// only the RTP receivers use: the camera callback in the seconds and the queuing in the microseconds. They are
+		// cleared before the frames are sent, so that the filters downstream do not take them for an arrival time.
+		template <typename TimeVal> static void setFrameStamps(TimeVal &arrival, uint32_t entered, uint32_t queued)
+		{
+			arrival.tv_sec = (long)entered;
+			arrival.tv_usec = (long)queued;
+		}
+		template <typename TimeVal> static void getFrameStamps(const TimeVal &arrival, uint32_t *entered, uint32_t *queued)
+		{
+			*entered = (uint32_t)arrival.tv_sec;
+			*queued = (uint32_t)arrival.tv_usec;
+		}
+		template <typename TimeVal> static void clearFrameStamps(TimeVal &arrival)
+		{
+			arrival.tv_sec = 0;
+			arrival.tv_usec = 0;
+		}
+
+		LatencyTracer();
+
+		void record(Stage stage, uint32_t start, uint32_t end);
+		// Called with the stamp of each frame leaving the filter, records the difference between its interval from the
+		// previous frame and the previous interval. The calls must not overlap, which is the case when they are made by
+		// the thread passing the frames on, even if this thread changes from one frame to the next.
+		void frameDone(uint32_t stamp);
+
+		LatencyHistogram & stage(Stage stage) { return mStages[stage]; }
+		LatencyHistogram & jitter() { return mJitter; }
+		// One line with the summaries of the stages and of the jitter, for the logs.
+		std::string describe() const;
+
+		// Returns true once per period, in 100ns units like PresentationClock::now(), for the periodic log lines.
+		bool isLogDue(int64_t now, int64_t period);
+		void reset();
+
+	private:
+		LatencyHistogram mStages[StageCount];
+		LatencyHistogram mJitter;
+		uint32_t mLastFrameStamp;
+		int64_t mLastInterval;
+		int64_t mLastLogTime;
+		bool mHasLastFrame;
+	};
+}
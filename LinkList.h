@@ -430,6 +430,7 @@ class ComPtrList : public List<T*>
 public:
 
 	typedef T* Ptr;
+	typedef typename List<Ptr>::Node Node;
 
 	void Clear()
 	{
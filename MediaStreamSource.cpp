@@ -21,6 +21,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
 #include "MediaStreamSource.h"
+#include "VideoWorkerPool.h"
 #include <mfapi.h>
 #include <wrl.h>
 #include <robuffer.h>
@@ -32,10 +33,92 @@ using namespace Windows::Media::MediaProperties;
 using Microsoft::WRL::ComPtr;
 
 
+// Enough for the samples queued by the renderer and the one being filled.
+static const size_t kMaxIdleSamples = 4;
+
+
+libmswinrtvid::SampleAllocator::SampleAllocator()
+	: mPool(&mBackend, kMaxIdleSamples)
+{
+}
+
+libmswinrtvid::SampleAllocator::~SampleAllocator()
+{
+	mPool.clear();
+}
+
+IMFSample * libmswinrtvid::SampleAllocator::Backend::create(int width, int height)
+{
+	ComPtr<IMFTrackedSample> spTrackedSample;
+	HRESULT hr = MFCreateTrackedSample(spTrackedSample.GetAddressOf());
+	if (FAILED(hr)) {
+		ms_error("SampleAllocator: MFCreateTrackedSample failed %x", hr);
+		return NULL;
+	}
+	ComPtr<IMFSample> spSample;
+	spTrackedSample.As(&spSample);
+	ComPtr<IMFMediaBuffer> mediaBuffer;
+	hr = MFCreate2DMediaBuffer(width, height, 0x3231564E /* NV12 */, FALSE, mediaBuffer.GetAddressOf());
+	if (FAILED(hr)) {
+		ms_error("SampleAllocator: MFCreate2DMediaBuffer failed %x", hr);
+		return NULL;
+	}
+	spSample->AddBuffer(mediaBuffer.Get());
+	// Tells Invoke() which pool size the sample belongs to.
+	spSample->SetUINT64(MF_MT_FRAME_SIZE, Pack2UINT32AsUINT64(width, height));
+	return spSample.Detach();
+}
+
+void libmswinrtvid::SampleAllocator::Backend::destroy(IMFSample *sample)
+{
+	sample->Release();
+}
+
+HRESULT libmswinrtvid::SampleAllocator::GetSample(int width, int height, IMFSample **sample)
+{
+	ComPtr<IMFSample> spSample;
+	spSample.Attach(mPool.acquire(width, height));
+	if (spSample == nullptr) {
+		return E_OUTOFMEMORY;
+	}
+	ComPtr<IMFTrackedSample> spTrackedSample;
+	HRESULT hr = spSample.As(&spTrackedSample);
+	if (SUCCEEDED(hr)) {
+		// The allocator has to be set again each time the sample is handed out.
+		hr = spTrackedSample->SetAllocator(this, nullptr);
+	}
+	if (FAILED(hr)) {
+		return hr;
+	}
+	*sample = spSample.Detach();
+	return S_OK;
+}
+
+HRESULT libmswinrtvid::SampleAllocator::Invoke(IMFAsyncResult *result)
+{
+	ComPtr<IUnknown> spObject;
+	ComPtr<IMFSample> spSample;
+	HRESULT hr = result->GetObject(spObject.GetAddressOf());
+	if (SUCCEEDED(hr)) {
+		hr = spObject.As(&spSample);
+	}
+	if (FAILED(hr)) {
+		return hr;
+	}
+	UINT64 frameSize = 0;
+	UINT32 width = 0;
+	UINT32 height = 0;
+	spSample->GetUINT64(MF_MT_FRAME_SIZE, &frameSize);
+	Unpack2UINT32AsUINT64(frameSize, &width, &height);
+	mPool.recycle(spSample.Detach(), (int)width, (int)height);
+	return S_OK;
+}
+
+
 libmswinrtvid::MediaStreamSource::MediaStreamSource()
-	: mMediaStreamSource(nullptr), mTimeStamp(0LL), mInitialTimeStamp(0LL)
+	: mMediaStreamSource(nullptr)
 {
-	mDeferralQueue = ref new Platform::Collections::Vector<SampleRequestDeferral^>();
+	Microsoft::WRL::MakeAndInitialize<SampleAllocator>(&mSampleAllocator);
 }
 
 libmswinrtvid::MediaStreamSource::~MediaStreamSource()
@@ -63,36 +146,53 @@ void libmswinrtvid::MediaStreamSource::OnSampleRequested(Windows::Media::Core::M
 	if (request == nullptr) {
 		return;
 	}
-	mMutex.lock();
-	if (mSample == nullptr) {
-		mDeferralQueue->Append(ref new SampleRequestDeferral(request, request->GetDeferral()));
-	} else {
-		AnswerSampleRequest(request);
+	Sample^ sample = nullptr;
+	if (mMailbox.take(&sample)) {
+		AnswerSampleRequest(request, sample);
+		return;
+	}
+	SampleRequestDeferral^ deferral = ref new SampleRequestDeferral(request, request->GetDeferral());
+	if (mMailbox.request(deferral, &sample)) {
+		// A frame has been published in the meantime.
+		AnswerSampleRequest(request, sample);
+		deferral->Deferral->Complete();
 	}
-	mMutex.unlock();
 }
 
-void libmswinrtvid::MediaStreamSource::Feed(Windows::Storage::Streams::IBuffer^ pBuffer, int width, int height)
+void libmswinrtvid::MediaStreamSource::Feed(Windows::Storage::Streams::IBuffer^ pBuffer, const MSPicture &picture, uint32_t timestamp)
 {
-	mMutex.lock();
-	mSample = ref new Sample(pBuffer, width, height);
-	if (mDeferralQueue->Size > 0) {
-		SampleRequestDeferral^ deferral = mDeferralQueue->GetAt(0);
-		mDeferralQueue->RemoveAt(0);
-		AnswerSampleRequest(deferral->Request);
-		deferral->Deferral->Complete();
+	// Never converts on the ticker: the frame is converted by the Media Foundation thread when it requests it, or on the
+	// worker pool when a request was already waiting for it.
+	SampleRequestDeferral^ deferral = nullptr;
+	Sample^ sample = nullptr;
+	if (mMailbox.publish(ref new Sample(pBuffer, picture, timestamp), &deferral, &sample)) {
+		// Media Foundation only requests a sample once the previous one has been answered, so the previous answer
+		// is already done or finishing.
+		mAnswer.collect();
+		MediaStreamSource^ source = this;
+		mAnswer.submit([source, deferral, sample]() {
+			source->AnswerSampleRequest(deferral->Request, sample);
+			deferral->Deferral->Complete();
+		});
 	}
-	mMutex.unlock();
 }
 
 void libmswinrtvid::MediaStreamSource::Stop()
 {
+	// The answer in progress uses the stream descriptor released below.
+	mAnswer.collect();
+	RecyclingPool<IMFSample>::Stats stats = mSampleAllocator->GetStats();
+	ms_message("MediaStreamSource::Stop: %llu samples reused, %llu created", (unsigned long long)stats.hits, (unsigned long long)stats.misses);
+	FrameMailbox<Sample^, SampleRequestDeferral^>::Stats mailboxStats = mMailbox.getStats();
+	ms_message("MediaStreamSource::Stop: %llu frames published, %llu replaced before being requested, %llu requests deferred",
+		(unsigned long long)mailboxStats.published, (unsigned long long)mailboxStats.overwritten, (unsigned long long)mailboxStats.deferred);
+	SampleRequestDeferral^ deferral = nullptr;
+	mMailbox.cancelRequest(&deferral);
 	mMediaStreamSource = nullptr;
 	mVideoDesc = nullptr;
-	mDeferralQueue = nullptr;
 }
 
-void libmswinrtvid::MediaStreamSource::AnswerSampleRequest(Windows::Media::Core::MediaStreamSourceSampleRequest^ sampleRequest)
+void libmswinrtvid::MediaStreamSource::AnswerSampleRequest(Windows::Media::Core::MediaStreamSourceSampleRequest^ sampleRequest, Sample^ sample)
 {
 	ComPtr<IMFMediaStreamSourceSampleRequest> spRequest;
 	HRESULT hr = reinterpret_cast<IInspectable*>(sampleRequest)->QueryInterface(spRequest.ReleaseAndGetAddressOf());
@@ -100,50 +200,32 @@ void libmswinrtvid::MediaStreamSource::AnswerSampleRequest(Windows::Media::Core:
 		ms_error("MediaStreamSource::AnswerSampleRequest: QueryInterface failed %x", hr);
 		return;
 	}
+	if ((mVideoDesc->EncodingProperties->Width != sample->Width) || (mVideoDesc->EncodingProperties->Height != sample->Height)) {
+		mVideoDesc->EncodingProperties->Width = sample->Width;
+		mVideoDesc->EncodingProperties->Height = sample->Height;
+	}
 	ComPtr<IMFSample> spSample;
-	hr = MFCreateSample(spSample.GetAddressOf());
+	hr = mSampleAllocator->GetSample(mVideoDesc->EncodingProperties->Width, mVideoDesc->EncodingProperties->Height, spSample.GetAddressOf());
 	if (FAILED(hr)) {
-		ms_error("MediaStreamSource::AnswerSampleRequest: MFCreateSample failed %x", hr);
+		ms_error("MediaStreamSource::AnswerSampleRequest: GetSample failed %x", hr);
 		return;
 	}
-	LONGLONG timeStamp = GetTickCount64();
-	if (mInitialTimeStamp == 0) {
-		mInitialTimeStamp = timeStamp;
-	}
-	LONGLONG duration;
-	if (mTimeStamp == 0LL)
-	{
-		duration = (LONGLONG)((1.0 / 30.0) * 1000 * 1000 * 10);
-	}
-	else
-	{
-		duration = (timeStamp - mTimeStamp) * 10000LL;
-	}
-	mTimeStamp = timeStamp;
+	int64_t sampleTime;
+	int64_t duration;
+	mClock.stamp(PresentationClock::now(), sample->Timestamp(), &sampleTime, &duration);
 	spSample->SetSampleDuration(duration);
 	// Set frame 40ms into the future
-	LONGLONG sampleTime = (mTimeStamp - mInitialTimeStamp + 40LL) * 10000LL;
-	spSample->SetSampleTime(sampleTime);
+	spSample->SetSampleTime(sampleTime + 40LL * 10000LL);
 	ComPtr<IMFMediaBuffer> mediaBuffer;
-	if ((mVideoDesc->EncodingProperties->Width != mSample->Width) || (mVideoDesc->EncodingProperties->Height != mSample->Height)) {
-		mVideoDesc->EncodingProperties->Width = mSample->Width;
-		mVideoDesc->EncodingProperties->Height = mSample->Height;
-	}
-	hr = MFCreate2DMediaBuffer(mVideoDesc->EncodingProperties->Width, mVideoDesc->EncodingProperties->Height, 0x3231564E /* NV12 */, FALSE, mediaBuffer.GetAddressOf());
-	if (FAILED(hr)) {
-		ms_error("MediaStreamSource::AnswerSampleRequest: MFCreate2DMediaBuffer failed %x", hr);
-		return;
-	}
-	spSample->AddBuffer(mediaBuffer.Get());
-	RenderFrame(mediaBuffer.Get());
+	spSample->GetBufferByIndex(0, mediaBuffer.GetAddressOf());
+	RenderFrame(mediaBuffer.Get(), sample);
 	hr = spRequest->SetSample(spSample.Get());
 	if (FAILED(hr)) {
 		ms_error("MediaStreamSource::AnswerSampleRequest: SetSample failed %x", hr);
 	}
-	mSample = nullptr;
 }
 
-void libmswinrtvid::MediaStreamSource::RenderFrame(IMFMediaBuffer* mediaBuffer)
+void libmswinrtvid::MediaStreamSource::RenderFrame(IMFMediaBuffer* mediaBuffer, Sample^ sample)
 {
 	ComPtr<IMF2DBuffer2> imageBuffer;
 	HRESULT hr = mediaBuffer->QueryInterface(imageBuffer.GetAddressOf());
@@ -152,13 +234,6 @@ void libmswinrtvid::MediaStreamSource::RenderFrame(IMFMediaBuffer* mediaBuffer)
 		return;
 	}
 
-	ComPtr<Windows::Storage::Streams::IBufferByteAccess> sampleByteAccess;
-	hr = reinterpret_cast<IInspectable*>(mSample->Buffer)->QueryInterface(IID_PPV_ARGS(&sampleByteAccess));
-	if (FAILED(hr)) {
-		ms_error("MediaStreamSource::RenderFrame: mSample->Buffer QueryInterface failed %x", hr);
-		return;
-	}
-
 	BYTE* destRawData;
 	BYTE* buffer;
 	LONG pitch;
@@ -169,27 +244,10 @@ void libmswinrtvid::MediaStreamSource::RenderFrame(IMFMediaBuffer* mediaBuffer)
 		return;
 	}
 
-	BYTE* srcRawData = nullptr;
-	sampleByteAccess->Buffer(&srcRawData);
-	MSPicture src_pic;
+	/* The source planes are read with their own strides, so padded decoder output needs no repacking */
+	const MSPicture &src_pic = sample->Picture();
 	MSPicture dst_pic;
-	ms_yuv_buf_init(&src_pic, mSample->Width, mSample->Height, mSample->Width, srcRawData);
-	ms_yuv_buf_init(&dst_pic, mSample->Width, mSample->Height, pitch, destRawData);
-	/* Copy Y plane */
-	uint8_t *src_plane = src_pic.planes[0];
-	uint8_t *dst_plane = dst_pic.planes[0];
-	for (int i = 0; i < src_pic.h; ++i) {
-		memcpy(dst_plane, src_plane, src_pic.w);
-		src_plane += src_pic.w;
-		dst_plane += pitch;
-	}
-	/* Copy U & V plane with interleaving */
-	dst_plane = dst_pic.planes[1];
-	for (int i = 0; i < src_pic.h / 2; i++) {
-		for (int j = 0; j < src_pic.w / 2; j++) {
-			dst_plane[i * pitch + j * 2] = src_pic.planes[1][i * (src_pic.w / 2) + j];
-			dst_plane[i * pitch + j * 2 + 1] = src_pic.planes[2][i * (src_pic.w / 2) + j];
-		}
-	}
+	ms_yuv_buf_init(&dst_pic, src_pic.w, src_pic.h, pitch, destRawData);
+	libmswinrtvid::parallelConvertI420ToNV12(src_pic.planes, src_pic.strides, src_pic.w, src_pic.h, dst_pic.planes[0], pitch, dst_pic.planes[1], pitch);
 	imageBuffer->Unlock2D();
 }
@@ -23,12 +23,43 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #pragma once
 
 #include <Mfidl.h>
-#include <mutex>
-#include <collection.h>
+#include <wrl.h>
+
+#include <mediastreamer2/msvideo.h>
+
+#include "FrameMailbox.h"
+#include "PresentationClock.h"
+#include "RecyclingPool.h"
+#include "VideoWorkerPool.h"
 
 
 namespace libmswinrtvid
 {
+	// Hands out tracked samples with an NV12 2D buffer attached, that come back to the pool when Media Foundation releases them.
+	class SampleAllocator : public Microsoft::WRL::RuntimeClass<Microsoft::WRL::RuntimeClassFlags<Microsoft::WRL::ClassicCom>, IMFAsyncCallback>
+	{
+	public:
+		SampleAllocator();
+		virtual ~SampleAllocator();
+
+		HRESULT GetSample(int width, int height, IMFSample **sample);
+		RecyclingPool<IMFSample>::Stats GetStats() { return mPool.getStats(); }
+
+		// IMFAsyncCallback, invoked when the last reference on a sample handed out by GetSample() is released.
+		STDMETHODIMP GetParameters(DWORD *flags, DWORD *queue) { return E_NOTIMPL; }
+		STDMETHODIMP Invoke(IMFAsyncResult *result);
+
+	private:
+		class Backend : public RecyclingPoolBackend<IMFSample> {
+		public:
+			IMFSample * create(int width, int height);
+			void destroy(IMFSample *sample);
+		};
+
+		Backend mBackend;
+		RecyclingPool<IMFSample> mPool;
+	};
+
 	private ref class SampleRequestDeferral sealed
 	{
 	public:
@@ -59,14 +90,19 @@ namespace libmswinrtvid
 
 	private ref class Sample sealed
 	{
-	public:
-		Sample(Windows::Storage::Streams::IBuffer^ buffer, int width, int height)
+	internal:
+		// The buffer keeps the memory referenced by the picture planes alive. timestamp is the 90kHz one of the frame.
+		Sample(Windows::Storage::Streams::IBuffer^ buffer, const MSPicture &picture, uint32_t timestamp)
 		{
 			mBuffer = buffer;
-			mWidth = width;
-			mHeight = height;
+			mPicture = picture;
+			mTimestamp = timestamp;
 		}
 
+		const MSPicture & Picture() { return mPicture; }
+		uint32_t Timestamp() { return mTimestamp; }
+
+	public:
 		property Windows::Storage::Streams::IBuffer^ Buffer
 		{
 			Windows::Storage::Streams::IBuffer^ get() { return mBuffer; }
@@ -74,20 +110,20 @@ namespace libmswinrtvid
 
 		property int Width
 		{
-			int get() { return mWidth; }
+			int get() { return mPicture.w; }
 		}
 
 		property int Height
 		{
-			int get() { return mHeight; }
+			int get() { return mPicture.h; }
 		}
 
 	private:
 		~Sample() {};
 
 		Windows::Storage::Streams::IBuffer^ mBuffer;
-		int mWidth;
-		int mHeight;
+		MSPicture mPicture;
+		uint32_t mTimestamp;
 	};
 
 	ref class MediaStreamSource sealed
@@ -95,7 +131,6 @@ namespace libmswinrtvid
 	public:
 		static MediaStreamSource^ CreateMediaSource();
 
-		void Feed(Windows::Storage::Streams::IBuffer^ pBuffer, int width, int height);
 		void Stop();
 
 		property Windows::Media::Core::MediaStreamSource^ Source
@@ -103,20 +138,23 @@ namespace libmswinrtvid
 			Windows::Media::Core::MediaStreamSource^ get() { return mMediaStreamSource; }
 		}
 
+	internal:
+		void Feed(Windows::Storage::Streams::IBuffer^ pBuffer, const MSPicture &picture, uint32_t timestamp);
+
 	private:
 		MediaStreamSource();
 		~MediaStreamSource();
 
 		void OnSampleRequested(Windows::Media::Core::MediaStreamSource ^sender, Windows::Media::Core::MediaStreamSourceSampleRequestedEventArgs ^args);
-		void AnswerSampleRequest(Windows::Media::Core::MediaStreamSourceSampleRequest^ sampleRequest);
-		void RenderFrame(IMFMediaBuffer* mediaBuffer);
+		void AnswerSampleRequest(Windows::Media::Core::MediaStreamSourceSampleRequest^ sampleRequest, Sample^ sample);
+		void RenderFrame(IMFMediaBuffer* mediaBuffer, Sample^ sample);
 
+		Microsoft::WRL::ComPtr<SampleAllocator> mSampleAllocator;
 		Windows::Media::Core::MediaStreamSource^ mMediaStreamSource;
 		Windows::Media::Core::VideoStreamDescriptor^ mVideoDesc;
-		Platform::Collections::Vector<SampleRequestDeferral^>^ mDeferralQueue;
-		Sample^ mSample;
-		uint64 mTimeStamp;
-		uint64 mInitialTimeStamp;
-		std::mutex mMutex;
+		FrameMailbox<Sample^, SampleRequestDeferral^> mMailbox;
+		// Answer of the request that was waiting for a fed frame, running on the worker pool.
+		ConversionPipeline mAnswer;
+		PresentationClock mClock;
 	};
 }
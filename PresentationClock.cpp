@@ -0,0 +1,107 @@
+/*
+PresentationClock.cpp
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "PresentationClock.h"
+
+#include <chrono>
+
+using namespace libmswinrtvid;
+
+
+// Duration of the first sample, before there is a previous one to compare with.
+static const int64_t kDefaultDuration = PresentationClock::kUnitsPerSecond / 30;
+// Timestamp intervals beyond this one are not trusted: the stream has been restarted or frames have been lost.
+static const int64_t kMaxTimestampInterval = PresentationClock::kUnitsPerSecond;
+// Drift allowed between the times following the timestamps and the clock before they are realigned on the clock.
+static const int64_t kMaxDrift = PresentationClock::kUnitsPerSecond / 10;
+
+
+int64_t PresentationClock::now()
+{
+	std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now().time_since_epoch();
+	return (int64_t)(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / 100);
+}
+
+uint32_t PresentationClock::toTimestamp(int64_t time)
+{
+	// The whole seconds are converted apart so that the product cannot overflow.
+	int64_t seconds = time / kUnitsPerSecond;
+	int64_t remainder = time % kUnitsPerSecond;
+	return (uint32_t)(uint64_t)(seconds * 90000 + (remainder * 90000) / kUnitsPerSecond);
+}
+
+PresentationClock::PresentationClock()
+	: mStarted(false), mResetRequested(false), mOrigin(0), mLastNow(0), mLastTime(0), mLastDuration(kDefaultDuration),
+	mLastTimestamp(0), mTimestampRemainder(0)
+{
+}
+
+void PresentationClock::stamp(int64_t now, uint32_t timestamp, int64_t *time, int64_t *duration)
+{
+	if (mResetRequested.exchange(false) || !mStarted.load()) {
+		mOrigin = now;
+		mLastNow = now;
+		mLastTime = 0;
+		mLastDuration = kDefaultDuration;
+		mLastTimestamp = timestamp;
+		mTimestampRemainder = 0;
+		*time = 0;
+		*duration = kDefaultDuration;
+		// Published last, so that isStarted() is only true once the origin is set.
+		mStarted.store(true);
+		return;
+	}
+
+	int64_t interval = now - mLastNow;
+	// The difference is computed on 32 bits so that the wrapping of the timestamps is handled.
+	int64_t scaledInterval = (int64_t)(int32_t)(timestamp - mLastTimestamp) * kUnitsPerSecond + mTimestampRemainder;
+	int64_t timestampInterval = scaledInterval / 90000;
+	if ((timestampInterval > 0) && (timestampInterval <= kMaxTimestampInterval)) {
+		interval = timestampInterval;
+		mTimestampRemainder = scaledInterval % 90000;
+	} else {
+		mTimestampRemainder = 0;
+	}
+	if (interval < 1) interval = 1;
+	int64_t sampleTime = mLastTime + interval;
+	int64_t clockTime = now - mOrigin;
+	if (((sampleTime - clockTime) > kMaxDrift) || ((clockTime - sampleTime) > kMaxDrift)) {
+		// The timestamps do not follow the pace of the clock anymore.
+		sampleTime = (clockTime > mLastTime) ? clockTime : (mLastTime + 1);
+		interval = sampleTime - mLastTime;
+	}
+	if (interval > kMaxTimestampInterval) {
+		// A gap in the stream: the sample lasts as long as the previous ones, not the whole gap.
+		interval = mLastDuration;
+	}
+	mLastNow = now;
+	mLastTime = sampleTime;
+	mLastDuration = interval;
+	mLastTimestamp = timestamp;
+	*time = sampleTime;
+	*duration = interval;
+}
+
+void PresentationClock::reset()
+{
+	mResetRequested.store(true);
+}
@@ -0,0 +1,70 @@
+/*
+PresentationClock.h
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Times and durations of the samples handed to Media Foundation, in 100ns units. They follow the timestamps of the frames
+// when these are consistent, and a monotonic high-resolution clock otherwise, instead of GetTickCount64() whose 10 to 16ms
+// resolution shows as jitter. Like VideoKernels, this file only depends on the standard library.
+
+#include <atomic>
+#include <stdint.h>
+
+
+namespace libmswinrtvid
+{
+	class PresentationClock {
+	public:
+		static const int64_t kUnitsPerSecond = 10000000;
+
+		// Monotonic time in 100ns units, from an arbitrary origin.
+		static int64_t now();
+		// The 90kHz timestamp of a time in 100ns units, wrapping at 2^32 like the timestamps of the mblks.
+		static uint32_t toTimestamp(int64_t time);
+
+		PresentationClock();
+
+		// Computes the time of a sample, from the first one stamped, and its duration estimated from the previous sample.
+		// The duration is the interval since the previous sample, except after a gap of more than a second where the
+		// previous duration is kept rather than spanning the gap.
+		// now is the time the sample is handed out, timestamp the 90kHz timestamp of its frame (0 if it has none).
+		// The samples are stamped by one thread at a time, the one answering the sample requests.
+		void stamp(int64_t now, uint32_t timestamp, int64_t *time, int64_t *duration);
+
+		// Restarts the times from 0 at the next sample, to be called when the stream is restarted.
+		// reset() and isStarted() may be called from another thread than the one stamping the samples: reset() only
+		// raises a flag, consumed by the next stamp(), so that only the stamping thread touches the times.
+		void reset();
+		bool isStarted() const { return mStarted.load() && !mResetRequested.load(); }
+
+	private:
+		std::atomic<bool> mStarted;
+		std::atomic<bool> mResetRequested;
+		int64_t mOrigin;
+		int64_t mLastNow;
+		int64_t mLastTime;
+		int64_t mLastDuration;
+		uint32_t mLastTimestamp;
+		// Part of a 100ns unit left by the conversion of the timestamp intervals, carried so that the times do not drift.
+		int64_t mTimestampRemainder;
+	};
+}
@@ -0,0 +1,147 @@
+/*
+RecyclingPool.h
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Pool of objects that are expensive to create, such as the Media Foundation samples and the IBuffer wrappers.
+// The pool only decides when to reuse, create or destroy them; a backend does the actual creation and destruction.
+// Like VideoKernels, this file only depends on the standard library.
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+namespace libmswinrtvid
+{
+	template <typename Resource> class RecyclingPoolBackend {
+	public:
+		virtual ~RecyclingPoolBackend() {}
+		virtual Resource * create(int width, int height) = 0;
+		virtual void destroy(Resource *resource) = 0;
+	};
+
+	// Keeps up to maxIdle resources of the size of the last acquired one. The resources of another size are destroyed
+	// when they come back, so that a resolution change does not leave stale resources in the pool.
+	template <typename Resource> class RecyclingPool {
+	public:
+		struct Stats {
+			uint64_t hits;	// Resources taken from the pool.
+			uint64_t misses;	// Resources created by the backend.
+			uint64_t destroyed;	// Resources destroyed by the backend.
+			size_t idle;	// Resources waiting in the pool.
+		};
+
+		RecyclingPool(RecyclingPoolBackend<Resource> *backend, size_t maxIdle)
+			: mBackend(backend), mMaxIdle(maxIdle), mWidth(0), mHeight(0)
+		{
+			mStats.hits = 0;
+			mStats.misses = 0;
+			mStats.destroyed = 0;
+			mStats.idle = 0;
+		}
+
+		~RecyclingPool()
+		{
+			clear();
+		}
+
+		// Returns NULL if the backend fails to create a resource.
+		Resource * acquire(int width, int height)
+		{
+			std::vector<Resource *> stale;
+			Resource *resource = NULL;
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				if ((width != mWidth) || (height != mHeight)) {
+					stale.swap(mIdle);
+					mWidth = width;
+					mHeight = height;
+				}
+				if (!mIdle.empty()) {
+					resource = mIdle.back();
+					mIdle.pop_back();
+					mStats.hits++;
+				} else {
+					mStats.misses++;
+				}
+				mStats.destroyed += stale.size();
+				mStats.idle = mIdle.size();
+			}
+			// The backend is called without holding the lock, destroying a resource may release others.
+			destroyAll(stale);
+			if (resource == NULL) {
+				resource = mBackend->create(width, height);
+			}
+			return resource;
+		}
+
+		void recycle(Resource *resource, int width, int height)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				if ((width == mWidth) && (height == mHeight) && (mIdle.size() < mMaxIdle)) {
+					mIdle.push_back(resource);
+					mStats.idle = mIdle.size();
+					return;
+				}
+				mStats.destroyed++;
+			}
+			mBackend->destroy(resource);
+		}
+
+		void clear()
+		{
+			std::vector<Resource *> idle;
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				idle.swap(mIdle);
+				mStats.destroyed += idle.size();
+				mStats.idle = 0;
+			}
+			destroyAll(idle);
+		}
+
+		Stats getStats()
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			return mStats;
+		}
+
+	private:
+		void destroyAll(std::vector<Resource *> &resources)
+		{
+			for (size_t i = 0; i < resources.size(); i++) {
+				mBackend->destroy(resources[i]);
+			}
+		}
+
+		std::mutex mMutex;
+		RecyclingPoolBackend<Resource> *mBackend;
+		std::vector<Resource *> mIdle;
+		size_t mMaxIdle;
+		int mWidth;
+		int mHeight;
+		Stats mStats;
+	};
+}
@@ -276,10 +276,12 @@ void MSWinRTRenderer::Stop()
 	Close();
 }
 
-void MSWinRTRenderer::Feed(Windows::Storage::Streams::IBuffer^ pBuffer, int width, int height)
+void MSWinRTRenderer::Feed(Windows::Storage::Streams::IBuffer^ pBuffer, const MSPicture &picture, uint32_t timestamp)
 {
 	if ((mMediaStreamSource != nullptr) && (mSharedData != nullptr) && (mMediaEngineEx != nullptr)) {
 		bool sizeChanged = false;
+		int width = picture.w;
+		int height = picture.h;
 		HRESULT hr = mDevice->GetDeviceRemovedReason();
 		if (FAILED(hr)) {
 			ms_error("MSWinRTRenderer::Feed: Device lost %x", hr);
@@ -303,7 +305,7 @@ void MSWinRTRenderer::Feed(Windows::Storage::Streams::IBuffer^ pBuffer, int widt
 			mMediaEngineEx->UpdateVideoStream(&srcSize, &dstSize, &backgroundColor);
 		}
 
-		mMediaStreamSource->Feed(pBuffer, width, height);
+		mMediaStreamSource->Feed(pBuffer, picture, timestamp);
 	}
 }
 
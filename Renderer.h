@@ -46,6 +46,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <wrl\wrappers\corewrappers.h>
 #include <wrl\module.h>
 
+#include <mediastreamer2/msvideo.h>
+
 #include "MediaEngineNotify.h"
 #include "MediaStreamSource.h"
 #include "RemoteHandle.h"
@@ -84,7 +86,6 @@ namespace libmswinrtvid
 
 		bool Start();
 		void Stop();
-		void Feed(Windows::Storage::Streams::IBuffer^ pBuffer, int width, int height);
 		virtual void OnMediaEngineEvent(uint32 meEvent, uintptr_t param1, uint32 param2);
 		static bool D3D11Supported();
 
@@ -104,6 +105,9 @@ namespace libmswinrtvid
 			void set(Platform::String^ value) { mSwapChainPanelName = value; }
 		}
 
+	internal:
+		void Feed(Windows::Storage::Streams::IBuffer^ pBuffer, const MSPicture &picture, uint32_t timestamp);
+
 	private:
 		void Close();
 		void SetSwapChainPanel();
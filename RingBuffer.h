@@ -0,0 +1,146 @@
+/*
+RingBuffer.h
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Queue stored in a fixed array, to replace the List of LinkList.h that allocates a node for each item.
+// Like VideoKernels, this file only depends on the standard library.
+
+#include <stddef.h>
+#include <vector>
+
+
+namespace libmswinrtvid
+{
+	// What insertBack() does when the ring is full.
+	enum RingOverflowPolicy {
+		RingOverflowReject,	// The item is not inserted.
+		RingOverflowDropOldest,	// The front item is dropped to make room.
+		RingOverflowGrow	// The capacity is doubled, the only case where the ring allocates after its construction.
+	};
+
+	template <typename T> class RingBuffer {
+	public:
+		enum InsertResult {
+			Inserted,
+			InsertedDroppingOldest,
+			Rejected
+		};
+
+		// The capacity is rounded up to a power of two.
+		RingBuffer(size_t capacity, RingOverflowPolicy policy)
+			: mHead(0), mCount(0), mPolicy(policy)
+		{
+			size_t size = 1;
+			while (size < capacity) size <<= 1;
+			mItems.resize(size);
+			mMask = size - 1;
+		}
+
+		// When the front item is dropped to make room, it is returned in dropped so that the caller can release it.
+		InsertResult insertBack(const T &item, T *dropped = NULL)
+		{
+			InsertResult result = Inserted;
+			if (mCount == mItems.size()) {
+				switch (mPolicy) {
+				case RingOverflowReject:
+					return Rejected;
+				case RingOverflowDropOldest:
+					if (dropped != NULL) *dropped = mItems[mHead];
+					mItems[mHead] = T();
+					mHead = (mHead + 1) & mMask;
+					mCount--;
+					result = InsertedDroppingOldest;
+					break;
+				case RingOverflowGrow:
+					grow();
+					break;
+				}
+			}
+			mItems[(mHead + mCount) & mMask] = item;
+			mCount++;
+			return result;
+		}
+
+		// item can be NULL if the removed item is not needed.
+		bool removeFront(T *item)
+		{
+			if (mCount == 0) return false;
+			if (item != NULL) *item = mItems[mHead];
+			mItems[mHead] = T();
+			mHead = (mHead + 1) & mMask;
+			mCount--;
+			return true;
+		}
+
+		bool getFront(T *item) const
+		{
+			if (mCount == 0) return false;
+			*item = mItems[mHead];
+			return true;
+		}
+
+		// Calls clearFn on each item, from the front to the back, before removing them.
+		template <class FN> void clear(FN &clearFn)
+		{
+			while (mCount > 0) {
+				clearFn(mItems[mHead]);
+				mItems[mHead] = T();
+				mHead = (mHead + 1) & mMask;
+				mCount--;
+			}
+			mHead = 0;
+		}
+
+		void clear()
+		{
+			while (mCount > 0) {
+				mItems[mHead] = T();
+				mHead = (mHead + 1) & mMask;
+				mCount--;
+			}
+			mHead = 0;
+		}
+
+		size_t getCount() const { return mCount; }
+		size_t getCapacity() const { return mItems.size(); }
+		bool isEmpty() const { return mCount == 0; }
+
+	private:
+		void grow()
+		{
+			std::vector<T> items(mItems.size() * 2);
+			for (size_t i = 0; i < mCount; i++) {
+				items[i] = mItems[(mHead + i) & mMask];
+			}
+			mItems.swap(items);
+			mMask = mItems.size() - 1;
+			mHead = 0;
+		}
+
+		std::vector<T> mItems;
+		size_t mMask;
+		size_t mHead;
+		size_t mCount;
+		RingOverflowPolicy mPolicy;
+	};
+}
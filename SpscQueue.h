@@ -0,0 +1,164 @@
+/*
+SpscQueue.h
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Bounded queue between one producer thread and one consumer thread, used to pass the captured frames from the
+// Media Foundation thread to the ticker without a lock. When the queue is full, the producer may take the oldest item
+// back to make room for the new one.
+// Like VideoKernels, this file only depends on the standard library.
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+
+
+namespace libmswinrtvid
+{
+	// T must be trivially copyable, the items are stored in atomics.
+	template <typename T> class SpscQueue {
+	public:
+		// The capacity is rounded up to a power of two. The number of queued items is limited to capacity until setLimit()
+		// is called.
+		explicit SpscQueue(size_t capacity)
+			: mHead(0), mCachedTail(0), mTail(0), mCachedHead(0)
+		{
+			size_t size = 1;
+			while (size < capacity) size <<= 1;
+			mItems.reset(new std::atomic<T>[size]);
+			mMask = size - 1;
+			mLimit = size;
+		}
+
+		// Maximum number of queued items, between 1 and the capacity. May be changed while the queue is in use: if there
+		// are more items, the next pushes find it full until enough items have been removed.
+		void setLimit(size_t limit)
+		{
+			if (limit < 1) limit = 1;
+			if (limit > getCapacity()) limit = getCapacity();
+			mLimit.store(limit, std::memory_order_relaxed);
+		}
+
+		size_t getLimit() const { return mLimit.load(std::memory_order_relaxed); }
+
+		// Producer side. Returns false if the queue is full.
+		bool push(const T &item)
+		{
+			size_t tail = mTail.load(std::memory_order_relaxed);
+			size_t limit = mLimit.load(std::memory_order_relaxed);
+			if ((tail - mCachedHead) >= limit) {
+				mCachedHead = mHead.load(std::memory_order_acquire);
+				if ((tail - mCachedHead) >= limit) return false;
+			}
+			publish(tail, item);
+			return true;
+		}
+
+		// Producer side. Never fails: if the queue is full, its oldest item is removed and stored in evicted, and true is
+		// returned. The consumer may be removing the same item at the same time, the head index decides who gets it.
+		bool pushEvictingOldest(const T &item, T *evicted)
+		{
+			size_t tail = mTail.load(std::memory_order_relaxed);
+			size_t limit = mLimit.load(std::memory_order_relaxed);
+			bool dropped = false;
+			if ((tail - mCachedHead) >= limit) {
+				size_t head = mHead.load(std::memory_order_acquire);
+				while ((tail - head) >= limit) {
+					T oldest = mItems[head & mMask].load(std::memory_order_relaxed);
+					if (mHead.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+						*evicted = oldest;
+						dropped = true;
+						head++;
+						// A single eviction is enough to make room, even if the limit has just been lowered.
+						break;
+					}
+				}
+				mCachedHead = head;
+			}
+			publish(tail, item);
+			return dropped;
+		}
+
+		// Consumer side. Returns false if the queue is empty.
+		bool pop(T *item)
+		{
+			size_t head = mHead.load(std::memory_order_acquire);
+			for (;;) {
+				if (!isAhead(mCachedTail, head)) {
+					mCachedTail = mTail.load(std::memory_order_acquire);
+					if (!isAhead(mCachedTail, head)) return false;
+				}
+				T value = mItems[head & mMask].load(std::memory_order_relaxed);
+				if (mHead.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+					*item = value;
+					return true;
+				}
+			}
+		}
+
+		// Consumer side. Calls func on all the items present when it is called, in order. Returns the number of items.
+		template <typename FN> size_t drain(FN func)
+		{
+			size_t tail = mTail.load(std::memory_order_acquire);
+			size_t head = mHead.load(std::memory_order_acquire);
+			size_t count = 0;
+			mCachedTail = tail;
+			while (isAhead(tail, head)) {
+				T value = mItems[head & mMask].load(std::memory_order_relaxed);
+				if (mHead.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+					func(value);
+					count++;
+					head++;
+				}
+			}
+			return count;
+		}
+
+		size_t getCapacity() const { return mMask + 1; }
+
+	private:
+		static const size_t kCacheLineSize = 64;
+
+		// The indexes keep growing and wrap around, the items are at index & mMask.
+		static bool isAhead(size_t index, size_t other) { return (ptrdiff_t)(index - other) > 0; }
+
+		void publish(size_t tail, const T &item)
+		{
+			mItems[tail & mMask].store(item, std::memory_order_relaxed);
+			mTail.store(tail + 1, std::memory_order_release);
+		}
+
+		// The indexes are kept on their own cache line, with the copy of the other index that spares each side from
+		// reading it on each call. Padding is used rather than alignas, as the queue may be allocated with a smaller
+		// alignment.
+		char mPad0[kCacheLineSize];
+		std::atomic<size_t> mHead;	// Advanced by the consumer, and by the producer when it evicts an item.
+		size_t mCachedTail;
+		char mPad1[kCacheLineSize];
+		std::atomic<size_t> mTail;	// Only advanced by the producer.
+		size_t mCachedHead;
+		char mPad2[kCacheLineSize];
+		std::unique_ptr<std::atomic<T>[]> mItems;
+		size_t mMask;
+		std::atomic<size_t> mLimit;
+	};
+}
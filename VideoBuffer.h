@@ -33,6 +33,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include <mediastreamer2/mscommon.h>
 
+#include "RecyclingPool.h"
+
 
 namespace libmswinrtvid
 {
@@ -47,7 +49,9 @@ namespace libmswinrtvid
 	{
 	public:
 		virtual ~VideoBuffer() {
-			freemsg(mMblk);
+			if (mMblk != NULL) {
+				freemsg(mMblk);
+			}
 			mBuffer = NULL;
 		}
 
@@ -58,6 +62,43 @@ namespace libmswinrtvid
 			return S_OK;
 		}
 
+		/// <summary>
+		/// Wraps a buffer, reusing a wrapper released by Media Foundation if any. The wrapper takes ownership of the mblk.
+		/// </summary>
+		static Microsoft::WRL::ComPtr<VideoBuffer> Acquire(BYTE* pBuffer, UINT size, mblk_t *mblk) {
+			Microsoft::WRL::ComPtr<VideoBuffer> spVideoBuffer;
+			// The wrappers do not depend on the size of the frames.
+			VideoBuffer *videoBuffer = GetPool()->acquire(0, 0);
+			if (videoBuffer == NULL) {
+				freemsg(mblk);
+				return spVideoBuffer;
+			}
+			// The pooled wrappers have no reference left, the returned one holds the first.
+			videoBuffer->InternalAddRef();
+			videoBuffer->RuntimeClassInitialize(pBuffer, size, mblk);
+			spVideoBuffer.Attach(videoBuffer);
+			return spVideoBuffer;
+		}
+
+		static RecyclingPool<VideoBuffer>::Stats GetPoolStats() {
+			return GetPool()->getStats();
+		}
+
+		// Once the last reference is released, the frame is freed right away but the wrapper goes back to the pool instead of being deleted.
+		STDMETHOD_(ULONG, Release)() {
+			ULONG ref = InternalRelease();
+			if (ref == 0) {
+				if (mMblk != NULL) {
+					freemsg(mMblk);
+					mMblk = NULL;
+				}
+				mBuffer = NULL;
+				mSize = 0;
+				GetPool()->recycle(this, 0, 0);
+			}
+			return ref;
+		}
+
 		STDMETHODIMP Buffer(BYTE **value) {
 			*value = mBuffer;
 			return S_OK;
@@ -87,6 +128,36 @@ namespace libmswinrtvid
 		}
 
 	private:
+		class PoolBackend : public RecyclingPoolBackend<VideoBuffer> {
+		public:
+			VideoBuffer * create(int width, int height) {
+				Microsoft::WRL::ComPtr<VideoBuffer> spVideoBuffer;
+				if (FAILED(Microsoft::WRL::MakeAndInitialize<VideoBuffer>(&spVideoBuffer, (BYTE *)NULL, 0, (mblk_t *)NULL))) {
+					return NULL;
+				}
+				// Drop the reference without going through Release(), Acquire() takes a new one.
+				VideoBuffer *videoBuffer = spVideoBuffer.Detach();
+				videoBuffer->InternalRelease();
+				return videoBuffer;
+			}
+
+			void destroy(VideoBuffer *videoBuffer) {
+				// What the default Release() does when the last reference is released.
+				delete videoBuffer;
+				auto modulePtr = Microsoft::WRL::GetModuleBase();
+				if (modulePtr != nullptr) {
+					modulePtr->DecrementObjectCount();
+				}
+			}
+		};
+
+		static RecyclingPool<VideoBuffer> * GetPool() {
+			// Shared by the display filters and never destroyed, the wrappers may be released by Media Foundation at any time.
+			static PoolBackend *backend = new PoolBackend();
+			static RecyclingPool<VideoBuffer> *pool = new RecyclingPool<VideoBuffer>(backend, 8);
+			return pool;
+		}
+
 		UINT32 mSize;
 		BYTE* mBuffer;
 		mblk_t *mMblk;
@@ -0,0 +1,989 @@
+/*
+VideoKernels.cpp
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "VideoKernels.h"
+
+#include <string.h>
+#include <vector>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define VIDEO_KERNELS_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define VIDEO_KERNELS_TARGET_SSE2
+#define VIDEO_KERNELS_TARGET_AVX2
+#else
+#define VIDEO_KERNELS_TARGET_SSE2 __attribute__((target("sse2")))
+#define VIDEO_KERNELS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(_M_ARM) || defined(_M_ARM64) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VIDEO_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+
+using namespace libmswinrtvid;
+
+
+typedef void (*InterleaveUVRowFunc)(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width);
+
+
+static void interleaveUVRowScalar(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width)
+{
+	for (int i = 0; i < width; i++) {
+		dst[2 * i] = u[i];
+		dst[2 * i + 1] = v[i];
+	}
+}
+
+typedef void (*DeinterleaveUVRowFunc)(uint8_t *u, uint8_t *v, const uint8_t *uv, int width);
+// Writes the columns of a 8x8 block as the rows of dst. The strides may be negative to flip the block.
+typedef void (*TransposeBlockFunc)(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride);
+// Same as TransposeBlockFunc for a block of 8x8 interleaved UV samples, splitting them into dstU and dstV.
+typedef void (*TransposeUVBlockFunc)(const uint8_t *src, int srcStride, uint8_t *dstU, int dstUStride, uint8_t *dstV, int dstVStride);
+
+struct RotateKernels {
+	DeinterleaveUVRowFunc deinterleaveUVRow;
+	TransposeBlockFunc transposeBlock;
+	TransposeUVBlockFunc transposeUVBlock;
+};
+
+static const int kRotateBlockSize = 8;
+static const int kRotateTileSize = 64;
+
+// Writes count samples blending row0 and row1, fraction being the weight of row1 in 1/256.
+typedef void (*BlendRowsFunc)(uint8_t *dst, const uint8_t *row0, const uint8_t *row1, int fraction, int count);
+
+// Accumulates the stripes of 32 bytes of a row into the four 64-bit lanes of acc, the first stripe having the given index.
+// Returns the number of bytes consumed. Each lane is updated as acc += lo32(d ^ k) * hi32(d ^ k) + d, k being a key
+// that changes with the stripe so that swapping two stripes changes the result.
+typedef int (*FingerprintRowFunc)(uint64_t acc[4], const uint8_t *row, int width);
+
+static const uint64_t kFingerprintKeys[4] = { 0x9e3779b185ebca87ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL, 0x85ebca77c2b2ae63ULL };
+static const uint64_t kFingerprintKeyStep = 0x27d4eb2f165667c5ULL;
+static const uint64_t kFingerprintPrime = 0x9e3779b97f4a7c15ULL;
+
+
+static void deinterleaveUVRowScalar(uint8_t *u, uint8_t *v, const uint8_t *uv, int width)
+{
+	for (int i = 0; i < width; i++) {
+		u[i] = uv[2 * i];
+		v[i] = uv[2 * i + 1];
+	}
+}
+
+static void transposeBlockScalar(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride)
+{
+	for (int i = 0; i < kRotateBlockSize; i++) {
+		for (int j = 0; j < kRotateBlockSize; j++) {
+			dst[i * dstStride + j] = src[j * srcStride + i];
+		}
+	}
+}
+
+static void transposeUVBlockScalar(const uint8_t *src, int srcStride, uint8_t *dstU, int dstUStride, uint8_t *dstV, int dstVStride)
+{
+	for (int i = 0; i < kRotateBlockSize; i++) {
+		for (int j = 0; j < kRotateBlockSize; j++) {
+			dstU[i * dstUStride + j] = src[j * srcStride + 2 * i];
+			dstV[i * dstVStride + j] = src[j * srcStride + 2 * i + 1];
+		}
+	}
+}
+
+static void blendRowsScalar(uint8_t *dst, const uint8_t *row0, const uint8_t *row1, int fraction, int count)
+{
+	int weight0 = 256 - fraction;
+	for (int i = 0; i < count; i++) {
+		dst[i] = (uint8_t)((row0[i] * weight0 + row1[i] * fraction + 128) >> 8);
+	}
+}
+
+static inline uint64_t loadUint64(const uint8_t *p)
+{
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static int fingerprintRowScalar(uint64_t acc[4], const uint8_t *row, int width)
+{
+	int i = 0;
+	for (int stripe = 0; i + 32 <= width; i += 32, stripe++) {
+		for (int lane = 0; lane < 4; lane++) {
+			uint64_t data = loadUint64(row + i + 8 * lane);
+			uint64_t keyed = data ^ (kFingerprintKeys[lane] + stripe * kFingerprintKeyStep);
+			acc[lane] += (keyed & 0xffffffffULL) * (keyed >> 32) + data;
+		}
+	}
+	return i;
+}
+
+#ifdef VIDEO_KERNELS_X86
+VIDEO_KERNELS_TARGET_SSE2 static void interleaveUVRowSSE2(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width)
+{
+	int i = 0;
+	for (; i + 16 <= width; i += 16) {
+		__m128i mu = _mm_loadu_si128((const __m128i *)(u + i));
+		__m128i mv = _mm_loadu_si128((const __m128i *)(v + i));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi8(mu, mv));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i + 16), _mm_unpackhi_epi8(mu, mv));
+	}
+	interleaveUVRowScalar(dst + 2 * i, u + i, v + i, width - i);
+}
+
+VIDEO_KERNELS_TARGET_AVX2 static void interleaveUVRowAVX2(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width)
+{
+	int i = 0;
+	for (; i + 32 <= width; i += 32) {
+		__m256i mu = _mm256_loadu_si256((const __m256i *)(u + i));
+		__m256i mv = _mm256_loadu_si256((const __m256i *)(v + i));
+		// The unpack instructions work on each 128-bit lane, put the lanes back in order afterwards.
+		__m256i lo = _mm256_unpacklo_epi8(mu, mv);
+		__m256i hi = _mm256_unpackhi_epi8(mu, mv);
+		_mm256_storeu_si256((__m256i *)(dst + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(dst + 2 * i + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+	interleaveUVRowSSE2(dst + 2 * i, u + i, v + i, width - i);
+}
+
+VIDEO_KERNELS_TARGET_SSE2 static void deinterleaveUVRowSSE2(uint8_t *u, uint8_t *v, const uint8_t *uv, int width)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	int i = 0;
+	for (; i + 16 <= width; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(uv + 2 * i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(uv + 2 * i + 16));
+		_mm_storeu_si128((__m128i *)(u + i), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+		_mm_storeu_si128((__m128i *)(v + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+	}
+	deinterleaveUVRowScalar(u + i, v + i, uv + 2 * i, width - i);
+}
+
+VIDEO_KERNELS_TARGET_SSE2 static void blendRowsSSE2(uint8_t *dst, const uint8_t *row0, const uint8_t *row1, int fraction, int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i weight0 = _mm_set1_epi16((short)(256 - fraction));
+	const __m128i weight1 = _mm_set1_epi16((short)fraction);
+	const __m128i round = _mm_set1_epi16(128);
+	int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(row0 + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(row1 + i));
+		// The sums fit in unsigned 16-bit words: 255 * 256 + 128 < 65536.
+		__m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), weight0), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), weight1)), round);
+		__m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), weight0), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), weight1)), round);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+	}
+	blendRowsScalar(dst + i, row0 + i, row1 + i, fraction, count - i);
+}
+
+VIDEO_KERNELS_TARGET_AVX2 static void blendRowsAVX2(uint8_t *dst, const uint8_t *row0, const uint8_t *row1, int fraction, int count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i weight0 = _mm256_set1_epi16((short)(256 - fraction));
+	const __m256i weight1 = _mm256_set1_epi16((short)fraction);
+	const __m256i round = _mm256_set1_epi16(128);
+	int i = 0;
+	for (; i + 32 <= count; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(row0 + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(row1 + i));
+		// Unpacking and packing both work on each 128-bit lane, so the samples stay in order.
+		__m256i lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), weight0), _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), weight1)), round);
+		__m256i hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), weight0), _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), weight1)), round);
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+	}
+	blendRowsSSE2(dst + i, row0 + i, row1 + i, fraction, count - i);
+}
+
+VIDEO_KERNELS_TARGET_SSE2 static int fingerprintRowSSE2(uint64_t acc[4], const uint8_t *row, int width)
+{
+	__m128i acc0 = _mm_loadu_si128((const __m128i *)acc);
+	__m128i acc1 = _mm_loadu_si128((const __m128i *)(acc + 2));
+	__m128i key0 = _mm_loadu_si128((const __m128i *)kFingerprintKeys);
+	__m128i key1 = _mm_loadu_si128((const __m128i *)(kFingerprintKeys + 2));
+	const __m128i keyStep = _mm_set1_epi64x((long long)kFingerprintKeyStep);
+	int i = 0;
+	for (; i + 32 <= width; i += 32) {
+		__m128i data0 = _mm_loadu_si128((const __m128i *)(row + i));
+		__m128i data1 = _mm_loadu_si128((const __m128i *)(row + i + 16));
+		__m128i keyed0 = _mm_xor_si128(data0, key0);
+		__m128i keyed1 = _mm_xor_si128(data1, key1);
+		// _mm_mul_epu32 multiplies the low 32 bits of each 64-bit lane.
+		acc0 = _mm_add_epi64(acc0, _mm_add_epi64(_mm_mul_epu32(keyed0, _mm_srli_epi64(keyed0, 32)), data0));
+		acc1 = _mm_add_epi64(acc1, _mm_add_epi64(_mm_mul_epu32(keyed1, _mm_srli_epi64(keyed1, 32)), data1));
+		key0 = _mm_add_epi64(key0, keyStep);
+		key1 = _mm_add_epi64(key1, keyStep);
+	}
+	_mm_storeu_si128((__m128i *)acc, acc0);
+	_mm_storeu_si128((__m128i *)(acc + 2), acc1);
+	return i;
+}
+
+VIDEO_KERNELS_TARGET_AVX2 static int fingerprintRowAVX2(uint64_t acc[4], const uint8_t *row, int width)
+{
+	__m256i acc0 = _mm256_loadu_si256((const __m256i *)acc);
+	__m256i key = _mm256_loadu_si256((const __m256i *)kFingerprintKeys);
+	const __m256i keyStep = _mm256_set1_epi64x((long long)kFingerprintKeyStep);
+	int i = 0;
+	for (; i + 32 <= width; i += 32) {
+		__m256i data = _mm256_loadu_si256((const __m256i *)(row + i));
+		__m256i keyed = _mm256_xor_si256(data, key);
+		acc0 = _mm256_add_epi64(acc0, _mm256_add_epi64(_mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32)), data));
+		key = _mm256_add_epi64(key, keyStep);
+	}
+	_mm256_storeu_si256((__m256i *)acc, acc0);
+	return i;
+}
+
+VIDEO_KERNELS_TARGET_SSE2 static void transposeBlockSSE2(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride)
+{
+	__m128i r0 = _mm_loadl_epi64((const __m128i *)(src));
+	__m128i r1 = _mm_loadl_epi64((const __m128i *)(src + srcStride));
+	__m128i r2 = _mm_loadl_epi64((const __m128i *)(src + 2 * srcStride));
+	__m128i r3 = _mm_loadl_epi64((const __m128i *)(src + 3 * srcStride));
+	__m128i r4 = _mm_loadl_epi64((const __m128i *)(src + 4 * srcStride));
+	__m128i r5 = _mm_loadl_epi64((const __m128i *)(src + 5 * srcStride));
+	__m128i r6 = _mm_loadl_epi64((const __m128i *)(src + 6 * srcStride));
+	__m128i r7 = _mm_loadl_epi64((const __m128i *)(src + 7 * srcStride));
+	__m128i a0 = _mm_unpacklo_epi8(r0, r1);
+	__m128i a1 = _mm_unpacklo_epi8(r2, r3);
+	__m128i a2 = _mm_unpacklo_epi8(r4, r5);
+	__m128i a3 = _mm_unpacklo_epi8(r6, r7);
+	__m128i b0 = _mm_unpacklo_epi16(a0, a1);
+	__m128i b1 = _mm_unpackhi_epi16(a0, a1);
+	__m128i b2 = _mm_unpacklo_epi16(a2, a3);
+	__m128i b3 = _mm_unpackhi_epi16(a2, a3);
+	// Each register now holds two columns of the block.
+	__m128i c0 = _mm_unpacklo_epi32(b0, b2);
+	__m128i c1 = _mm_unpackhi_epi32(b0, b2);
+	__m128i c2 = _mm_unpacklo_epi32(b1, b3);
+	__m128i c3 = _mm_unpackhi_epi32(b1, b3);
+	_mm_storel_epi64((__m128i *)(dst), c0);
+	_mm_storel_epi64((__m128i *)(dst + dstStride), _mm_srli_si128(c0, 8));
+	_mm_storel_epi64((__m128i *)(dst + 2 * dstStride), c1);
+	_mm_storel_epi64((__m128i *)(dst + 3 * dstStride), _mm_srli_si128(c1, 8));
+	_mm_storel_epi64((__m128i *)(dst + 4 * dstStride), c2);
+	_mm_storel_epi64((__m128i *)(dst + 5 * dstStride), _mm_srli_si128(c2, 8));
+	_mm_storel_epi64((__m128i *)(dst + 6 * dstStride), c3);
+	_mm_storel_epi64((__m128i *)(dst + 7 * dstStride), _mm_srli_si128(c3, 8));
+}
+
+VIDEO_KERNELS_TARGET_SSE2 static void storeUVColumnSSE2(__m128i column, uint8_t *dstU, uint8_t *dstV)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	_mm_storel_epi64((__m128i *)dstU, _mm_packus_epi16(_mm_and_si128(column, mask), mask));
+	_mm_storel_epi64((__m128i *)dstV, _mm_packus_epi16(_mm_srli_epi16(column, 8), mask));
+}
+
+VIDEO_KERNELS_TARGET_SSE2 static void transposeUVBlockSSE2(const uint8_t *src, int srcStride, uint8_t *dstU, int dstUStride, uint8_t *dstV, int dstVStride)
+{
+	// Transpose the block as 16-bit UV pairs, then split each column into its U and V parts.
+	__m128i r0 = _mm_loadu_si128((const __m128i *)(src));
+	__m128i r1 = _mm_loadu_si128((const __m128i *)(src + srcStride));
+	__m128i r2 = _mm_loadu_si128((const __m128i *)(src + 2 * srcStride));
+	__m128i r3 = _mm_loadu_si128((const __m128i *)(src + 3 * srcStride));
+	__m128i r4 = _mm_loadu_si128((const __m128i *)(src + 4 * srcStride));
+	__m128i r5 = _mm_loadu_si128((const __m128i *)(src + 5 * srcStride));
+	__m128i r6 = _mm_loadu_si128((const __m128i *)(src + 6 * srcStride));
+	__m128i r7 = _mm_loadu_si128((const __m128i *)(src + 7 * srcStride));
+	__m128i a0 = _mm_unpacklo_epi16(r0, r1);
+	__m128i a1 = _mm_unpackhi_epi16(r0, r1);
+	__m128i a2 = _mm_unpacklo_epi16(r2, r3);
+	__m128i a3 = _mm_unpackhi_epi16(r2, r3);
+	__m128i a4 = _mm_unpacklo_epi16(r4, r5);
+	__m128i a5 = _mm_unpackhi_epi16(r4, r5);
+	__m128i a6 = _mm_unpacklo_epi16(r6, r7);
+	__m128i a7 = _mm_unpackhi_epi16(r6, r7);
+	__m128i b0 = _mm_unpacklo_epi32(a0, a2);
+	__m128i b1 = _mm_unpackhi_epi32(a0, a2);
+	__m128i b2 = _mm_unpacklo_epi32(a1, a3);
+	__m128i b3 = _mm_unpackhi_epi32(a1, a3);
+	__m128i b4 = _mm_unpacklo_epi32(a4, a6);
+	__m128i b5 = _mm_unpackhi_epi32(a4, a6);
+	__m128i b6 = _mm_unpacklo_epi32(a5, a7);
+	__m128i b7 = _mm_unpackhi_epi32(a5, a7);
+	storeUVColumnSSE2(_mm_unpacklo_epi64(b0, b4), dstU, dstV);
+	storeUVColumnSSE2(_mm_unpackhi_epi64(b0, b4), dstU + dstUStride, dstV + dstVStride);
+	storeUVColumnSSE2(_mm_unpacklo_epi64(b1, b5), dstU + 2 * dstUStride, dstV + 2 * dstVStride);
+	storeUVColumnSSE2(_mm_unpackhi_epi64(b1, b5), dstU + 3 * dstUStride, dstV + 3 * dstVStride);
+	storeUVColumnSSE2(_mm_unpacklo_epi64(b2, b6), dstU + 4 * dstUStride, dstV + 4 * dstVStride);
+	storeUVColumnSSE2(_mm_unpackhi_epi64(b2, b6), dstU + 5 * dstUStride, dstV + 5 * dstVStride);
+	storeUVColumnSSE2(_mm_unpacklo_epi64(b3, b7), dstU + 6 * dstUStride, dstV + 6 * dstVStride);
+	storeUVColumnSSE2(_mm_unpackhi_epi64(b3, b7), dstU + 7 * dstUStride, dstV + 7 * dstVStride);
+}
+
+static bool cpuHasSSE2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	return __builtin_cpu_supports("sse2") != 0;
+#endif
+}
+
+static bool cpuHasAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	// AVX and OSXSAVE are required, and the OS must save the YMM registers.
+	if ((info[2] & ((1 << 27) | (1 << 28))) != ((1 << 27) | (1 << 28))) return false;
+	if ((_xgetbv(0) & 0x6) != 0x6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+#ifdef VIDEO_KERNELS_NEON
+static void interleaveUVRowNEON(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width)
+{
+	int i = 0;
+	for (; i + 16 <= width; i += 16) {
+		uint8x16x2_t uv;
+		uv.val[0] = vld1q_u8(u + i);
+		uv.val[1] = vld1q_u8(v + i);
+		vst2q_u8(dst + 2 * i, uv);
+	}
+	interleaveUVRowScalar(dst + 2 * i, u + i, v + i, width - i);
+}
+
+static void blendRowsNEON(uint8_t *dst, const uint8_t *row0, const uint8_t *row1, int fraction, int count)
+{
+	const uint8x8_t weight0 = vdup_n_u8((uint8_t)(256 - fraction));
+	const uint8x8_t weight1 = vdup_n_u8((uint8_t)fraction);
+	int i = 0;
+	// A fraction of 0 would need a weight of 256 for row0, the callers copy row0 in that case.
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t a = vld1q_u8(row0 + i);
+		uint8x16_t b = vld1q_u8(row1 + i);
+		uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(a), weight0), vget_low_u8(b), weight1);
+		uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(a), weight0), vget_high_u8(b), weight1);
+		vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+	}
+	blendRowsScalar(dst + i, row0 + i, row1 + i, fraction, count - i);
+}
+
+static int fingerprintRowNEON(uint64_t acc[4], const uint8_t *row, int width)
+{
+	uint64x2_t acc0 = vld1q_u64(acc);
+	uint64x2_t acc1 = vld1q_u64(acc + 2);
+	uint64x2_t key0 = vld1q_u64(kFingerprintKeys);
+	uint64x2_t key1 = vld1q_u64(kFingerprintKeys + 2);
+	const uint64x2_t keyStep = vdupq_n_u64(kFingerprintKeyStep);
+	int i = 0;
+	for (; i + 32 <= width; i += 32) {
+		uint64x2_t data0 = vreinterpretq_u64_u8(vld1q_u8(row + i));
+		uint64x2_t data1 = vreinterpretq_u64_u8(vld1q_u8(row + i + 16));
+		uint64x2_t keyed0 = veorq_u64(data0, key0);
+		uint64x2_t keyed1 = veorq_u64(data1, key1);
+		acc0 = vaddq_u64(acc0, vaddq_u64(vmull_u32(vmovn_u64(keyed0), vshrn_n_u64(keyed0, 32)), data0));
+		acc1 = vaddq_u64(acc1, vaddq_u64(vmull_u32(vmovn_u64(keyed1), vshrn_n_u64(keyed1, 32)), data1));
+		key0 = vaddq_u64(key0, keyStep);
+		key1 = vaddq_u64(key1, keyStep);
+	}
+	vst1q_u64(acc, acc0);
+	vst1q_u64(acc + 2, acc1);
+	return i;
+}
+#endif
+
+
+static VideoKernelsIsa detectIsa()
+{
+#if defined(VIDEO_KERNELS_X86)
+	if (cpuHasAVX2()) return VideoKernelsIsaAVX2;
+	if (cpuHasSSE2()) return VideoKernelsIsaSSE2;
+#elif defined(VIDEO_KERNELS_NEON)
+	return VideoKernelsIsaNEON;
+#endif
+	return VideoKernelsIsaScalar;
+}
+
+static InterleaveUVRowFunc selectInterleaveUVRow(VideoKernelsIsa isa)
+{
+	switch (isa) {
+#ifdef VIDEO_KERNELS_X86
+	case VideoKernelsIsaAVX2:
+		return interleaveUVRowAVX2;
+	case VideoKernelsIsaSSE2:
+		return interleaveUVRowSSE2;
+#endif
+#ifdef VIDEO_KERNELS_NEON
+	case VideoKernelsIsaNEON:
+		return interleaveUVRowNEON;
+#endif
+	default:
+		return interleaveUVRowScalar;
+	}
+}
+
+static RotateKernels selectRotateKernels(VideoKernelsIsa isa)
+{
+	RotateKernels kernels = { deinterleaveUVRowScalar, transposeBlockScalar, transposeUVBlockScalar };
+#ifdef VIDEO_KERNELS_X86
+	if (isa != VideoKernelsIsaScalar) {
+		kernels.deinterleaveUVRow = deinterleaveUVRowSSE2;
+		kernels.transposeBlock = transposeBlockSSE2;
+		kernels.transposeUVBlock = transposeUVBlockSSE2;
+	}
+#endif
+	return kernels;
+}
+
+
+static FingerprintRowFunc selectFingerprintRow(VideoKernelsIsa isa)
+{
+	switch (isa) {
+#ifdef VIDEO_KERNELS_X86
+	case VideoKernelsIsaAVX2:
+		return fingerprintRowAVX2;
+	case VideoKernelsIsaSSE2:
+		return fingerprintRowSSE2;
+#endif
+#ifdef VIDEO_KERNELS_NEON
+	case VideoKernelsIsaNEON:
+		return fingerprintRowNEON;
+#endif
+	default:
+		return fingerprintRowScalar;
+	}
+}
+
+static inline uint64_t mixFingerprint(uint64_t value)
+{
+	value ^= value >> 29;
+	value *= kFingerprintPrime;
+	value ^= value >> 32;
+	return value;
+}
+
+static BlendRowsFunc selectBlendRows(VideoKernelsIsa isa)
+{
+	switch (isa) {
+#ifdef VIDEO_KERNELS_X86
+	case VideoKernelsIsaAVX2:
+		return blendRowsAVX2;
+	case VideoKernelsIsaSSE2:
+		return blendRowsSSE2;
+#endif
+#ifdef VIDEO_KERNELS_NEON
+	case VideoKernelsIsaNEON:
+		return blendRowsNEON;
+#endif
+	default:
+		return blendRowsScalar;
+	}
+}
+
+// Kernels of the instruction set in use, selected once unless setVideoKernelsIsa() is called.
+struct KernelTable {
+	VideoKernelsIsa isa;
+	InterleaveUVRowFunc interleaveUVRow;
+	RotateKernels rotate;
+	BlendRowsFunc blendRows;
+	FingerprintRowFunc fingerprintRow;
+};
+
+static KernelTable selectKernels(VideoKernelsIsa isa)
+{
+	KernelTable table;
+	table.isa = isa;
+	table.interleaveUVRow = selectInterleaveUVRow(isa);
+	table.rotate = selectRotateKernels(isa);
+	table.blendRows = selectBlendRows(isa);
+	table.fingerprintRow = selectFingerprintRow(isa);
+	return table;
+}
+
+static KernelTable & kernels()
+{
+	static KernelTable table = selectKernels(detectIsa());
+	return table;
+}
+
+static const RotateKernels & rotateKernels()
+{
+	return kernels().rotate;
+}
+
+static inline int minInt(int a, int b)
+{
+	return (a < b) ? a : b;
+}
+
+// Rotates a plane by a quarter turn, possibly mirrored. The source sample at (x, y) goes to row x, or width - 1 - x
+// when reverseRows is set, and to column y, or height - 1 - y when reverseColumns is set. A clockwise turn reverses
+// the columns, a counter-clockwise one reverses the rows, and mirroring the result toggles the columns.
+static void rotatePlane90(const uint8_t *src, int srcStride, int width, int height, uint8_t *dst, int dstStride, bool reverseRows, bool reverseColumns)
+{
+	TransposeBlockFunc transposeBlock = rotateKernels().transposeBlock;
+	int bw = width & ~(kRotateBlockSize - 1);
+	int bh = height & ~(kRotateBlockSize - 1);
+	int blockSrcStride = reverseColumns ? -srcStride : srcStride;
+	int blockDstStride = reverseRows ? -dstStride : dstStride;
+	for (int ty = 0; ty < bh; ty += kRotateTileSize) {
+		int tyEnd = minInt(ty + kRotateTileSize, bh);
+		for (int tx = 0; tx < bw; tx += kRotateTileSize) {
+			int txEnd = minInt(tx + kRotateTileSize, bw);
+			for (int y = ty; y < tyEnd; y += kRotateBlockSize) {
+				const uint8_t *srcRow = src + (reverseColumns ? (y + kRotateBlockSize - 1) : y) * srcStride;
+				int column = reverseColumns ? (height - kRotateBlockSize - y) : y;
+				for (int x = tx; x < txEnd; x += kRotateBlockSize) {
+					int row = reverseRows ? (width - 1 - x) : x;
+					transposeBlock(srcRow + x, blockSrcStride, dst + row * dstStride + column, blockDstStride);
+				}
+			}
+		}
+	}
+	// Right and bottom borders that do not fill a whole block
+	for (int y = 0; y < height; y++) {
+		int column = reverseColumns ? (height - 1 - y) : y;
+		for (int x = (y < bh) ? bw : 0; x < width; x++) {
+			int row = reverseRows ? (width - 1 - x) : x;
+			dst[row * dstStride + column] = src[y * srcStride + x];
+		}
+	}
+}
+
+// Same as rotatePlane90 for an interleaved UV plane of width x height samples.
+static void rotateUVPlane90(const uint8_t *src, int srcStride, int width, int height, uint8_t *dstU, int dstUStride, uint8_t *dstV, int dstVStride, bool reverseRows, bool reverseColumns)
+{
+	TransposeUVBlockFunc transposeUVBlock = rotateKernels().transposeUVBlock;
+	int bw = width & ~(kRotateBlockSize - 1);
+	int bh = height & ~(kRotateBlockSize - 1);
+	int blockSrcStride = reverseColumns ? -srcStride : srcStride;
+	int blockDstUStride = reverseRows ? -dstUStride : dstUStride;
+	int blockDstVStride = reverseRows ? -dstVStride : dstVStride;
+	for (int ty = 0; ty < bh; ty += kRotateTileSize) {
+		int tyEnd = minInt(ty + kRotateTileSize, bh);
+		for (int tx = 0; tx < bw; tx += kRotateTileSize) {
+			int txEnd = minInt(tx + kRotateTileSize, bw);
+			for (int y = ty; y < tyEnd; y += kRotateBlockSize) {
+				const uint8_t *srcRow = src + (reverseColumns ? (y + kRotateBlockSize - 1) : y) * srcStride;
+				int column = reverseColumns ? (height - kRotateBlockSize - y) : y;
+				for (int x = tx; x < txEnd; x += kRotateBlockSize) {
+					int row = reverseRows ? (width - 1 - x) : x;
+					transposeUVBlock(srcRow + 2 * x, blockSrcStride,
+						dstU + row * dstUStride + column, blockDstUStride, dstV + row * dstVStride + column, blockDstVStride);
+				}
+			}
+		}
+	}
+	for (int y = 0; y < height; y++) {
+		int column = reverseColumns ? (height - 1 - y) : y;
+		for (int x = (y < bh) ? bw : 0; x < width; x++) {
+			const uint8_t *uv = src + y * srcStride + 2 * x;
+			int row = reverseRows ? (width - 1 - x) : x;
+			dstU[row * dstUStride + column] = uv[0];
+			dstV[row * dstVStride + column] = uv[1];
+		}
+	}
+}
+
+// Half turns and mirrors read and write both planes row by row, so they do not need any tiling.
+// The samples of each row are always reversed, the order of the rows only when reverseRows is set.
+static void mirrorPlane(const uint8_t *src, int srcStride, int width, int height, uint8_t *dst, int dstStride, bool reverseRows)
+{
+	for (int y = 0; y < height; y++) {
+		const uint8_t *s = src + (reverseRows ? (height - 1 - y) : y) * srcStride + width - 1;
+		uint8_t *d = dst + y * dstStride;
+		for (int x = 0; x < width; x++) {
+			d[x] = *(s - x);
+		}
+	}
+}
+
+static void mirrorUVPlane(const uint8_t *src, int srcStride, int width, int height, uint8_t *dstU, int dstUStride, uint8_t *dstV, int dstVStride, bool reverseRows)
+{
+	for (int y = 0; y < height; y++) {
+		const uint8_t *s = src + (reverseRows ? (height - 1 - y) : y) * srcStride + 2 * (width - 1);
+		uint8_t *u = dstU + y * dstUStride;
+		uint8_t *v = dstV + y * dstVStride;
+		for (int x = 0; x < width; x++) {
+			u[x] = *(s - 2 * x);
+			v[x] = *(s - 2 * x + 1);
+		}
+	}
+}
+
+// Bilinear scaler of a plane made of pixelStep interleaved samples per pixel, computing one destination row at a time.
+// The vertical pass blends two whole source rows with the SIMD kernels, the horizontal pass then picks and blends
+// the samples of the blended row with precomputed taps.
+class PlaneScaler {
+public:
+	PlaneScaler(int srcWidth, int srcHeight, int dstWidth, int dstHeight, int pixelStep)
+		: mSrcHeight(srcHeight), mDstWidth(dstWidth), mDstHeight(dstHeight), mPixelStep(pixelStep),
+		mFirst(dstWidth), mSecond(dstWidth), mFraction(dstWidth), mBlendedRow(srcWidth * pixelStep)
+	{
+		for (int x = 0; x < dstWidth; x++) {
+			computeTap(x, srcWidth, dstWidth, mFirst[x], mSecond[x], mFraction[x]);
+			mFirst[x] *= pixelStep;
+			mSecond[x] *= pixelStep;
+		}
+	}
+
+	void scaleRow(uint8_t *dst, const uint8_t *src, int srcStride, int y)
+	{
+		BlendRowsFunc blendRows = kernels().blendRows;
+		int first, second, fraction;
+		computeTap(y, mSrcHeight, mDstHeight, first, second, fraction);
+		const uint8_t *row = src + first * srcStride;
+		if (fraction != 0) {
+			blendRows(&mBlendedRow[0], row, src + second * srcStride, fraction, (int)mBlendedRow.size());
+			row = &mBlendedRow[0];
+		}
+		if (mPixelStep == 2) {
+			scaleRowHorizontally<2>(dst, row);
+		} else {
+			scaleRowHorizontally<1>(dst, row);
+		}
+	}
+
+private:
+	template <int pixelStep> void scaleRowHorizontally(uint8_t *dst, const uint8_t *row) const
+	{
+		const int *first = &mFirst[0];
+		const int *second = &mSecond[0];
+		const int *fraction = &mFraction[0];
+		for (int x = 0; x < mDstWidth; x++) {
+			const uint8_t *a = row + first[x];
+			const uint8_t *b = row + second[x];
+			int weight1 = fraction[x];
+			int weight0 = 256 - weight1;
+			for (int c = 0; c < pixelStep; c++) {
+				dst[x * pixelStep + c] = (uint8_t)((a[c] * weight0 + b[c] * weight1 + 128) >> 8);
+			}
+		}
+	}
+
+	// The centers of the samples are aligned: destination sample i is taken at the source position
+	// (i + 0.5) * srcSize / dstSize - 0.5, expressed in 1/256 of sample.
+	static void computeTap(int i, int srcSize, int dstSize, int &first, int &second, int &fraction)
+	{
+		int64_t position = ((int64_t)(2 * i + 1) * srcSize * 128) / dstSize - 128;
+		if (position < 0) position = 0;
+		first = (int)(position >> 8);
+		fraction = (int)(position & 0xff);
+		if (first >= srcSize - 1) {
+			first = srcSize - 1;
+			fraction = 0;
+		}
+		second = (fraction == 0) ? first : first + 1;
+	}
+
+	int mSrcHeight;
+	int mDstWidth;
+	int mDstHeight;
+	int mPixelStep;
+	std::vector<int> mFirst;
+	std::vector<int> mSecond;
+	std::vector<int> mFraction;
+	std::vector<uint8_t> mBlendedRow;
+};
+
+
+VideoKernelsIsa libmswinrtvid::videoKernelsIsa()
+{
+	return kernels().isa;
+}
+
+bool libmswinrtvid::setVideoKernelsIsa(VideoKernelsIsa isa)
+{
+	VideoKernelsIsa detected = detectIsa();
+	bool supported = (isa == VideoKernelsIsaScalar) || (isa == detected);
+#ifdef VIDEO_KERNELS_X86
+	// The instruction sets of x86 are supersets of the previous ones.
+	supported = supported || ((isa == VideoKernelsIsaSSE2) && (detected == VideoKernelsIsaAVX2));
+#endif
+	if (!supported) return false;
+	kernels() = selectKernels(isa);
+	return true;
+}
+
+const char * libmswinrtvid::videoKernelsIsaName(VideoKernelsIsa isa)
+{
+	switch (isa) {
+	case VideoKernelsIsaSSE2:
+		return "SSE2";
+	case VideoKernelsIsaAVX2:
+		return "AVX2";
+	case VideoKernelsIsaNEON:
+		return "NEON";
+	default:
+		return "scalar";
+	}
+}
+
+void libmswinrtvid::interleaveUVRow(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width)
+{
+	kernels().interleaveUVRow(dst, u, v, width);
+}
+
+void libmswinrtvid::interleaveUVPlanes(uint8_t *dst, int dstStride, const uint8_t *u, int uStride, const uint8_t *v, int vStride, int width, int height)
+{
+	for (int i = 0; i < height; i++) {
+		interleaveUVRow(dst, u, v, width);
+		dst += dstStride;
+		u += uStride;
+		v += vStride;
+	}
+}
+
+void libmswinrtvid::copyPlane(uint8_t *dst, int dstStride, const uint8_t *src, int srcStride, int width, int height)
+{
+	if ((dstStride == width) && (srcStride == width)) {
+		memcpy(dst, src, (size_t)width * height);
+		return;
+	}
+	for (int i = 0; i < height; i++) {
+		memcpy(dst, src, width);
+		dst += dstStride;
+		src += srcStride;
+	}
+}
+
+void libmswinrtvid::copyNV12(uint8_t *dst, const uint8_t *src, int srcPitch, int width, int height)
+{
+	copyPlane(dst, width, src, srcPitch, width, height);
+	copyPlane(dst + width * height, 2 * ((width + 1) / 2), src + srcPitch * height, srcPitch, 2 * ((width + 1) / 2), (height + 1) / 2);
+}
+
+void libmswinrtvid::convertI420ToNV12(const uint8_t *const srcPlanes[3], const int srcStrides[3], int width, int height,
+	uint8_t *dstY, int dstYStride, uint8_t *dstUV, int dstUVStride)
+{
+	copyPlane(dstY, dstYStride, srcPlanes[0], srcStrides[0], width, height);
+	interleaveUVPlanes(dstUV, dstUVStride, srcPlanes[1], srcStrides[1], srcPlanes[2], srcStrides[2], (width + 1) / 2, (height + 1) / 2);
+}
+
+void libmswinrtvid::deinterleaveUVRow(uint8_t *u, uint8_t *v, const uint8_t *uv, int width)
+{
+	rotateKernels().deinterleaveUVRow(u, v, uv, width);
+}
+
+void libmswinrtvid::rotateNV12ToI420(const uint8_t *srcY, int srcYStride, const uint8_t *srcUV, int srcUVStride, int width, int height,
+	uint8_t *const dstPlanes[3], const int dstStrides[3], int rotation, bool mirror)
+{
+	int chromaWidth = (width + 1) / 2;
+	int chromaHeight = (height + 1) / 2;
+	switch (rotation) {
+	case 90:
+	case 270:
+		{
+			bool reverseRows = (rotation == 270);
+			bool reverseColumns = (rotation == 90) != mirror;
+			rotatePlane90(srcY, srcYStride, width, height, dstPlanes[0], dstStrides[0], reverseRows, reverseColumns);
+			rotateUVPlane90(srcUV, srcUVStride, chromaWidth, chromaHeight, dstPlanes[1], dstStrides[1], dstPlanes[2], dstStrides[2], reverseRows, reverseColumns);
+		}
+		break;
+	case 180:
+		if (mirror) {
+			// A mirrored half turn is a vertical flip: the rows are only copied in reverse order.
+			copyPlane(dstPlanes[0], dstStrides[0], srcY + (height - 1) * srcYStride, -srcYStride, width, height);
+			for (int i = 0; i < chromaHeight; i++) {
+				deinterleaveUVRow(dstPlanes[1] + i * dstStrides[1], dstPlanes[2] + i * dstStrides[2], srcUV + (chromaHeight - 1 - i) * srcUVStride, chromaWidth);
+			}
+		} else {
+			mirrorPlane(srcY, srcYStride, width, height, dstPlanes[0], dstStrides[0], true);
+			mirrorUVPlane(srcUV, srcUVStride, chromaWidth, chromaHeight, dstPlanes[1], dstStrides[1], dstPlanes[2], dstStrides[2], true);
+		}
+		break;
+	default:
+		if (mirror) {
+			mirrorPlane(srcY, srcYStride, width, height, dstPlanes[0], dstStrides[0], false);
+			mirrorUVPlane(srcUV, srcUVStride, chromaWidth, chromaHeight, dstPlanes[1], dstStrides[1], dstPlanes[2], dstStrides[2], false);
+		} else {
+			copyPlane(dstPlanes[0], dstStrides[0], srcY, srcYStride, width, height);
+			for (int i = 0; i < chromaHeight; i++) {
+				deinterleaveUVRow(dstPlanes[1] + i * dstStrides[1], dstPlanes[2] + i * dstStrides[2], srcUV + i * srcUVStride, chromaWidth);
+			}
+		}
+		break;
+	}
+}
+
+void libmswinrtvid::scalePlane(uint8_t *dst, int dstStride, int dstWidth, int dstHeight, const uint8_t *src, int srcStride, int srcWidth, int srcHeight, int pixelStep)
+{
+	if ((dstWidth == srcWidth) && (dstHeight == srcHeight)) {
+		copyPlane(dst, dstStride, src, srcStride, srcWidth * pixelStep, srcHeight);
+		return;
+	}
+	PlaneScaler scaler(srcWidth, srcHeight, dstWidth, dstHeight, pixelStep);
+	for (int y = 0; y < dstHeight; y++) {
+		scaler.scaleRow(dst + y * dstStride, src, srcStride, y);
+	}
+}
+
+void libmswinrtvid::scaleNV12ToI420(const uint8_t *srcY, int srcYStride, const uint8_t *srcUV, int srcUVStride, int srcWidth, int srcHeight,
+	uint8_t *const dstPlanes[3], const int dstStrides[3], int dstWidth, int dstHeight)
+{
+	int srcChromaWidth = (srcWidth + 1) / 2;
+	int srcChromaHeight = (srcHeight + 1) / 2;
+	int dstChromaWidth = (dstWidth + 1) / 2;
+	int dstChromaHeight = (dstHeight + 1) / 2;
+	scalePlane(dstPlanes[0], dstStrides[0], dstWidth, dstHeight, srcY, srcYStride, srcWidth, srcHeight, 1);
+	// Each scaled UV row is split right away while it is still in the cache.
+	PlaneScaler scaler(srcChromaWidth, srcChromaHeight, dstChromaWidth, dstChromaHeight, 2);
+	std::vector<uint8_t> row(2 * dstChromaWidth);
+	for (int y = 0; y < dstChromaHeight; y++) {
+		scaler.scaleRow(&row[0], srcUV, srcUVStride, y);
+		deinterleaveUVRow(dstPlanes[1] + y * dstStrides[1], dstPlanes[2] + y * dstStrides[2], &row[0], dstChromaWidth);
+	}
+}
+
+void libmswinrtvid::fillPlane(uint8_t *dst, int dstStride, int width, int height, uint8_t value)
+{
+	if (dstStride == width) {
+		memset(dst, value, (size_t)width * height);
+		return;
+	}
+	for (int i = 0; i < height; i++) {
+		memset(dst, value, width);
+		dst += dstStride;
+	}
+}
+
+void libmswinrtvid::computeFitRects(int srcWidth, int srcHeight, int dstWidth, int dstHeight, VideoFitMode mode, VideoRect &srcRect, VideoRect &dstRect)
+{
+	srcRect.x = srcRect.y = dstRect.x = dstRect.y = 0;
+	srcRect.width = srcWidth;
+	srcRect.height = srcHeight;
+	dstRect.width = dstWidth;
+	dstRect.height = dstHeight;
+	// Compare the aspect ratios without dividing: srcWidth / srcHeight > dstWidth / dstHeight.
+	bool srcIsWider = ((int64_t)srcWidth * dstHeight) > ((int64_t)dstWidth * srcHeight);
+	bool srcIsTaller = ((int64_t)srcWidth * dstHeight) < ((int64_t)dstWidth * srcHeight);
+	// The offsets and sizes are kept even so that the chroma samples stay aligned with the luma ones.
+	if (mode == VideoFitLetterbox) {
+		if (srcIsWider) {
+			dstRect.height = (int)(((int64_t)srcHeight * dstWidth) / srcWidth) & ~1;
+			dstRect.y = ((dstHeight - dstRect.height) / 2) & ~1;
+		} else if (srcIsTaller) {
+			dstRect.width = (int)(((int64_t)srcWidth * dstHeight) / srcHeight) & ~1;
+			dstRect.x = ((dstWidth - dstRect.width) / 2) & ~1;
+		}
+	} else if (mode == VideoFitCrop) {
+		if (srcIsWider) {
+			srcRect.width = (int)(((int64_t)dstWidth * srcHeight) / dstHeight) & ~1;
+			srcRect.x = ((srcWidth - srcRect.width) / 2) & ~1;
+		} else if (srcIsTaller) {
+			srcRect.height = (int)(((int64_t)dstHeight * srcWidth) / dstWidth) & ~1;
+			srcRect.y = ((srcHeight - srcRect.height) / 2) & ~1;
+		}
+	}
+}
+
+void libmswinrtvid::fitI420ToNV12(const uint8_t *const srcPlanes[3], const int srcStrides[3], int srcWidth, int srcHeight,
+	uint8_t *dstY, int dstYStride, uint8_t *dstUV, int dstUVStride, int dstWidth, int dstHeight, VideoFitMode mode)
+{
+	VideoRect srcRect, dstRect;
+	computeFitRects(srcWidth, srcHeight, dstWidth, dstHeight, mode, srcRect, dstRect);
+	if ((dstRect.width <= 0) || (dstRect.height <= 0) || (srcRect.width <= 0) || (srcRect.height <= 0)) {
+		fillPlane(dstY, dstYStride, dstWidth, dstHeight, 16);
+		fillPlane(dstUV, dstUVStride, 2 * ((dstWidth + 1) / 2), (dstHeight + 1) / 2, 128);
+		return;
+	}
+
+	// Black borders: only the bands around the picture are filled.
+	int dstChromaWidth = (dstWidth + 1) / 2;
+	int dstChromaHeight = (dstHeight + 1) / 2;
+	int rectChromaWidth = (dstRect.width + 1) / 2;
+	int rectChromaHeight = (dstRect.height + 1) / 2;
+	int rectChromaX = dstRect.x / 2;
+	int rectChromaY = dstRect.y / 2;
+	int bottom = dstRect.y + dstRect.height;
+	int right = dstRect.x + dstRect.width;
+	int chromaBottom = rectChromaY + rectChromaHeight;
+	int chromaRight = rectChromaX + rectChromaWidth;
+	fillPlane(dstY, dstYStride, dstWidth, dstRect.y, 16);
+	fillPlane(dstY + bottom * dstYStride, dstYStride, dstWidth, dstHeight - bottom, 16);
+	fillPlane(dstY + dstRect.y * dstYStride, dstYStride, dstRect.x, dstRect.height, 16);
+	fillPlane(dstY + dstRect.y * dstYStride + right, dstYStride, dstWidth - right, dstRect.height, 16);
+	fillPlane(dstUV, dstUVStride, 2 * dstChromaWidth, rectChromaY, 128);
+	fillPlane(dstUV + chromaBottom * dstUVStride, dstUVStride, 2 * dstChromaWidth, dstChromaHeight - chromaBottom, 128);
+	fillPlane(dstUV + rectChromaY * dstUVStride, dstUVStride, 2 * rectChromaX, rectChromaHeight, 128);
+	fillPlane(dstUV + rectChromaY * dstUVStride + 2 * chromaRight, dstUVStride, 2 * (dstChromaWidth - chromaRight), rectChromaHeight, 128);
+
+	const uint8_t *srcY = srcPlanes[0] + srcRect.y * srcStrides[0] + srcRect.x;
+	const uint8_t *srcU = srcPlanes[1] + (srcRect.y / 2) * srcStrides[1] + srcRect.x / 2;
+	const uint8_t *srcV = srcPlanes[2] + (srcRect.y / 2) * srcStrides[2] + srcRect.x / 2;
+	uint8_t *rectY = dstY + dstRect.y * dstYStride + dstRect.x;
+	uint8_t *rectUV = dstUV + rectChromaY * dstUVStride + 2 * rectChromaX;
+	int srcChromaWidth = (srcRect.width + 1) / 2;
+	int srcChromaHeight = (srcRect.height + 1) / 2;
+	scalePlane(rectY, dstYStride, dstRect.width, dstRect.height, srcY, srcStrides[0], srcRect.width, srcRect.height, 1);
+	if ((srcChromaWidth == rectChromaWidth) && (srcChromaHeight == rectChromaHeight)) {
+		interleaveUVPlanes(rectUV, dstUVStride, srcU, srcStrides[1], srcV, srcStrides[2], rectChromaWidth, rectChromaHeight);
+		return;
+	}
+	// Each pair of scaled U and V rows is interleaved right away while it is still in the cache.
+	PlaneScaler uScaler(srcChromaWidth, srcChromaHeight, rectChromaWidth, rectChromaHeight, 1);
+	PlaneScaler vScaler(srcChromaWidth, srcChromaHeight, rectChromaWidth, rectChromaHeight, 1);
+	std::vector<uint8_t> rows(2 * rectChromaWidth);
+	for (int y = 0; y < rectChromaHeight; y++) {
+		uScaler.scaleRow(&rows[0], srcU, srcStrides[1], y);
+		vScaler.scaleRow(&rows[rectChromaWidth], srcV, srcStrides[2], y);
+		interleaveUVRow(rectUV + y * dstUVStride, &rows[0], &rows[rectChromaWidth], rectChromaWidth);
+	}
+}
+
+uint64_t libmswinrtvid::fingerprintPlane(const uint8_t *src, int srcStride, int width, int height, int rowStep, uint64_t seed)
+{
+	FingerprintRowFunc fingerprintRow = kernels().fingerprintRow;
+	uint64_t acc[4];
+	for (int lane = 0; lane < 4; lane++) {
+		acc[lane] = seed + kFingerprintKeys[lane];
+	}
+	if (rowStep < 1) rowStep = 1;
+	for (int y = 0; y < height; y += rowStep) {
+		const uint8_t *row = src + y * srcStride;
+		int i = fingerprintRow(acc, row, width);
+		for (; i < width; i++) {
+			acc[0] = (acc[0] ^ row[i]) * kFingerprintPrime;
+		}
+		// Mixing the lanes after each row makes the result depend on the order of the rows.
+		for (int lane = 0; lane < 4; lane++) {
+			acc[lane] = mixFingerprint(acc[lane]);
+		}
+	}
+	return mixFingerprint(acc[0] ^ (acc[1] * kFingerprintPrime) ^ (acc[2] >> 7) ^ (acc[3] << 13) ^ (acc[3] >> 51));
+}
+
+uint64_t libmswinrtvid::fingerprintI420(const uint8_t *const planes[3], const int strides[3], int width, int height, int rowStep)
+{
+	int chromaWidth = (width + 1) / 2;
+	int chromaHeight = (height + 1) / 2;
+	uint64_t fingerprint = ((uint64_t)width << 32) | (uint32_t)height;
+	fingerprint = fingerprintPlane(planes[0], strides[0], width, height, rowStep, fingerprint);
+	fingerprint = fingerprintPlane(planes[1], strides[1], chromaWidth, chromaHeight, rowStep, fingerprint);
+	fingerprint = fingerprintPlane(planes[2], strides[2], chromaWidth, chromaHeight, rowStep, fingerprint);
+	return fingerprint;
+}
@@ -0,0 +1,115 @@
+/*
+VideoKernels.h
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Portable pixel kernels used by the capture and display filters.
+// This file must not depend on WinRT nor on mediastreamer2 so that it can be built on any platform.
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace libmswinrtvid
+{
+	enum VideoFitMode {
+		VideoFitStretch,	// The whole picture is scaled to the destination dimensions.
+		VideoFitLetterbox,	// The whole picture is scaled to fit, surrounded by black borders.
+		VideoFitCrop		// The picture is scaled to cover the destination, its exceeding part being cropped.
+	};
+
+	struct VideoRect {
+		int x;
+		int y;
+		int width;
+		int height;
+	};
+
+	enum VideoKernelsIsa {
+		VideoKernelsIsaScalar,
+		VideoKernelsIsaSSE2,
+		VideoKernelsIsaAVX2,
+		VideoKernelsIsaNEON
+	};
+
+	// Returns the instruction set selected at runtime for the kernels below.
+	VideoKernelsIsa videoKernelsIsa();
+	const char * videoKernelsIsaName(VideoKernelsIsa isa);
+	// Forces the instruction set of the kernels, so that the tests can compare each one with the scalar kernels. Returns
+	// false if the processor does not support it. Must not be called while a kernel is running.
+	bool setVideoKernelsIsa(VideoKernelsIsa isa);
+
+	// Interleaves width samples of the u and v rows into dst (u0 v0 u1 v1 ...).
+	void interleaveUVRow(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width);
+
+	// Interleaves the U and V planes of an I420 picture into the UV plane of a NV12 picture.
+	// width and height are the dimensions of the chroma planes.
+	void interleaveUVPlanes(uint8_t *dst, int dstStride, const uint8_t *u, int uStride, const uint8_t *v, int vStride, int width, int height);
+
+	// Copies a plane of width x height bytes, honouring the source and destination strides.
+	void copyPlane(uint8_t *dst, int dstStride, const uint8_t *src, int srcStride, int width, int height);
+
+	// Copies a NV12 picture whose rows are srcPitch bytes apart and whose chroma plane follows its height rows of luma, as in
+	// the camera buffers, to a packed NV12 picture: width x height luma samples, then (height + 1) / 2 rows of
+	// (width + 1) / 2 interleaved chroma pairs.
+	void copyNV12(uint8_t *dst, const uint8_t *src, int srcPitch, int width, int height);
+
+	// Converts an I420 picture given by its planes and strides (as in MSPicture) to NV12.
+	// The chroma planes are (width + 1) / 2 x (height + 1) / 2, so dstUVStride must be at least 2 * ((width + 1) / 2).
+	void convertI420ToNV12(const uint8_t *const srcPlanes[3], const int srcStrides[3], int width, int height,
+		uint8_t *dstY, int dstYStride, uint8_t *dstUV, int dstUVStride);
+
+	// Splits width interleaved samples of the uv row into the u and v rows.
+	void deinterleaveUVRow(uint8_t *u, uint8_t *v, const uint8_t *uv, int width);
+
+	// Converts a NV12 picture of width x height to I420 while rotating it by rotation degrees (0, 90, 180 or 270) clockwise,
+	// and then mirroring it horizontally if requested. The destination picture is height x width when rotating by 90 or 270 degrees.
+	// The quarter turns are done by 8x8 blocks walked in 64x64 tiles so that both pictures are accessed cache line by cache line.
+	void rotateNV12ToI420(const uint8_t *srcY, int srcYStride, const uint8_t *srcUV, int srcUVStride, int width, int height,
+		uint8_t *const dstPlanes[3], const int dstStrides[3], int rotation, bool mirror);
+
+	// Scales a plane of srcWidth x srcHeight pixels to dstWidth x dstHeight with a bilinear filter.
+	// Each pixel is made of pixelStep interleaved samples: 1 for a luma plane, 2 for the UV plane of a NV12 picture.
+	void scalePlane(uint8_t *dst, int dstStride, int dstWidth, int dstHeight, const uint8_t *src, int srcStride, int srcWidth, int srcHeight, int pixelStep);
+
+	// Scales a NV12 picture to an I420 picture of dstWidth x dstHeight, splitting the chroma samples while scaling them.
+	void scaleNV12ToI420(const uint8_t *srcY, int srcYStride, const uint8_t *srcUV, int srcUVStride, int srcWidth, int srcHeight,
+		uint8_t *const dstPlanes[3], const int dstStrides[3], int dstWidth, int dstHeight);
+
+	// Sets width x height bytes of a plane to value (16 for black luma, 128 for neutral chroma).
+	void fillPlane(uint8_t *dst, int dstStride, int width, int height, uint8_t value);
+
+	// Computes the part of the source picture that is kept and where it is placed in the destination picture.
+	// All the coordinates are even so that they can also be used for the chroma planes once halved.
+	void computeFitRects(int srcWidth, int srcHeight, int dstWidth, int dstHeight, VideoFitMode mode, VideoRect &srcRect, VideoRect &dstRect);
+
+	// Computes a 64-bit fingerprint of a plane of width x height bytes, reading only one row out of rowStep.
+	// This is a fast non-cryptographic hash meant to detect identical frames, the result is the same whatever the instruction set.
+	uint64_t fingerprintPlane(const uint8_t *src, int srcStride, int width, int height, int rowStep, uint64_t seed);
+
+	// Combines the fingerprints of the three planes of an I420 picture and of its dimensions.
+	uint64_t fingerprintI420(const uint8_t *const planes[3], const int strides[3], int width, int height, int rowStep);
+
+	// Converts an I420 picture to a NV12 picture of dstWidth x dstHeight, scaling it according to mode.
+	void fitI420ToNV12(const uint8_t *const srcPlanes[3], const int srcStrides[3], int srcWidth, int srcHeight,
+		uint8_t *dstY, int dstYStride, uint8_t *dstUV, int dstUVStride, int dstWidth, int dstHeight, VideoFitMode mode);
+}
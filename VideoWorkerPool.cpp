@@ -0,0 +1,336 @@
+/*
+VideoWorkerPool.cpp
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "VideoWorkerPool.h"
+
+using namespace libmswinrtvid;
+
+
+// Bands are made of whole 8x8 blocks of chroma samples so that the rotation kernel keeps working by blocks.
+static const int kBandGranularity = 16;
+static const int kMaxAutoThreads = 4;
+
+
+VideoWorkerPool * VideoWorkerPool::get()
+{
+	// Never destroyed: the threads must not be joined while the plugin is being unloaded.
+	static VideoWorkerPool *pool = new VideoWorkerPool();
+	return pool;
+}
+
+VideoWorkerPool::VideoWorkerPool()
+	: mFunc(nullptr), mCount(0), mBandSize(0), mBandCount(0), mNextBand(0), mPendingBands(0), mThreadCount(0), mUsers(0), mWorkers(0), mStopping(false)
+{
+	mTaskStats.posted = 0;
+	mTaskStats.ranInline = 0;
+	mTaskStats.queueDepth = 0;
+	mTaskStats.maxQueueDepth = 0;
+}
+
+VideoWorkerPool::~VideoWorkerPool()
+{
+	std::deque<Task> leftovers;
+	stopThreads(leftovers);
+	runTasks(leftovers);
+}
+
+void VideoWorkerPool::retain()
+{
+	std::lock_guard<std::mutex> jobLock(mJobMutex);
+	if (mUsers++ == 0) {
+		startThreads();
+	}
+}
+
+void VideoWorkerPool::release()
+{
+	std::deque<Task> leftovers;
+	{
+		std::lock_guard<std::mutex> jobLock(mJobMutex);
+		if (--mUsers == 0) {
+			stopThreads(leftovers);
+		}
+	}
+	runTasks(leftovers);
+}
+
+void VideoWorkerPool::setThreadCount(int count)
+{
+	std::deque<Task> leftovers;
+	{
+		std::lock_guard<std::mutex> jobLock(mJobMutex);
+		if (count < 0) count = 0;
+		if (count == mThreadCount) return;
+		mThreadCount = count;
+		if (mUsers > 0) {
+			stopThreads(leftovers);
+			startThreads();
+		}
+	}
+	runTasks(leftovers);
+}
+
+int VideoWorkerPool::getThreadCount()
+{
+	std::lock_guard<std::mutex> jobLock(mJobMutex);
+	return effectiveThreadCount();
+}
+
+int VideoWorkerPool::effectiveThreadCount() const
+{
+	if (mThreadCount > 0) return mThreadCount;
+	int count = (int)std::thread::hardware_concurrency();
+	if (count < 1) count = 1;
+	if (count > kMaxAutoThreads) count = kMaxAutoThreads;
+	return count;
+}
+
+void VideoWorkerPool::startThreads()
+{
+	mStopping = false;
+	// The calling thread takes part in the conversions, so one worker less is needed.
+	int workers = effectiveThreadCount() - 1;
+	for (int i = 0; i < workers; i++) {
+		mThreads.push_back(std::thread(&VideoWorkerPool::run, this));
+	}
+	std::lock_guard<std::mutex> lock(mMutex);
+	mWorkers = workers;
+}
+
+void VideoWorkerPool::stopThreads(std::deque<Task> &leftovers)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+		mWorkers = 0;
+	}
+	mJobCond.notify_all();
+	for (size_t i = 0; i < mThreads.size(); i++) {
+		mThreads[i].join();
+	}
+	mThreads.clear();
+	// The tasks posted before the workers were stopped are handed to the caller, their filters are waiting for them.
+	std::lock_guard<std::mutex> lock(mMutex);
+	leftovers.swap(mTasks);
+	mTaskStats.queueDepth = 0;
+}
+
+void VideoWorkerPool::runTasks(std::deque<Task> &tasks)
+{
+	// Called without mJobMutex: the tasks may run parallelFor() or reconfigure the pool.
+	while (!tasks.empty()) {
+		Task task = tasks.front();
+		tasks.pop_front();
+		task();
+	}
+}
+
+bool VideoWorkerPool::runNextBand(std::unique_lock<std::mutex> &lock)
+{
+	if (mNextBand >= mBandCount) return false;
+	int band = mNextBand++;
+	int first = band * mBandSize;
+	int last = first + mBandSize;
+	if (last > mCount) last = mCount;
+	const RangeFunc *func = mFunc;
+	lock.unlock();
+	(*func)(first, last);
+	lock.lock();
+	if (--mPendingBands == 0) {
+		mDoneCond.notify_all();
+	}
+	return true;
+}
+
+bool VideoWorkerPool::runNextTask(std::unique_lock<std::mutex> &lock)
+{
+	if (mTasks.empty()) return false;
+	Task task = mTasks.front();
+	mTasks.pop_front();
+	mTaskStats.queueDepth = mTasks.size();
+	lock.unlock();
+	task();
+	lock.lock();
+	return true;
+}
+
+void VideoWorkerPool::run()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (!mStopping) {
+		if (!runNextBand(lock) && !runNextTask(lock)) {
+			mJobCond.wait(lock);
+		}
+	}
+}
+
+void VideoWorkerPool::post(const Task &task)
+{
+	bool queued = false;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTaskStats.posted++;
+		if (mWorkers > 0) {
+			mTasks.push_back(task);
+			mTaskStats.queueDepth = mTasks.size();
+			if (mTaskStats.queueDepth > mTaskStats.maxQueueDepth) mTaskStats.maxQueueDepth = mTaskStats.queueDepth;
+			queued = true;
+		} else {
+			mTaskStats.ranInline++;
+		}
+	}
+	if (queued) {
+		mJobCond.notify_one();
+	} else {
+		task();
+	}
+}
+
+VideoWorkerPool::TaskStats VideoWorkerPool::getTaskStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mTaskStats;
+}
+
+void VideoWorkerPool::parallelFor(int count, int granularity, const RangeFunc &func)
+{
+	std::unique_lock<std::mutex> jobLock(mJobMutex, std::try_to_lock);
+	if (!jobLock.owns_lock() || mThreads.empty()) {
+		func(0, count);
+		return;
+	}
+
+	int parts = (int)mThreads.size() + 1;
+	int bandSize = (count + parts - 1) / parts;
+	bandSize = ((bandSize + granularity - 1) / granularity) * granularity;
+	if (bandSize >= count) {
+		func(0, count);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mFunc = &func;
+	mCount = count;
+	mBandSize = bandSize;
+	mBandCount = (count + bandSize - 1) / bandSize;
+	mNextBand = 0;
+	mPendingBands = mBandCount;
+	mJobCond.notify_all();
+	while (runNextBand(lock));
+	mDoneCond.wait(lock, [this]() { return mPendingBands == 0; });
+	mFunc = nullptr;
+	mBandCount = 0;
+}
+
+
+ConversionPipeline::ConversionPipeline()
+	: mPending(false), mDone(false)
+{
+	mStats.submitted = 0;
+	mStats.overruns = 0;
+}
+
+ConversionPipeline::~ConversionPipeline()
+{
+	collect();
+}
+
+void ConversionPipeline::submit(const VideoWorkerPool::Task &conversion)
+{
+	mPending = true;
+	mDone = false;
+	mStats.submitted++;
+	VideoWorkerPool::get()->post([this, conversion]() {
+		conversion();
+		std::lock_guard<std::mutex> lock(mMutex);
+		mDone = true;
+		mDoneCond.notify_all();
+	});
+}
+
+bool ConversionPipeline::collect()
+{
+	if (!mPending) return false;
+	std::unique_lock<std::mutex> lock(mMutex);
+	if (!mDone) {
+		mStats.overruns++;
+		mDoneCond.wait(lock, [this]() { return mDone; });
+	}
+	mPending = false;
+	return true;
+}
+
+
+void libmswinrtvid::parallelConvertI420ToNV12(const uint8_t *const srcPlanes[3], const int srcStrides[3], int width, int height,
+	uint8_t *dstY, int dstYStride, uint8_t *dstUV, int dstUVStride)
+{
+	if ((width * height) < VideoWorkerPool::kMinParallelPixels) {
+		convertI420ToNV12(srcPlanes, srcStrides, width, height, dstY, dstYStride, dstUV, dstUVStride);
+		return;
+	}
+	VideoWorkerPool::get()->parallelFor(height, kBandGranularity, [&](int first, int last) {
+		const uint8_t *planes[3] = {
+			srcPlanes[0] + first * srcStrides[0],
+			srcPlanes[1] + (first / 2) * srcStrides[1],
+			srcPlanes[2] + (first / 2) * srcStrides[2]
+		};
+		convertI420ToNV12(planes, srcStrides, width, last - first, dstY + first * dstYStride, dstYStride, dstUV + (first / 2) * dstUVStride, dstUVStride);
+	});
+}
+
+void libmswinrtvid::parallelRotateNV12ToI420(const uint8_t *srcY, int srcYStride, const uint8_t *srcUV, int srcUVStride, int width, int height,
+	uint8_t *const dstPlanes[3], const int dstStrides[3], int rotation, bool mirror)
+{
+	if ((width * height) < VideoWorkerPool::kMinParallelPixels) {
+		rotateNV12ToI420(srcY, srcYStride, srcUV, srcUVStride, width, height, dstPlanes, dstStrides, rotation, mirror);
+		return;
+	}
+	int chromaHeight = (height + 1) / 2;
+	// Mirroring a quarter turn swaps the side of the destination where the first source rows land.
+	bool quarterTurn = (rotation == 90) || (rotation == 270);
+	bool fromEnd = quarterTurn ? ((rotation == 90) != mirror) : (rotation == 180);
+	VideoWorkerPool::get()->parallelFor(height, kBandGranularity, [&](int first, int last) {
+		// Each band of source rows is rotated as a picture of its own, placed where these rows land in the destination.
+		int chromaFirst = first / 2;
+		int chromaLast = (last + 1) / 2;
+		// The rows land in columns of the destination for quarter turns, in rows otherwise.
+		int offset = fromEnd ? (height - last) : first;
+		int chromaOffset = fromEnd ? (chromaHeight - chromaLast) : chromaFirst;
+		uint8_t *planes[3];
+		planes[0] = dstPlanes[0] + (quarterTurn ? offset : offset * dstStrides[0]);
+		planes[1] = dstPlanes[1] + (quarterTurn ? chromaOffset : chromaOffset * dstStrides[1]);
+		planes[2] = dstPlanes[2] + (quarterTurn ? chromaOffset : chromaOffset * dstStrides[2]);
+		rotateNV12ToI420(srcY + first * srcYStride, srcYStride, srcUV + chromaFirst * srcUVStride, srcUVStride, width, last - first, planes, dstStrides, rotation, mirror);
+	});
+}
+
+void libmswinrtvid::parallelRotateNV12ToNV12(const uint8_t *srcY, int srcYStride, const uint8_t *srcUV, int srcUVStride, int width, int height,
+	uint8_t *dstY, int dstYStride, uint8_t *dstUV, int dstUVStride, int rotation, bool mirror, uint8_t *chromaScratch)
+{
+	bool quarterTurn = (rotation == 90) || (rotation == 270);
+	int chromaWidth = ((quarterTurn ? height : width) + 1) / 2;
+	int chromaHeight = ((quarterTurn ? width : height) + 1) / 2;
+	uint8_t *planes[3] = { dstY, chromaScratch, chromaScratch + chromaWidth * chromaHeight };
+	int strides[3] = { dstYStride, chromaWidth, chromaWidth };
+	parallelRotateNV12ToI420(srcY, srcYStride, srcUV, srcUVStride, width, height, planes, strides, rotation, mirror);
+	interleaveUVPlanes(dstUV, dstUVStride, planes[1], chromaWidth, planes[2], chromaWidth, chromaWidth, chromaHeight);
+}
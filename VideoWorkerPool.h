@@ -0,0 +1,146 @@
+/*
+VideoWorkerPool.h
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Small pool of worker threads shared by all the filters of the plugin to convert large frames by bands of rows, and to
+// run whole conversions off the ticker thread. Like VideoKernels, this file only depends on the standard library.
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "VideoKernels.h"
+
+
+namespace libmswinrtvid
+{
+	class VideoWorkerPool {
+	public:
+		typedef std::function<void(int first, int last)> RangeFunc;
+		typedef std::function<void()> Task;
+
+		struct TaskStats {
+			uint64_t posted;
+			uint64_t ranInline;	// Tasks run by the posting thread because there are no workers.
+			size_t queueDepth;
+			size_t maxQueueDepth;
+		};
+
+		// Frames smaller than this number of pixels are always converted by the calling thread.
+		static const int kMinParallelPixels = 1280 * 720;
+
+		static VideoWorkerPool * get();
+
+		// The threads are only running while at least one filter holds a reference on the pool.
+		void retain();
+		void release();
+
+		// Number of threads taking part in a conversion, including the calling one. 0 selects one per processor (at most 4).
+		void setThreadCount(int count);
+		int getThreadCount();
+
+		// Splits [0, count) into bands whose size is a multiple of granularity and runs func on each of them,
+		// on the calling thread and on the workers. Returns once all the bands have been processed.
+		// If the pool is already busy with another frame, func is run inline on the whole range.
+		void parallelFor(int count, int granularity, const RangeFunc &func);
+
+		// Runs task on a worker, after the tasks posted before it. The bands of parallelFor() go first. If there are no
+		// workers, the task is run by the calling thread before returning. The tasks still queued when the workers are
+		// stopped are run by the thread stopping them in release() or setThreadCount(), once the pool is unlocked.
+		void post(const Task &task);
+		TaskStats getTaskStats();
+
+	private:
+		VideoWorkerPool();
+		~VideoWorkerPool();
+		int effectiveThreadCount() const;
+		void startThreads();
+		// Stops the workers and moves the tasks they have not run to leftovers, for the caller to run them with runTasks()
+		// once it has released mJobMutex.
+		void stopThreads(std::deque<Task> &leftovers);
+		static void runTasks(std::deque<Task> &tasks);
+		bool runNextBand(std::unique_lock<std::mutex> &lock);
+		bool runNextTask(std::unique_lock<std::mutex> &lock);
+		void run();
+
+		std::mutex mJobMutex;
+		std::mutex mMutex;
+		std::condition_variable mJobCond;
+		std::condition_variable mDoneCond;
+		std::vector<std::thread> mThreads;
+		std::deque<Task> mTasks;
+		TaskStats mTaskStats;
+		const RangeFunc *mFunc;
+		int mCount;
+		int mBandSize;
+		int mBandCount;
+		int mNextBand;
+		int mPendingBands;
+		int mThreadCount;
+		int mUsers;
+		int mWorkers;	// Number of running workers, protected by mMutex unlike mThreads.
+		bool mStopping;
+	};
+
+	// Conversion of the frames of one filter, pipelined one frame deep: the conversion of a frame is posted to the worker
+	// pool and its result is collected at the next tick, while the conversion of the next frame is posted.
+	class ConversionPipeline {
+	public:
+		struct Stats {
+			uint64_t submitted;
+			uint64_t overruns;	// Conversions that were not finished when collected, the ticker had to wait for them.
+		};
+
+		ConversionPipeline();
+		// Waits for the conversion in progress.
+		~ConversionPipeline();
+
+		// Posts the conversion, the previous one must have been collected.
+		void submit(const VideoWorkerPool::Task &conversion);
+		// Waits for the conversion submitted previously. Returns false if there is none.
+		bool collect();
+		bool isPending() const { return mPending; }
+		Stats getStats() const { return mStats; }
+
+	private:
+		std::mutex mMutex;
+		std::condition_variable mDoneCond;
+		bool mPending;
+		bool mDone;
+		Stats mStats;
+	};
+
+	// Same as convertI420ToNV12 and rotateNV12ToI420, splitting large frames in bands of rows converted by the worker pool.
+	void parallelConvertI420ToNV12(const uint8_t *const srcPlanes[3], const int srcStrides[3], int width, int height,
+		uint8_t *dstY, int dstYStride, uint8_t *dstUV, int dstUVStride);
+	void parallelRotateNV12ToI420(const uint8_t *srcY, int srcYStride, const uint8_t *srcUV, int srcUVStride, int width, int height,
+		uint8_t *const dstPlanes[3], const int dstStrides[3], int rotation, bool mirror);
+	// Same as parallelRotateNV12ToI420, but keeps the picture in NV12: the U and V planes are rotated to chromaScratch, of
+	// 2 * ((dstWidth + 1) / 2) * ((dstHeight + 1) / 2) bytes, then interleaved into dstUV.
+	void parallelRotateNV12ToNV12(const uint8_t *srcY, int srcYStride, const uint8_t *srcUV, int srcUVStride, int width, int height,
+		uint8_t *dstY, int dstYStride, uint8_t *dstUV, int dstUVStride, int rotation, bool mirror, uint8_t *chromaScratch);
+}
@@ -0,0 +1,71 @@
+/*
+WorkItemCoalescer.h
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+// Keeps at most one work item pending for requests that a single run of the work item can serve together,
+// such as the samples queued in the media sink that one dispatch sends all at once.
+// It is not thread-safe: the owner calls it with its own lock held.
+// Like VideoKernels, this file only depends on the standard library.
+
+
+namespace libmswinrtvid
+{
+	class WorkItemCoalescer {
+	public:
+		WorkItemCoalescer() : mPending(false), mRequests(0), mPosts(0) {}
+
+		// Records a request. Returns true if a work item has to be posted, false if the pending one will serve it.
+		bool request()
+		{
+			mRequests++;
+			if (mPending) return false;
+			mPending = true;
+			mPosts++;
+			return true;
+		}
+
+		// To be called if posting the work item failed: the requests are kept for the next one.
+		void cancel()
+		{
+			mPending = false;
+			mPosts--;
+		}
+
+		// Called by the work item when it runs. Returns the number of requests it serves, the next request posts a new one.
+		unsigned int take()
+		{
+			unsigned int requests = mRequests;
+			mRequests = 0;
+			mPending = false;
+			return requests;
+		}
+
+		// Number of work items posted since the creation.
+		unsigned long getPosts() const { return mPosts; }
+
+	private:
+		bool mPending;
+		unsigned int mRequests;
+		unsigned long mPosts;
+	};
+}
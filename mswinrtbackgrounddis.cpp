@@ -24,6 +24,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "mswinrtbackgrounddis.h"
 #include "VideoBuffer.h"
+#include "VideoWorkerPool.h"
 
 
 using namespace libmswinrtvid;
@@ -33,12 +34,14 @@ MSWinRTBackgroundDis::MSWinRTBackgroundDis()
 	: mIsActivated(false), mIsStarted(false)
 {
 	mRenderer = ref new MSWinRTRenderer();
+	VideoWorkerPool::get()->retain();
 }
 
 MSWinRTBackgroundDis::~MSWinRTBackgroundDis()
 {
 	stop();
 	mRenderer = nullptr;
+	VideoWorkerPool::get()->release();
 }
 
 int MSWinRTBackgroundDis::activate()
@@ -64,6 +67,7 @@ void MSWinRTBackgroundDis::stop()
 {
 	if (mIsStarted) {
 		mRenderer->Stop();
+		mDuplicateDetector.reset();
 		mIsStarted = false;
 	}
 }
@@ -75,11 +79,14 @@ int MSWinRTBackgroundDis::feed(MSFilter *f)
 
 		if ((f->inputs[0] != NULL) && ((im = ms_queue_peek_last(f->inputs[0])) != NULL)) {
 			MSPicture buf;
-			if (ms_yuv_buf_init_from_mblk(&buf, im) == 0) {
+			if ((ms_yuv_buf_init_from_mblk(&buf, im) == 0) && !mDuplicateDetector.isDuplicate(buf.planes, buf.strides, buf.w, buf.h)) {
 				ms_queue_remove(f->inputs[0], im);
-				Microsoft::WRL::ComPtr<VideoBuffer> spVideoBuffer = NULL;
-				Microsoft::WRL::MakeAndInitialize<VideoBuffer>(&spVideoBuffer, buf.planes[0], (int)msgdsize(im), im);
-				mRenderer->Feed(VideoBuffer::GetIBuffer(spVideoBuffer), buf.w, buf.h);
+				uint32_t timestamp = mblk_get_timestamp_info(im);
+				// The buffer only keeps the mblk alive, the planes are handed over as they are with their strides.
+				Microsoft::WRL::ComPtr<VideoBuffer> spVideoBuffer = VideoBuffer::Acquire(im->b_rptr, (int)msgdsize(im), im);
+				if (spVideoBuffer != nullptr) {
+					mRenderer->Feed(VideoBuffer::GetIBuffer(spVideoBuffer), buf, timestamp);
+				}
 			}
 		}
 	}
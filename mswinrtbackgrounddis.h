@@ -26,6 +26,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <string>
 
 #include "mswinrtvid.h"
+#include "DuplicateFrameDetector.h"
 #include "Renderer.h"
 
 
@@ -44,10 +45,13 @@ namespace libmswinrtvid
 		int feed(MSFilter *f);
 		MSVideoSize getVideoSize();
 		void setSwapChainPanel(Platform::String ^swapChainPanelName);
+		void setDuplicateDetection(MSWinRTDisDuplicateDetection detection) { mDuplicateDetector.setMode((DuplicateFrameDetector::Mode)detection); }
+		int getSkippedFrames() { return (int)mDuplicateDetector.getSkippedFrames(); }
 
 	private:
 		bool mIsActivated;
 		bool mIsStarted;
+		DuplicateFrameDetector mDuplicateDetector;
 		MSWinRTRenderer^ mRenderer;
 	};
 }
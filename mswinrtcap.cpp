@@ -22,6 +22,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 
 #include "mswinrtcap.h"
+#include "BufferLender.h"
+#include "FramePool.h"
+#include "PresentationClock.h"
+#include "SpscQueue.h"
+#include "VideoWorkerPool.h"
+
+#include <math.h>
 
 using namespace Microsoft::WRL;
 using namespace Windows::Foundation;
@@ -33,11 +40,77 @@ using namespace libmswinrtvid;
 bool MSWinRTCap::smInstantiated = false;
 bctbx_list_t *MSWinRTCap::smCameras = NULL;
 
+// Camera buffers held downstream at a time when the frames are not copied, the camera needs the others to go on capturing.
+static const int kMaxBorrowedFrames = 2;
+// Frames waiting for the ticker: the queue is allocated for the maximum depth, the limit is set by MS_WINRTCAP_SET_QUEUE_DEPTH.
+static const int kMaxQueueDepth = 32;
+static const int kDefaultQueueDepth = 8;
+// Period of the latency log lines, in 100ns units.
+static const int64_t kLatencyLogPeriod = 10 * PresentationClock::kUnitsPerSecond;
+
+
+static void addRefMediaBuffer(void *buffer)
+{
+	static_cast<IMFMediaBuffer *>(buffer)->AddRef();
+}
+
+static void releaseMediaBuffer(void *buffer)
+{
+	static_cast<IMFMediaBuffer *>(buffer)->Release();
+}
+
+static bool lockMediaBuffer(void *buffer, uint8_t **data, size_t *length)
+{
+	DWORD currentLength = 0;
+	if (FAILED(static_cast<IMFMediaBuffer *>(buffer)->Lock(data, NULL, &currentLength))) {
+		return false;
+	}
+	*length = currentLength;
+	return true;
+}
+
+static void unlockMediaBuffer(void *buffer)
+{
+	static_cast<IMFMediaBuffer *>(buffer)->Unlock();
+}
+
+static const BorrowedBufferOps kMediaBufferOps = { addRefMediaBuffer, releaseMediaBuffer, lockMediaBuffer, unlockMediaBuffer };
+
+static BufferLender * getCaptureBufferLender()
+{
+	// Never destroyed, the frames may be freed by the downstream filters after the capture filter is gone.
+	static BufferLender *lender = new BufferLender(kMaxBorrowedFrames);
+	return lender;
+}
+
+// Free function of the mblks pointing to a camera buffer.
+static void giveBackCaptureBuffer(void *data)
+{
+	getCaptureBufferLender()->giveBack(data);
+}
+
+// Puts a NV12 frame of width x height behind a video header, as ms_yuv_buf_alloc() lays out the frames it allocates, so
+// that the downstream filters get its size with ms_yuv_buf_init_from_mblk(). The frame data is owned by someone else and
+// has no room for the header: the header gets an mblk of its own and the frame follows it through b_cont, where
+// ms_yuv_buf_init_from_mblk() reads the planes from.
+static mblk_t * wrapVideoFrame(mblk_t *frame, int width, int height)
+{
+	mblk_t *m = allocb(sizeof(mblk_video_header), 0);
+	mblk_video_header *header = (mblk_video_header *)m->b_datap->db_base;
+	header->w = (uint16_t)width;
+	header->h = (uint16_t)height;
+	m->b_rptr = m->b_wptr = m->b_datap->db_base + sizeof(mblk_video_header);
+	m->b_cont = frame;
+	return m;
+}
+
 
 MSWinRTCapHelper::MSWinRTCapHelper() :
 	mRotationKey({ 0xC380465D, 0x2271, 0x428C,{ 0x9B, 0x83, 0xEC, 0xEA, 0x3B, 0x4A, 0x85, 0xC1 } }),
-	mDeviceOrientation(0), mAllocator(NULL)
+	mDeviceOrientation(0), mMirror(false), mZeroCopy(false), mPixFmt(MS_YUV420P), mOutputWidth(0), mOutputHeight(0), mCaptureWidth(0), mCaptureHeight(0), mAllocator(NULL),
+	mQueuePolicy(MSWinRTCapQueueDropOldest), mSamplesQueue(kMaxQueueDepth), mDroppedSamples(0), mDecimationFps(0)
 {
+	mSamplesQueue.setLimit(kDefaultQueueDepth);
 	mInitializationCompleted = CreateEventEx(NULL, L"Local\\MSWinRTCapInitialization", 0, EVENT_ALL_ACCESS);
 	if (!mInitializationCompleted) {
 		ms_error("[MSWinRTCap] Could not create initialization event [%i]", GetLastError());
@@ -54,9 +127,7 @@ MSWinRTCapHelper::MSWinRTCapHelper() :
 		return;
 	}
 
-	ms_mutex_init(&mMutex, NULL);
 	mAllocator = ms_yuv_buf_allocator_new();
-	ms_queue_init(&mSamplesQueue);
 }
 
 MSWinRTCapHelper::~MSWinRTCapHelper()
@@ -81,7 +152,6 @@ MSWinRTCapHelper::~MSWinRTCapHelper()
 		mAllocator = NULL;
 	}
 	mEncodingProfile = nullptr;
-	ms_mutex_destroy(&mMutex);
 }
 
 void MSWinRTCapHelper::OnCaptureFailed(MediaCapture^ sender, MediaCaptureFailedEventArgs^ errorEventArgs)
@@ -125,6 +195,9 @@ bool MSWinRTCapHelper::StartCapture(MediaEncodingProfile^ EncodingProfile)
 {
 	bool isStarted = false;
 	mEncodingProfile = EncodingProfile;
+	mCaptureWidth = (int)EncodingProfile->Video->Width;
+	mCaptureHeight = (int)EncodingProfile->Video->Height;
+	mDecimator.reset();
 	MakeAndInitialize<MSWinRTMediaSink>(&mMediaSink, EncodingProfile->Video);
 	static_cast<MSWinRTMediaSink *>(mMediaSink.Get())->SetCaptureFilter(this);
 	ComPtr<IInspectable> spInspectable;
@@ -165,36 +238,197 @@ void MSWinRTCapHelper::StopCapture()
 	WaitForSingleObjectEx(mStopCompleted, INFINITE, FALSE);
 }
 
+bool MSWinRTCapHelper::AcceptSample(LONGLONG presentationTime)
+{
+	float fps = mDecimationFps;
+	if (fps != (float)mDecimator.getFps()) {
+		mDecimator.setFps(fps);
+	}
+	return mDecimator.accept(presentationTime);
+}
+
 void MSWinRTCapHelper::OnSampleAvailable(BYTE *buf, DWORD bufLen, LONGLONG presentationTime)
+{
+	uint32_t entered = LatencyTracer::now();
+	// The frame is only copied here: it is converted by ConvertSample() if it leaves the filter, so that the frames dropped
+	// by the queue policy, the frame-rate control or the pacing are never converted.
+	int w = mCaptureWidth;
+	int h = mCaptureHeight;
+	size_t size = FramePool::frameSize(w, h, FramePool::FormatNV12);
+	if (bufLen < size) {
+		ms_warning("[MSWinRTCap] Dropping a camera frame of %u bytes, %ix%i NV12 needs %u", (unsigned int)bufLen, w, h, (unsigned int)size);
+		return;
+	}
+	uint8_t *data = FramePool::get()->acquire(w, h, FramePool::FormatNV12);
+	if (data == NULL) {
+		ms_warning("[MSWinRTCap] Dropping a camera frame, no memory for a %ix%i NV12 frame", w, h);
+		return;
+	}
+	copyNV12(data, (const uint8_t *)buf, w, w, h);
+	mblk_t *frame = esballoc(data, size, 0, FramePool::release);
+	frame->b_wptr += size;
+	mblk_t *m = wrapVideoFrame(frame, w, h);
+	mblk_set_timestamp_info(m, PresentationClock::toTimestamp(presentationTime));
+
+	LatencyTracer::setFrameStamps(m->timestamp, entered, LatencyTracer::now());
+	QueueSample(m);
+}
+
+mblk_t * MSWinRTCapHelper::ConvertSample(mblk_t *raw)
 {
 	mblk_t *m;
-	uint32_t timestamp = (uint32_t)((presentationTime / 10000LL) * 90LL);
+	MSPicture pict;
+
+	int w = mCaptureWidth;
+	int h = mCaptureHeight;
+	// The captured frames follow their video header, see wrapVideoFrame().
+	const uint8_t *y = raw->b_cont->b_rptr;
+	const uint8_t *cbcr = y + w * h;
+	int ow = mOutputWidth;
+	int oh = mOutputHeight;
+	if ((ow > 0) && (oh > 0) && ((ow != w) || (oh != h))) {
+		// The camera captures in a larger mode than the negotiated one: keep the centered part having the aspect
+		// ratio of the output size and scale it down.
+		int cw = w;
+		int ch = h;
+		if ((w * oh) > (ow * h)) {
+			cw = ((ow * h) / oh) & ~1;
+		} else {
+			ch = ((oh * w) / ow) & ~1;
+		}
+		int cx = ((w - cw) / 2) & ~1;
+		int cy = ((h - ch) / 2) & ~1;
+		const uint8_t *sy = y + cy * w + cx;
+		const uint8_t *scbcr = cbcr + (cy / 2) * w + cx;
+		if ((mPixFmt == MS_NV12) && (mDeviceOrientation == 0) && !mMirror) {
+			m = ms_yuv_buf_allocator_get(mAllocator, &pict, ow, oh);
+			scalePlane(pict.planes[0], ow, ow, oh, sy, w, cw, ch, 1);
+			scalePlane(pict.planes[0] + ow * oh, 2 * ((ow + 1) / 2), (ow + 1) / 2, (oh + 1) / 2, scbcr, w, (cw + 1) / 2, (ch + 1) / 2, 2);
+		} else if ((mDeviceOrientation == 0) && !mMirror) {
+			m = ms_yuv_buf_allocator_get(mAllocator, &pict, ow, oh);
+			scaleNV12ToI420(sy, w, scbcr, w, cw, ch, pict.planes, pict.strides, ow, oh);
+		} else {
+			// Scale to NV12 first, the rotation kernel then does the mirroring and the conversion to the output format.
+			int uvStride = 2 * ((ow + 1) / 2);
+			mScaledFrame.resize(ow * oh + uvStride * ((oh + 1) / 2));
+			uint8_t *scaledY = &mScaledFrame[0];
+			uint8_t *scaledUV = scaledY + ow * oh;
+			scalePlane(scaledY, ow, ow, oh, sy, w, cw, ch, 1);
+			scalePlane(scaledUV, uvStride, (ow + 1) / 2, (oh + 1) / 2, scbcr, w, (cw + 1) / 2, (ch + 1) / 2, 2);
+			m = RotateSample(scaledY, ow, scaledUV, uvStride, ow, oh);
+		}
+	} else if ((mPixFmt == MS_NV12) && (mDeviceOrientation == 0) && !mMirror) {
+		// The camera frames are already in NV12 and have been copied to a buffer of their own (or are lent by the camera).
+		return raw;
+	} else {
+		m = RotateSample(y, w, cbcr, w, w, h);
+	}
+	mblk_set_timestamp_info(m, mblk_get_timestamp_info(raw));
+	freemsg(raw);
+	return m;
+}
 
-	int w = mEncodingProfile->Video->Width;
-	int h = mEncodingProfile->Video->Height;
+mblk_t * MSWinRTCapHelper::RotateSample(const uint8_t *y, int yStride, const uint8_t *uv, int uvStride, int w, int h)
+{
+	MSPicture pict;
+	int ow = w;
+	int oh = h;
 	if ((mDeviceOrientation % 180) == 90) {
-		w = mEncodingProfile->Video->Height;
-		h = mEncodingProfile->Video->Width;
+		ow = h;
+		oh = w;
+	}
+	mblk_t *m = ms_yuv_buf_allocator_get(mAllocator, &pict, ow, oh);
+	if (mPixFmt == MS_NV12) {
+		// The format negotiated with the downstream filters is kept whatever the orientation and the mirroring.
+		int uvSize = 2 * ((ow + 1) / 2) * ((oh + 1) / 2);
+		mRotatedChroma.resize(uvSize);
+		parallelRotateNV12ToNV12(y, yStride, uv, uvStride, w, h, pict.planes[0], ow, pict.planes[0] + ow * oh, 2 * ((ow + 1) / 2),
+			mDeviceOrientation, mMirror, &mRotatedChroma[0]);
+	} else {
+		parallelRotateNV12ToI420(y, yStride, uv, uvStride, w, h, pict.planes, pict.strides, mDeviceOrientation, mMirror);
+	}
+	return m;
+}
+
+bool MSWinRTCapHelper::OnBufferAvailable(IMFMediaBuffer *buffer, LONGLONG presentationTime)
+{
+	uint32_t entered = LatencyTracer::now();
+	int w = mCaptureWidth;
+	int h = mCaptureHeight;
+	bool scaled = (mOutputWidth > 0) && (mOutputHeight > 0) && ((mOutputWidth != w) || (mOutputHeight != h));
+	if (!mZeroCopy || scaled || (mPixFmt != MS_NV12) || (mDeviceOrientation != 0) || mMirror) {
+		return false;
+	}
+
+	size_t size = (size_t)w * h + (size_t)w * (h / 2);
+	size_t length = 0;
+	uint8_t *data = getCaptureBufferLender()->lend(buffer, &kMediaBufferOps, &length);
+	if (data == NULL) {
+		// Enough camera buffers are already held downstream, this frame is copied.
+		return false;
 	}
-	uint8_t *y = (uint8_t *)buf;
-	uint8_t *cbcr = (uint8_t *)(buf + w * h);
-	m = copy_ycbcrbiplanar_to_true_yuv_with_rotation(mAllocator, y, cbcr, mDeviceOrientation, w, h, mEncodingProfile->Video->Width, mEncodingProfile->Video->Width, TRUE);
-	mblk_set_timestamp_info(m, timestamp);
+	if (length < size) {
+		getCaptureBufferLender()->giveBack(data);
+		return false;
+	}
+	mblk_t *frame = esballoc(data, size, 0, giveBackCaptureBuffer);
+	frame->b_wptr += size;
+	mblk_t *m = wrapVideoFrame(frame, w, h);
+	mblk_set_timestamp_info(m, PresentationClock::toTimestamp(presentationTime));
+
+	LatencyTracer::setFrameStamps(m->timestamp, entered, LatencyTracer::now());
+	QueueSample(m);
+	return true;
+}
 
-	ms_mutex_lock(&mMutex);
-	ms_queue_put(&mSamplesQueue, m);
-	ms_mutex_unlock(&mMutex);
+void MSWinRTCapHelper::QueueSample(mblk_t *m)
+{
+	mblk_t *oldest = NULL;
+	if (mSamplesQueue.pushEvictingOldest(m, &oldest)) {
+		freemsg(oldest);
+		mDroppedSamples++;
+	}
 }
 
 mblk_t * MSWinRTCapHelper::GetSample()
 {
-	ms_mutex_lock(&mMutex);
-	mblk_t *m = ms_queue_get(&mSamplesQueue);
-	ms_mutex_unlock(&mMutex);
+	mblk_t *m = NULL;
+	mSamplesQueue.pop(&m);
 	return m;
 }
 
-MSVideoSize MSWinRTCapHelper::SelectBestVideoSize(MSVideoSize vs)
+int MSWinRTCapHelper::GetSamples(MSQueue *q)
+{
+	if (mQueuePolicy == MSWinRTCapQueueKeepLatest) {
+		mblk_t *latest = NULL;
+		mSamplesQueue.drain([this, &latest](mblk_t *m) {
+			if (latest != NULL) {
+				freemsg(latest);
+				mDroppedSamples++;
+			}
+			latest = m;
+		});
+		if (latest == NULL) return 0;
+		ms_queue_put(q, latest);
+		return 1;
+	}
+	return (int)mSamplesQueue.drain([q](mblk_t *m) { ms_queue_put(q, m); });
+}
+
+void MSWinRTCapHelper::SetQueueDepth(int depth)
+{
+	if (depth < 1) depth = 1;
+	if (depth > kMaxQueueDepth) depth = kMaxQueueDepth;
+	mSamplesQueue.setLimit(depth);
+}
+
+void MSWinRTCapHelper::SetOutputSize(MSVideoSize vs)
+{
+	mOutputWidth = vs.width;
+	mOutputHeight = vs.height;
+}
+
+MSVideoSize MSWinRTCapHelper::SelectBestVideoSize(MSVideoSize vs, bool allowLarger)
 {
 	if ((CaptureDevice == nullptr) || (CaptureDevice->VideoDeviceController == nullptr)) {
 		return vs;
@@ -203,6 +437,7 @@ MSVideoSize MSWinRTCapHelper::SelectBestVideoSize(MSVideoSize vs)
 	MSVideoSize requestedSize;
 	MSVideoSize bestFoundSize;
 	MSVideoSize minSize = { 65536, 65536 };
+	MSVideoSize minLargerSize = { 65536, 65536 };
 	bestFoundSize.width = bestFoundSize.height = 0;
 	requestedSize.width = vs.width;
 	requestedSize.height = vs.height;
@@ -226,10 +461,19 @@ MSVideoSize MSWinRTCapHelper::SelectBestVideoSize(MSVideoSize vs)
 				if (ms_video_size_greater_than(minSize, currentSize)) {
 					minSize = currentSize;
 				}
+				if (ms_video_size_greater_than(currentSize, requestedSize)
+					&& ((currentSize.width * currentSize.height) < (minLargerSize.width * minLargerSize.height))) {
+					minLargerSize = currentSize;
+				}
 			}
 		}
 	}
 
+	if (allowLarger && !ms_video_size_equal(bestFoundSize, requestedSize) && (minLargerSize.width != 65536)) {
+		ms_message("[MSWinRTCap] Capture at %ix%i and downscale to %ix%i", minLargerSize.width, minLargerSize.height, requestedSize.width, requestedSize.height);
+		return minLargerSize;
+	}
+
 	if ((bestFoundSize.width == 0) && bestFoundSize.height == 0) {
 		ms_warning("[MSWinRTCap] This camera does not support our video size, use requested size");
 		return vs;
@@ -239,10 +483,47 @@ MSVideoSize MSWinRTCapHelper::SelectBestVideoSize(MSVideoSize vs)
 	return bestFoundSize;
 }
 
+bool MSWinRTCapHelper::SelectBestFrameRate(MSVideoSize vs, float fps, unsigned int *numerator, unsigned int *denominator)
+{
+	if ((CaptureDevice == nullptr) || (CaptureDevice->VideoDeviceController == nullptr)) {
+		return false;
+	}
+
+	double bestRate = 0;
+	bool bestIsHigher = false;
+	IVectorView<IMediaEncodingProperties^>^ props = mCapture->VideoDeviceController->GetAvailableMediaStreamProperties(MediaStreamType::VideoRecord);
+	for (unsigned int i = 0; i < props->Size; i++) {
+		IMediaEncodingProperties^ encodingProp = props->GetAt(i);
+		if (encodingProp->Type == L"Video") {
+			IVideoEncodingProperties^ videoProp = static_cast<IVideoEncodingProperties^>(encodingProp);
+			String^ subtype = videoProp->Subtype;
+			if (((subtype != L"NV12") && (subtype != L"Unknown"))
+				|| ((int)videoProp->Width != vs.width) || ((int)videoProp->Height != vs.height)
+				|| (videoProp->FrameRate->Denominator == 0)) {
+				continue;
+			}
+			double rate = (double)videoProp->FrameRate->Numerator / (double)videoProp->FrameRate->Denominator;
+			bool isHigher = (rate >= fps);
+			if ((bestRate == 0) || (isHigher && (!bestIsHigher || (rate < bestRate))) || (!isHigher && !bestIsHigher && (rate > bestRate))) {
+				bestRate = rate;
+				bestIsHigher = isHigher;
+				*numerator = videoProp->FrameRate->Numerator;
+				*denominator = videoProp->FrameRate->Denominator;
+			}
+		}
+	}
+	if (bestRate == 0) return false;
+	ms_message("[MSWinRTCap] Best frame rate for %f fps at %ix%i is %f fps", fps, vs.width, vs.height, bestRate);
+	return true;
+}
+
 
 MSWinRTCap::MSWinRTCap()
-	: mIsInitialized(false), mIsActivated(false), mIsStarted(false), mFps(15), mStartTime(0)
+	: mIsInitialized(false), mIsActivated(false), mIsStarted(false), mFps(15), mDownscaleEnabled(false), mPacingEnabled(false), mDecimationEnabled(false), mStartTime(0)
 {
+	VideoWorkerPool::get()->retain();
+	ms_queue_init(&mPendingFrames);
+	mPacer.setFps(mFps);
 	if (smInstantiated) {
 		ms_error("[MSWinRTCap] A video capture filter is already instantiated. A second one can not be created.");
 		return;
@@ -250,6 +531,7 @@ MSWinRTCap::MSWinRTCap()
 
 	mVideoSize.width = MS_VIDEO_SIZE_CIF_W;
 	mVideoSize.height = MS_VIDEO_SIZE_CIF_H;
+	mCaptureSize = mVideoSize;
 	mHelper = ref new MSWinRTCapHelper();
 	smInstantiated = true;
 }
@@ -259,6 +541,7 @@ MSWinRTCap::~MSWinRTCap()
 	stop();
 	deactivate();
 	smInstantiated = false;
+	VideoWorkerPool::get()->release();
 }
 
 
@@ -290,6 +573,7 @@ int MSWinRTCap::deactivate()
 void MSWinRTCap::start()
 {
 	if (!mIsStarted && mIsActivated) {
+		mLatency.reset();
 		mIsStarted = mHelper->StartCapture(mEncodingProfile);
 	}
 }
@@ -305,28 +589,129 @@ void MSWinRTCap::stop()
 	while ((m = mHelper->GetSample()) != NULL) {
 		freemsg(m);
 	}
+	ms_queue_flush(&mPendingFrames);
+	mPacer.reset();
+	if (mHelper->DroppedSamples > 0) {
+		ms_message("[MSWinRTCap] %u frames dropped because the ticker did not keep up", mHelper->DroppedSamples);
+	}
+	if (mHelper->DecimatedSamples > 0) {
+		ms_message("[MSWinRTCap] %u camera frames dropped by the decimation to %.2f fps", mHelper->DecimatedSamples, mFps);
+	}
+	if (mPacer.getDroppedFrames() > 0) {
+		ms_message("[MSWinRTCap] %u stale frames dropped by the pacing", mPacer.getDroppedFrames());
+	}
 	mIsStarted = false;
 }
 
 int MSWinRTCap::feed(MSFilter *f)
 {
-	if (ms_video_capture_new_frame(&mFpsControl, f->ticker->time)) {
-		mblk_t *im;
-		
+	if (mPacingEnabled) {
+		feedPaced(f);
+		return 0;
+	}
+	if (!ms_queue_empty(&mPendingFrames)) {
+		// The pacing has just been disabled.
+		ms_queue_flush(&mPendingFrames);
+		mPacer.reset();
+	}
+
+	// The decimated frames are already at the right frame rate.
+	if (mDecimationEnabled || ms_video_capture_new_frame(&mFpsControl, f->ticker->time)) {
 		// Send queued samples
-		while ((im = mHelper->GetSample()) != NULL) {
-			ms_queue_put(f->outputs[0], im);
-			ms_average_fps_update(&mAvgFps, (uint32_t)f->ticker->time);
+		MSQueue samples;
+		ms_queue_init(&samples);
+		mHelper->GetSamples(&samples);
+		mblk_t *m;
+		while ((m = ms_queue_get(&samples)) != NULL) {
+			sendSample(f, m);
 		}
 	}
 
+	logLatency();
 	return 0;
 }
 
+void MSWinRTCap::feedPaced(MSFilter *f)
+{
+	mHelper->GetSamples(&mPendingFrames);
+	mPendingCaptureTimes.clear();
+	for (mblk_t *m = ms_queue_peek_first(&mPendingFrames); !ms_queue_end(&mPendingFrames, m); m = ms_queue_next(&mPendingFrames, m)) {
+		// The timestamps are in 90kHz units.
+		mPendingCaptureTimes.push_back(mblk_get_timestamp_info(m) / 90);
+	}
+	// The latency is also logged on the ticks without any frame, so that a stalled camera does not hide the last figures.
+	if (!mPendingCaptureTimes.empty()) {
+		size_t stale = 0;
+		bool release = mPacer.select(f->ticker->time, &mPendingCaptureTimes[0], mPendingCaptureTimes.size(), &stale);
+		for (size_t i = 0; i < stale; i++) {
+			freemsg(ms_queue_get(&mPendingFrames));
+		}
+		if (release) {
+			sendSample(f, ms_queue_get(&mPendingFrames));
+		}
+	}
+	logLatency();
+}
+
+void MSWinRTCap::sendSample(MSFilter *f, mblk_t *raw)
+{
+	uint32_t entered;
+	uint32_t queued;
+	LatencyTracer::getFrameStamps(raw->timestamp, &entered, &queued);
+	uint32_t taken = LatencyTracer::now();
+	mblk_t *m = mHelper->ConvertSample(raw);
+	uint32_t converted = LatencyTracer::now();
+	// The NV12 frames needing no conversion are sent as they were queued.
+	LatencyTracer::clearFrameStamps(m->timestamp);
+	ms_queue_put(f->outputs[0], m);
+	ms_average_fps_update(&mAvgFps, (uint32_t)f->ticker->time);
+
+	mLatency.record(LatencyTracer::StageHandoff, entered, queued);
+	mLatency.record(LatencyTracer::StageQueueWait, queued, taken);
+	mLatency.record(LatencyTracer::StageConversion, taken, converted);
+	mLatency.record(LatencyTracer::StageTotal, entered, converted);
+	mLatency.frameDone(converted);
+}
+
+void MSWinRTCap::logLatency()
+{
+	if (mLatency.isLogDue(PresentationClock::now(), kLatencyLogPeriod)) {
+		ms_message("[MSWinRTCap] Latency: %s", mLatency.describe().c_str());
+	}
+}
+
+
+void MSWinRTCap::enableDecimation(bool enable)
+{
+	mDecimationEnabled = enable;
+	mHelper->DecimationFps = enable ? mFps : 0;
+	applyFps();
+}
+
+MSPixFmt MSWinRTCap::getPixFmt()
+{
+	// The rotated and mirrored frames are also emitted in the requested format, so that it does not change mid-stream when
+	// the device orientation or the mirroring change.
+	return (MSPixFmt)mHelper->PixFmt;
+}
+
+int MSWinRTCap::setPixFmt(MSPixFmt fmt)
+{
+	if ((fmt != MS_YUV420P) && (fmt != MS_NV12)) {
+		ms_error("[MSWinRTCap] Unsupported pixel format %i", (int)fmt);
+		return -1;
+	}
+	mHelper->PixFmt = fmt;
+	return 0;
+}
 
 void MSWinRTCap::setFps(float fps)
 {
 	mFps = fps;
+	mPacer.setFps(fps);
+	if (mDecimationEnabled) {
+		mHelper->DecimationFps = fps;
+	}
 	ms_average_fps_init(&mAvgFps, "[MSWinRTCap] fps=%f");
 	ms_video_init_framerate_controller(&mFpsControl, fps);
 	applyFps();
@@ -353,11 +738,19 @@ void MSWinRTCap::setVideoSize(MSVideoSize vs)
 {
 	selectBestVideoSize(vs);
 	applyVideoSize();
+	// The supported frame rates depend on the capture size.
+	applyFps();
 }
 
 void MSWinRTCap::selectBestVideoSize(MSVideoSize vs)
 {
-	mVideoSize = mHelper->SelectBestVideoSize(vs);
+	mCaptureSize = mHelper->SelectBestVideoSize(vs, mDownscaleEnabled);
+	if (mDownscaleEnabled && ms_video_size_greater_than(mCaptureSize, vs)) {
+		// The frames are downscaled to the exact requested size before being sent.
+		mVideoSize = vs;
+	} else {
+		mVideoSize = mCaptureSize;
+	}
 }
 
 void MSWinRTCap::setDeviceOrientation(int degrees)
@@ -373,15 +766,26 @@ void MSWinRTCap::setDeviceOrientation(int degrees)
 void MSWinRTCap::applyFps()
 {
 	if (mEncodingProfile != nullptr) {
-		mEncodingProfile->Video->FrameRate->Numerator = (unsigned int)mFps;
-		mEncodingProfile->Video->FrameRate->Denominator = 1;
+		unsigned int numerator;
+		unsigned int denominator;
+		if (mDecimationEnabled && mHelper->SelectBestFrameRate(mCaptureSize, mFps, &numerator, &denominator)) {
+			// Run the camera at the closest mode it supports at or above the frame rate and let the decimator drop the
+			// extra frames evenly, rather than having the driver pick a mode for an arbitrary rate.
+			mEncodingProfile->Video->FrameRate->Numerator = numerator;
+			mEncodingProfile->Video->FrameRate->Denominator = denominator;
+		} else {
+			// Round fractional frame rates up, the decimation needs the camera to run at least at the frame rate.
+			mEncodingProfile->Video->FrameRate->Numerator = (unsigned int)ceil(mFps);
+			mEncodingProfile->Video->FrameRate->Denominator = 1;
+		}
 	}
 }
 
 void MSWinRTCap::applyVideoSize()
 {
+	mHelper->SetOutputSize(mVideoSize);
 	if (mEncodingProfile != nullptr) {
-		MSVideoSize vs = mVideoSize;
+		MSVideoSize vs = mCaptureSize;
 		mEncodingProfile->Video->Width = vs.width;
 		mEncodingProfile->Video->Height = vs.height;
 		mEncodingProfile->Video->PixelAspectRatio->Numerator = 1;
@@ -394,7 +798,7 @@ void MSWinRTCap::configure()
 	mEncodingProfile = ref new MediaEncodingProfile();
 	mEncodingProfile->Audio = nullptr;
 	mEncodingProfile->Container = nullptr;
-	MSVideoSize vs = mVideoSize;
+	MSVideoSize vs = mCaptureSize;
 	mEncodingProfile->Video = VideoEncodingProperties::CreateUncompressed(MediaEncodingSubtypes::Nv12, vs.width, vs.height);
 }
 
@@ -30,6 +30,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "mswinrtvid.h"
 #include "mswinrtmediasink.h"
+#include "FrameDecimator.h"
+#include "FramePacer.h"
+#include "LatencyTracer.h"
+#include "SpscQueue.h"
 
 #include <wrl\implements.h>
 #include <ppltasks.h>
@@ -48,8 +52,21 @@ namespace libmswinrtvid
 		bool StartCapture(Windows::Media::MediaProperties::MediaEncodingProfile^ EncodingProfile);
 		void StopCapture();
 		void MSWinRTCapHelper::OnSampleAvailable(BYTE *buf, DWORD bufLen, LONGLONG presentationTime);
-		MSVideoSize SelectBestVideoSize(MSVideoSize vs);
+		bool OnBufferAvailable(IMFMediaBuffer *buffer, LONGLONG presentationTime);
+		// Called by the sink for each camera frame before it is passed to one of the above, false if it must be dropped.
+		bool AcceptSample(LONGLONG presentationTime);
+		MSVideoSize SelectBestVideoSize(MSVideoSize vs, bool allowLarger);
+		// Lowest frame rate of the camera modes of the given size that is not below fps, or the highest one if they are all
+		// below. Returns false if the camera has no mode of this size.
+		bool SelectBestFrameRate(MSVideoSize vs, float fps, unsigned int *numerator, unsigned int *denominator);
+		void SetOutputSize(MSVideoSize vs);
+		// Called by the ticker only, the frames are queued by the capture thread.
 		mblk_t * GetSample();
+		int GetSamples(MSQueue *q);
+		// The queued samples are the raw NV12 frames of the camera, converted to the output format and size by the ticker
+		// when they are sent. Returns the converted sample, raw being freed, or raw itself if it needs no conversion.
+		mblk_t * ConvertSample(mblk_t *raw);
+		void SetQueueDepth(int depth);
 
 		property Platform::Agile<MediaCapture^> CaptureDevice
 		{
@@ -62,9 +79,53 @@ namespace libmswinrtvid
 			void set(int value) { mDeviceOrientation = value; }
 		}
 
+		property bool Mirror
+		{
+			bool get() { return mMirror; }
+			void set(bool value) { mMirror = value; }
+		}
+
+		property bool ZeroCopy
+		{
+			bool get() { return mZeroCopy; }
+			void set(bool value) { mZeroCopy = value; }
+		}
+
+		property unsigned int DroppedSamples
+		{
+			unsigned int get() { return mDroppedSamples; }
+		}
+
+		// Frame rate the camera frames are decimated to, 0 to disable the decimation.
+		property float DecimationFps
+		{
+			float get() { return mDecimationFps; }
+			void set(float value) { mDecimationFps = value; }
+		}
+
+		property unsigned int DecimatedSamples
+		{
+			unsigned int get() { return mDecimator.getDroppedFrames(); }
+		}
+
+		property int QueuePolicy
+		{
+			int get() { return mQueuePolicy; }
+			void set(int value) { mQueuePolicy = (MSWinRTCapQueuePolicy)value; }
+		}
+
+		property unsigned int PixFmt
+		{
+			unsigned int get() { return mPixFmt; }
+			void set(unsigned int value) { mPixFmt = (MSPixFmt)value; }
+		}
+
 	private:
 		~MSWinRTCapHelper();
 		void OnCaptureFailed(Windows::Media::Capture::MediaCapture^ sender, Windows::Media::Capture::MediaCaptureFailedEventArgs^ errorEventArgs);
+		void QueueSample(mblk_t *m);
+		// Rotates and mirrors a NV12 frame of w x h to a new sample in the output format.
+		mblk_t * RotateSample(const uint8_t *y, int yStride, const uint8_t *uv, int uvStride, int w, int h);
 
 		HANDLE mInitializationCompleted;
 		HANDLE mStartCompleted;
@@ -75,9 +136,24 @@ namespace libmswinrtvid
 		ComPtr<IMFMediaSink> mMediaSink;
 		MediaEncodingProfile^ mEncodingProfile;
 		int mDeviceOrientation;
-		ms_mutex_t mMutex;
+		bool mMirror;
+		bool mZeroCopy;
+		MSPixFmt mPixFmt;
+		int mOutputWidth;
+		int mOutputHeight;
+		int mCaptureWidth;
+		int mCaptureHeight;
+		std::vector<uint8_t> mScaledFrame;
+		std::vector<uint8_t> mRotatedChroma;
 		MSYuvBufAllocator *mAllocator;
-		MSQueue mSamplesQueue;
+		MSWinRTCapQueuePolicy mQueuePolicy;
+		// The sink serializes the sample callbacks, so there is a single producer at a time.
+		SpscQueue<mblk_t *> mSamplesQueue;
+		// Counts the frames dropped by both the capture thread and the ticker.
+		std::atomic<unsigned int> mDroppedSamples;
+		std::atomic<float> mDecimationFps;
+		// Only used by the capture thread.
+		FrameDecimator mDecimator;
 	};
 
 	class MSWinRTCap {
@@ -98,12 +174,27 @@ namespace libmswinrtvid
 		void setDeviceId(Platform::String^ id) { mDeviceId = id; }
 		void setFront(bool front) { mFront = front; }
 		void setExternal(bool external) { mExternal = external; }
-		MSPixFmt getPixFmt() { return MS_YUV420P; }
+		MSPixFmt getPixFmt();
+		int setPixFmt(MSPixFmt fmt);
 		float getFps() { return mFps; }
 		float getAverageFps();
 		void setFps(float fps);
 		MSVideoSize getVideoSize();
 		void setVideoSize(MSVideoSize vs);
+		bool isDownscaleEnabled() { return mDownscaleEnabled; }
+		void enableDownscale(bool enable) { mDownscaleEnabled = enable; }
+		bool isMirrorEnabled() { return mHelper->Mirror; }
+		void enableMirror(bool enable) { mHelper->Mirror = enable; }
+		bool isZeroCopyEnabled() { return mHelper->ZeroCopy; }
+		void enableZeroCopy(bool enable) { mHelper->ZeroCopy = enable; }
+		bool isPacingEnabled() { return mPacingEnabled; }
+		void enablePacing(bool enable) { mPacingEnabled = enable; }
+		bool isDecimationEnabled() { return mDecimationEnabled; }
+		void enableDecimation(bool enable);
+		void setQueuePolicy(MSWinRTCapQueuePolicy policy) { mHelper->QueuePolicy = policy; }
+		void setQueueDepth(int depth) { mHelper->SetQueueDepth(depth); }
+		int getDroppedFrames() { return (int)mHelper->DroppedSamples; }
+		LatencyTracer & getLatencyTracer() { return mLatency; }
 		int getDeviceOrientation() { return mHelper->DeviceOrientation; }
 		void setDeviceOrientation(int degrees);
 
@@ -114,6 +205,9 @@ namespace libmswinrtvid
 		void applyVideoSize();
 		void selectBestVideoSize(MSVideoSize vs);
 		void configure();
+		void feedPaced(MSFilter *f);
+		void sendSample(MSFilter *f, mblk_t *raw);
+		void logLatency();
 		static void addCamera(MSWebCamManager *manager, MSWebCamDesc *desc, Windows::Devices::Enumeration::DeviceInformation^ DeviceInfo);
 		static void registerCameras(MSWebCamManager *manager);
 
@@ -125,6 +219,14 @@ namespace libmswinrtvid
 		float mFps;
 		MSAverageFPS mAvgFps;
 		MSVideoSize mVideoSize;
+		MSVideoSize mCaptureSize;
+		bool mDownscaleEnabled;
+		bool mPacingEnabled;
+		bool mDecimationEnabled;
+		FramePacer mPacer;
+		MSQueue mPendingFrames;
+		std::vector<uint64_t> mPendingCaptureTimes;
+		LatencyTracer mLatency;
 		uint64_t mStartTime;
 		MSVideoStarter mStarter;
 		Platform::String^ mDeviceId;
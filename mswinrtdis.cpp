@@ -22,7 +22,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 
 #include "mswinrtdis.h"
+#include "FramePool.h"
 #include "VideoBuffer.h"
+#include "VideoWorkerPool.h"
 
 using namespace libmswinrtvid;
 using namespace Microsoft::WRL;
@@ -33,6 +35,9 @@ using namespace Windows::Media::MediaProperties;
 
 //#define MSWINRTDIS_DEBUG
 
+// Period of the latency log lines, in 100ns units.
+static const int64_t kLatencyLogPeriod = 10 * PresentationClock::kUnitsPerSecond;
+
 
 static void _startMediaElement(Windows::UI::Xaml::Controls::MediaElement^ mediaElement, Windows::Media::Core::MediaStreamSource^ mediaStreamSource)
 {
@@ -49,10 +54,50 @@ static void _stopMediaElement(Windows::UI::Xaml::Controls::MediaElement^ mediaEl
 }
 
 
+MSWinRTDisFrame::MSWinRTDisFrame(mblk_t *m, const MSPicture &picture, int width, int height, VideoFitMode mode)
+	: mBlock(m), mTimestamp(mblk_get_timestamp_info(m)), mEntered(LatencyTracer::now()), mPicture(picture), mWidth(width), mHeight(height), mMode(mode)
+{
+}
+
+MSWinRTDisFrame::~MSWinRTDisFrame()
+{
+	if (mBlock != NULL) {
+		freemsg(mBlock);
+		mBlock = NULL;
+	}
+}
+
+Windows::Storage::Streams::IBuffer^ MSWinRTDisFrame::Convert()
+{
+	// The MediaStreamSample needs a packed NV12 buffer, the input planes are read with their own strides.
+	int ysize = mWidth * mHeight;
+	int uvStride = 2 * ((mWidth + 1) / 2);
+	int size = ysize + uvStride * ((mHeight + 1) / 2);
+	uint8_t *buffer = FramePool::get()->acquire(mWidth, mHeight, FramePool::FormatNV12);
+	if (buffer == NULL) {
+		ms_error("[MSWinRTDis] Cannot allocate a %ix%i frame", mWidth, mHeight);
+		return nullptr;
+	}
+	if ((mPicture.w == mWidth) && (mPicture.h == mHeight)) {
+		parallelConvertI420ToNV12(mPicture.planes, mPicture.strides, mPicture.w, mPicture.h, buffer, mWidth, buffer + ysize, uvStride);
+	} else {
+		// Keep the dimensions the MediaElement has been started with instead of restarting it.
+		fitI420ToNV12(mPicture.planes, mPicture.strides, mPicture.w, mPicture.h, buffer, mWidth, buffer + ysize, uvStride, mWidth, mHeight, mMode);
+	}
+	// The decoder can reuse its buffer as soon as the frame has been converted.
+	freemsg(mBlock);
+	mBlock = NULL;
+	mblk_t *om = esballoc(buffer, size, 0, FramePool::release);
+	om->b_wptr += size;
+	Microsoft::WRL::ComPtr<VideoBuffer> spVideoBuffer = VideoBuffer::Acquire(buffer, size, om);
+	if (spVideoBuffer == nullptr) return nullptr;
+	return VideoBuffer::GetIBuffer(spVideoBuffer);
+}
+
+
 MSWinRTDisSampleHandler::MSWinRTDisSampleHandler() :
-	mSample(nullptr), mReferenceTime(0), mPixFmt(MS_YUV420P), mWidth(MS_VIDEO_SIZE_CIF_W), mHeight(MS_VIDEO_SIZE_CIF_H), mStarted(false)
+	mLateFrames(0), mPixFmt(MS_YUV420P), mWidth(MS_VIDEO_SIZE_CIF_W), mHeight(MS_VIDEO_SIZE_CIF_H), mStarted(false)
 {
-	mDeferralQueue = ref new Platform::Collections::Vector<MSWinRTDisDeferral^>();
 }
 
 MSWinRTDisSampleHandler::~MSWinRTDisSampleHandler()
@@ -69,7 +114,7 @@ void MSWinRTDisSampleHandler::StartMediaElement()
 		mediaStreamSource->SampleRequested += ref new Windows::Foundation::TypedEventHandler<Windows::Media::Core::MediaStreamSource ^, Windows::Media::Core::MediaStreamSourceSampleRequestedEventArgs ^>(this, &MSWinRTDisSampleHandler::OnSampleRequested);
 		Windows::UI::Xaml::Controls::MediaElement^ mediaElement = mMediaElement;
 		bool inUIThread = mediaElement->Dispatcher->HasThreadAccess;
-		mReferenceTime = 0;
+		mClock.reset();
 		if (inUIThread) {
 			// We are in the UI thread
 			_startMediaElement(mediaElement, mediaStreamSource);
@@ -92,46 +137,63 @@ void MSWinRTDisSampleHandler::StopMediaElement()
 		if (mediaElement->Dispatcher->HasThreadAccess) {
 			// We are in the UI thread
 			_stopMediaElement(mediaElement, this);
-			mDeferralQueue->Clear();
+			CancelSampleRequest();
 			mStarted = false;
 		}
 		else {
 			// Ask the dispatcher to run this code in the UI thread
 			mediaElement->Dispatcher->RunAsync(Windows::UI::Core::CoreDispatcherPriority::Normal, ref new Windows::UI::Core::DispatchedHandler([mediaElement, this]() {
 				_stopMediaElement(mediaElement, this);
-				mDeferralQueue->Clear();
+				CancelSampleRequest();
 				mStarted = false;
 			}));
 		}
 	}
 	else {
-		mDeferralQueue->Clear();
+		CancelSampleRequest();
 		mStarted = false;
 	}
 }
 
-void MSWinRTDisSampleHandler::Feed(Windows::Storage::Streams::IBuffer^ pBuffer)
+void MSWinRTDisSampleHandler::CancelSampleRequest()
+{
+	// The deferral is dropped without being completed, which would end the stream.
+	// The frame waiting for a request, if any, is discarded by the ticker, see DiscardLatestFrame().
+	MSWinRTDisDeferral^ deferral = nullptr;
+	mMailbox.cancelRequest(&deferral);
+}
+
+void MSWinRTDisSampleHandler::DiscardLatestFrame()
+{
+	if (mMailbox.discardLatest()) {
+		mLateFrames++;
+	}
+}
+
+bool MSWinRTDisSampleHandler::Feed(MSWinRTDisFrame^ frame, MSWinRTDisDeferral^ *deferral, MSWinRTDisFrame^ *requestFrame)
 {
 	mMutex.lock();
 	if (!mStarted) {
 		StartMediaElement();
 	}
-	mSample = pBuffer;
-	if (mDeferralQueue->Size > 0) {
+	mMutex.unlock();
+
+	if (mMailbox.publish(frame, deferral, requestFrame)) {
 #ifdef MSWINRTDIS_DEBUG
 		ms_message("[MSWinRTDis] Feed answer deferral");
 #endif
-		MSWinRTDisDeferral^ deferral = mDeferralQueue->GetAt(0);
-		mDeferralQueue->RemoveAt(0);
-		AnswerSampleRequest(deferral->Request);
-		deferral->Deferral->Complete();
+		return true;
 	}
 #ifdef MSWINRTDIS_DEBUG
-	else {
-		ms_message("[MSWinRTDis] Feed");
-	}
+	ms_message("[MSWinRTDis] Feed");
 #endif
-	mMutex.unlock();
+	return false;
+}
+
+void MSWinRTDisSampleHandler::AnswerDeferral(MSWinRTDisDeferral^ deferral, MSWinRTDisFrame^ frame)
+{
+	AnswerSampleRequest(deferral->Request, frame);
+	deferral->Deferral->Complete();
 }
 
 void MSWinRTDisSampleHandler::OnSampleRequested(Windows::Media::Core::MediaStreamSource^ sender, Windows::Media::Core::MediaStreamSourceSampleRequestedEventArgs^ args)
@@ -142,40 +204,61 @@ void MSWinRTDisSampleHandler::OnSampleRequested(Windows::Media::Core::MediaStrea
 		ms_warning("[MSWinRTDis] OnSampleRequested not for a video stream!");
 		return;
 	}
-	mMutex.lock();
-	if (mSample == nullptr) {
-#ifdef MSWINRTDIS_DEBUG
-		ms_message("[MSWinRTDis] OnSampleRequested defer");
-#endif
-		mDeferralQueue->Append(ref new MSWinRTDisDeferral(request, request->GetDeferral()));
-	} else {
+	MSWinRTDisFrame^ frame = nullptr;
+	if (mMailbox.take(&frame)) {
 #ifdef MSWINRTDIS_DEBUG
 		ms_message("[MSWinRTDis] OnSampleRequested answer");
 #endif
-		AnswerSampleRequest(request);
+		AnswerSampleRequest(request, frame);
+		return;
 	}
-	mMutex.unlock();
+	MSWinRTDisDeferral^ deferral = ref new MSWinRTDisDeferral(request, request->GetDeferral());
+	if (mMailbox.request(deferral, &frame)) {
+		// A frame has been published in the meantime.
+		AnswerDeferral(deferral, frame);
+	}
+#ifdef MSWINRTDIS_DEBUG
+	else {
+		ms_message("[MSWinRTDis] OnSampleRequested defer");
+	}
+#endif
 }
 
-void MSWinRTDisSampleHandler::AnswerSampleRequest(Windows::Media::Core::MediaStreamSourceSampleRequest^ sampleRequest)
+void MSWinRTDisSampleHandler::AnswerSampleRequest(Windows::Media::Core::MediaStreamSourceSampleRequest^ sampleRequest, MSWinRTDisFrame^ frame)
 {
+	// Only the frames taken by a request are converted, by the thread answering it.
+	uint32_t taken = LatencyTracer::now();
+	Windows::Storage::Streams::IBuffer^ sample = frame->Convert();
+	if (sample == nullptr) return;
+	uint32_t converted = LatencyTracer::now();
+	int64_t time;
+	int64_t duration;
+	mClock.stamp(PresentationClock::now(), frame->Timestamp(), &time, &duration);
 	TimeSpan ts;
-	UINT64 CurrentTime = GetTickCount64() * 10000LL;
-	if (mReferenceTime == 0) {
-		mReferenceTime = CurrentTime;
-	}
-	ts.Duration = CurrentTime - mReferenceTime;
-	sampleRequest->Sample = MediaStreamSample::CreateFromBuffer(mSample, ts);
-	mSample = nullptr;
+	ts.Duration = time;
+	MediaStreamSample^ mediaStreamSample = MediaStreamSample::CreateFromBuffer(sample, ts);
+	TimeSpan sampleDuration;
+	sampleDuration.Duration = duration;
+	mediaStreamSample->Duration = sampleDuration;
+	sampleRequest->Sample = mediaStreamSample;
+
+	// The requests are answered one after the other, so are the frames done.
+	uint32_t handedOff = LatencyTracer::now();
+	mLatency.record(LatencyTracer::StageQueueWait, frame->Entered(), taken);
+	mLatency.record(LatencyTracer::StageConversion, taken, converted);
+	mLatency.record(LatencyTracer::StageHandoff, converted, handedOff);
+	mLatency.record(LatencyTracer::StageTotal, frame->Entered(), handedOff);
+	mLatency.frameDone(handedOff);
 }
 
 void MSWinRTDisSampleHandler::RequestMediaElementRestart()
 {
 	mMutex.lock();
 	ms_message("[MSWinRTDis] RequestMediaElementRestart");
-	if (mReferenceTime != 0) {
+	if (mClock.isStarted()) {
 		StopMediaElement();
-		mReferenceTime = 0;
+		mClock.reset();
+		DiscardLatestFrame();
 	}
 	mMutex.unlock();
 }
@@ -183,15 +266,19 @@ void MSWinRTDisSampleHandler::RequestMediaElementRestart()
 
 
 MSWinRTDis::MSWinRTDis()
-	: mIsInitialized(false), mIsActivated(false), mIsStarted(false), mSampleHandler(nullptr)
+	: mIsInitialized(false), mIsActivated(false), mIsStarted(false), mHasOutputSize(false), mFitMode(MSWinRTDisFitRestart),
+	mAsyncConversion(false), mSampleHandler(nullptr)
 {
 	mSampleHandler = ref new MSWinRTDisSampleHandler();
 	mIsInitialized = true;
+	VideoWorkerPool::get()->retain();
 }
 
 MSWinRTDis::~MSWinRTDis()
 {
 	stop();
+	mPipeline.collect();
+	VideoWorkerPool::get()->release();
 }
 
 int MSWinRTDis::activate()
@@ -210,6 +297,7 @@ int MSWinRTDis::deactivate()
 void MSWinRTDis::start()
 {
 	if (!mIsStarted && mIsActivated) {
+		mSampleHandler->GetLatencyTracer().reset();
 		mIsStarted = true;
 	}
 }
@@ -218,38 +306,54 @@ void MSWinRTDis::stop()
 {
 	if (mIsStarted) {
 		mIsStarted = false;
+		mHasOutputSize = false;
+		mDuplicateDetector.reset();
+		mPipeline.collect();
 		mSampleHandler->StopMediaElement();
+		mSampleHandler->DiscardLatestFrame();
+		ms_message("[MSWinRTDis] %u frames superseded and %u frames late, dropped without being converted",
+			mSampleHandler->SupersededFrames, mSampleHandler->LateFrames);
 	}
 }
 
 int MSWinRTDis::feed(MSFilter *f)
 {
+	// The request answered on the worker pool at the previous tick must be done before the next one is.
+	mPipeline.collect();
+
 	if (mIsStarted) {
 		mblk_t *im;
-		mblk_t *om;
 
 		if ((f->inputs[0] != NULL) && ((im = ms_queue_peek_last(f->inputs[0])) != NULL)) {
-			int size = 0;
 			MSPicture inbuf;
-			MSPicture outbuf;
-			if (ms_yuv_buf_init_from_mblk(&inbuf, im) == 0) {
+			if ((ms_yuv_buf_init_from_mblk(&inbuf, im) == 0) && !mDuplicateDetector.isDuplicate(inbuf.planes, inbuf.strides, inbuf.w, inbuf.h)) {
 				if ((inbuf.w != mSampleHandler->Width) || (inbuf.h != mSampleHandler->Height)) {
-					mSampleHandler->Width = inbuf.w;
-					mSampleHandler->Height = inbuf.h;
-					mSampleHandler->RequestMediaElementRestart();
+					if ((mFitMode == MSWinRTDisFitRestart) || !mHasOutputSize) {
+						mSampleHandler->Width = inbuf.w;
+						mSampleHandler->Height = inbuf.h;
+						mSampleHandler->RequestMediaElementRestart();
+					}
 				}
-				om = ms_yuv_buf_alloc(&outbuf, inbuf.w, inbuf.h);
-				int ysize = inbuf.w * inbuf.h;
-				int usize = ysize / 4;
-				uint8_t *buffer = outbuf.planes[0];
-				memcpy(buffer, inbuf.planes[0], ysize);
-				for (int i = 0; i < usize; i++) {
-					buffer[ysize + (i * 2)] = inbuf.planes[1][i];
-					buffer[ysize + (i * 2) + 1] = inbuf.planes[2][i];
+				mHasOutputSize = true;
+				int width = mSampleHandler->Width;
+				int height = mSampleHandler->Height;
+				// The pool is shared with the other filters, which may still use the previous size: its idle buffers are
+				// left to the idle memory cap of the pool rather than trimmed here.
+				VideoFitMode mode = (mFitMode == MSWinRTDisFitCrop) ? VideoFitCrop : ((mFitMode == MSWinRTDisFitLetterbox) ? VideoFitLetterbox : VideoFitStretch);
+				// The input is referenced until the frame is converted or superseded, as the input queue is flushed below.
+				MSWinRTDisFrame^ frame = ref new MSWinRTDisFrame(dupmsg(im), inbuf, width, height, mode);
+				MSWinRTDisDeferral^ deferral = nullptr;
+				MSWinRTDisFrame^ requestFrame = nullptr;
+				if (mSampleHandler->Feed(frame, &deferral, &requestFrame)) {
+					if (mAsyncConversion) {
+						MSWinRTDisSampleHandler^ sampleHandler = mSampleHandler;
+						mPipeline.submit([sampleHandler, deferral, requestFrame]() {
+							sampleHandler->AnswerDeferral(deferral, requestFrame);
+						});
+					} else {
+						mSampleHandler->AnswerDeferral(deferral, requestFrame);
+					}
 				}
-				Microsoft::WRL::ComPtr<VideoBuffer> spVideoBuffer = NULL;
-				Microsoft::WRL::MakeAndInitialize<VideoBuffer>(&spVideoBuffer, buffer, (int)msgdsize(om), om);
-				mSampleHandler->Feed(VideoBuffer::GetIBuffer(spVideoBuffer));
 			}
 		}
 	}
@@ -261,6 +365,11 @@ int MSWinRTDis::feed(MSFilter *f)
 		ms_queue_flush(f->inputs[1]);
 	}
 
+	LatencyTracer &latency = mSampleHandler->GetLatencyTracer();
+	if (latency.isLogDue(PresentationClock::now(), kLatencyLogPeriod)) {
+		ms_message("[MSWinRTDis] Latency: %s", latency.describe().c_str());
+	}
+
 	return 0;
 }
 
@@ -25,9 +25,15 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 
 #include "mswinrtvid.h"
+#include "DuplicateFrameDetector.h"
+#include "FrameMailbox.h"
+#include "LatencyTracer.h"
+#include "PresentationClock.h"
+#include "VideoWorkerPool.h"
 
 #include <mediastreamer2/rfc3984.h>
 
+#include <atomic>
 #include <collection.h>
 #include <ppltasks.h>
 #include <mutex>
@@ -67,6 +73,31 @@ namespace libmswinrtvid
 		Windows::Media::Core::MediaStreamSourceSampleRequestDeferral^ mDeferral;
 	};
 
+	// An I420 frame waiting for a sample request, held by reference: it is only converted to NV12 if a request takes it.
+	private ref class MSWinRTDisFrame sealed
+	{
+	internal:
+		// Takes ownership of m, whose planes are described by picture. The frame is converted to width x height.
+		MSWinRTDisFrame(mblk_t *m, const MSPicture &picture, int width, int height, VideoFitMode mode);
+		// Converts the frame to a pooled NV12 buffer and releases the I420 one. Returns nullptr if it cannot be allocated.
+		Windows::Storage::Streams::IBuffer^ Convert();
+		// The 90kHz timestamp of the frame.
+		uint32_t Timestamp() { return mTimestamp; }
+		// The stamp of the ticker creating the frame, see LatencyTracer::stamp().
+		uint32_t Entered() { return mEntered; }
+
+	private:
+		~MSWinRTDisFrame();
+
+		mblk_t *mBlock;
+		uint32_t mTimestamp;
+		uint32_t mEntered;
+		MSPicture mPicture;
+		int mWidth;
+		int mHeight;
+		VideoFitMode mMode;
+	};
+
 	private ref class MSWinRTDisSampleHandler sealed
 	{
 	public:
@@ -74,7 +105,6 @@ namespace libmswinrtvid
 		virtual ~MSWinRTDisSampleHandler();
 		void StartMediaElement();
 		void StopMediaElement();
-		void Feed(Windows::Storage::Streams::IBuffer^ pBuffer);
 		void OnSampleRequested(Windows::Media::Core::MediaStreamSource ^sender, Windows::Media::Core::MediaStreamSourceSampleRequestedEventArgs ^args);
 		void RequestMediaElementRestart();
 
@@ -102,14 +132,39 @@ namespace libmswinrtvid
 			void set(int value) { mHeight = value; }
 		}
 
+		// Frames replaced by a newer one before a sample request has taken them.
+		property unsigned int SupersededFrames
+		{
+			unsigned int get() { return (unsigned int)mMailbox.getStats().overwritten; }
+		}
+
+		// Frames still waiting when the MediaElement has been stopped or restarted, too late for the last request.
+		property unsigned int LateFrames
+		{
+			unsigned int get() { return mLateFrames; }
+		}
+
+	internal:
+		// Called by the ticker. If a sample request is waiting, returns true with the deferral and the frame it must be
+		// answered with through AnswerDeferral(), possibly by another thread.
+		bool Feed(MSWinRTDisFrame^ frame, MSWinRTDisDeferral^ *deferral, MSWinRTDisFrame^ *requestFrame);
+		void AnswerDeferral(MSWinRTDisDeferral^ deferral, MSWinRTDisFrame^ frame);
+		// Called by the ticker when the MediaElement is stopped or restarted: the frame that no request has taken is
+		// released with its input, and counted as late.
+		void DiscardLatestFrame();
+		// Updated by the threads answering the sample requests. Must only be reset while the MediaElement is stopped.
+		LatencyTracer & GetLatencyTracer() { return mLatency; }
+
 	private:
-		void AnswerSampleRequest(Windows::Media::Core::MediaStreamSourceSampleRequest^ sampleRequest);
+		void AnswerSampleRequest(Windows::Media::Core::MediaStreamSourceSampleRequest^ sampleRequest, MSWinRTDisFrame^ frame);
+		void CancelSampleRequest();
 
-		Windows::Storage::Streams::IBuffer^ mSample;
-		Platform::Collections::Vector<MSWinRTDisDeferral^>^ mDeferralQueue;
+		FrameMailbox<MSWinRTDisFrame^, MSWinRTDisDeferral^> mMailbox;
+		std::atomic<unsigned int> mLateFrames;
 		Windows::UI::Xaml::Controls::MediaElement^ mMediaElement;
-		UINT64 mReferenceTime;
-		std::mutex mMutex;
+		PresentationClock mClock;
+		LatencyTracer mLatency;
+		std::mutex mMutex;	// Protects the starting and restarting of the MediaElement.
 		MSPixFmt mPixFmt;
 		int mWidth;
 		int mHeight;
@@ -131,11 +186,25 @@ namespace libmswinrtvid
 		MSVideoSize getVideoSize();
 		void setVideoSize(MSVideoSize vs);
 		void setMediaElement(Windows::UI::Xaml::Controls::MediaElement^ mediaElement) { mSampleHandler->MediaElement = mediaElement; }
+		void setFitMode(MSWinRTDisFitMode mode) { mFitMode = mode; }
+		void setDuplicateDetection(MSWinRTDisDuplicateDetection detection) { mDuplicateDetector.setMode((DuplicateFrameDetector::Mode)detection); }
+		int getSkippedFrames() { return (int)mDuplicateDetector.getSkippedFrames(); }
+		void enableAsyncConversion(bool enable) { mAsyncConversion = enable; }
+		ConversionPipeline::Stats getConversionStats() { return mPipeline.getStats(); }
+		unsigned int getSupersededFrames() { return mSampleHandler->SupersededFrames; }
+		unsigned int getLateFrames() { return mSampleHandler->LateFrames; }
+		LatencyTracer & getLatencyTracer() { return mSampleHandler->GetLatencyTracer(); }
 
 	private:
 		bool mIsInitialized;
 		bool mIsActivated;
 		bool mIsStarted;
+		bool mHasOutputSize;
+		MSWinRTDisFitMode mFitMode;
+		DuplicateFrameDetector mDuplicateDetector;
+		bool mAsyncConversion;
+		// Answers the sample requests waiting for a frame on the worker pool, when the conversion is asynchronous.
+		ConversionPipeline mPipeline;
 		MSWinRTDisSampleHandler^ mSampleHandler;
 		Windows::Media::Core::MediaStreamSource^ mMediaStreamSource;
 	};
@@ -17,6 +17,11 @@ using namespace Windows::Foundation;
 }
 
 
+// The queue holds a few samples at most while the work queue dispatches them, and the markers must never be dropped,
+// so it grows in the unlikely case it is full.
+static const size_t kSampleQueueCapacity = 16;
+
+
 static void AddAttribute(_In_ GUID guidKey, _In_ IPropertyValue ^value, _In_ IMFAttributes *pAttr)
 {
 	HRESULT hr = S_OK;
@@ -187,6 +192,7 @@ MSWinRTStreamSink::MSWinRTStreamSink(DWORD dwIdentifier)
 	, _StartTime(0)
 	, _WorkQueueId(0)
 	, _pParent(nullptr)
+	, _SampleQueue(kSampleQueueCapacity, RingOverflowGrow)
 #pragma warning(push)
 #pragma warning(disable:4355)
 	, _WorkQueueCB(this, &MSWinRTStreamSink::OnDispatchWorkItem)
@@ -194,6 +200,9 @@ MSWinRTStreamSink::MSWinRTStreamSink(DWORD dwIdentifier)
 {
 	ZeroMemory(&_guiCurrentSubtype, sizeof(_guiCurrentSubtype));
 	_guiCurrentFrameSize = 0;
+	for (int op = 0; op < Op_Count; op++) {
+		_Operations[op].Attach(new MSWinRTAsyncOperation((StreamOperation)op)); // Created with ref count = 1
+	}
 	MSWINRTMEDIASINK_DEBUG("MSWinRTStreamSink constructor");
 }
 
@@ -794,12 +803,16 @@ HRESULT MSWinRTStreamSink::QueueAsyncOperation(StreamOperation op)
 {
 	MSWINRTMEDIASINK_DEBUG("MSWinRTStreamSink::QueueAsyncOperation");
 	HRESULT hr = S_OK;
-	ComPtr<MSWinRTAsyncOperation> spOp;
-	spOp.Attach(new MSWinRTAsyncOperation(op)); // Created with ref count = 1
+	// A pending OpProcessSample sends all the queued samples, so the new one will be sent by it as well.
+	if ((op == OpProcessSample) && !_ProcessSampleCoalescer.request())
+		return S_OK;
+	ComPtr<MSWinRTAsyncOperation> spOp = _Operations[op];
 	if (!spOp)
 		hr = E_OUTOFMEMORY;
 	if (SUCCEEDED(hr))
 		hr = MFPutWorkItem2(_WorkQueueId, 0, &_WorkQueueCB, spOp.Get());
+	if (FAILED(hr) && (op == OpProcessSample))
+		_ProcessSampleCoalescer.cancel();
 	RETURN_HR(hr)
 }
 
@@ -876,11 +889,12 @@ HRESULT MSWinRTStreamSink::OnDispatchWorkItem(IMFAsyncResult *pAsyncResult)
 void MSWinRTStreamSink::DispatchProcessSample(MSWinRTAsyncOperation *pOp)
 {
 	MSWINRTMEDIASINK_DEBUG("MSWinRTStreamSink::DispatchProcessSample");
+	unsigned int processSampleRequests = (pOp->m_op == OpProcessSample) ? _ProcessSampleCoalescer.take() : 0;
 	bool fRequestMoreSamples = SendSampleFromQueue();
 
-	// Ask for another sample
+	// Ask for another sample for each ProcessSample served by this dispatch, as if each of them had been dispatched on its own.
 	if (fRequestMoreSamples) {
-		if (pOp->m_op == OpProcessSample) {
+		for (unsigned int i = 0; i < processSampleRequests; i++) {
 			HRESULT hr = QueueEvent(MEStreamSinkRequestSample, GUID_NULL, S_OK, nullptr);
 			if (FAILED(hr))
 				throw ref new Exception(hr);
@@ -1005,9 +1019,19 @@ HRESULT MSWinRTStreamSink::PrepareSample(IMFSample *pSample)
 		return hr;
 	if (llSampleTime < 0)
 		return hr;
+	// The frames dropped by the decimation are neither copied nor lent.
+	if (!static_cast<MSWinRTMediaSink *>(_spSink.Get())->AcceptSample(llSampleTime))
+		return hr;
 
 	DWORD cBuffers = 0;
 	hr = pSample->GetBufferCount(&cBuffers);
+	if (SUCCEEDED(hr) && (cBuffers == 1)) {
+		// The capture filter may pass the buffer downstream as it is instead of copying it.
+		ComPtr<IMFMediaBuffer> spMediaBuffer;
+		hr = pSample->GetBufferByIndex(0, &spMediaBuffer);
+		if (SUCCEEDED(hr) && static_cast<MSWinRTMediaSink *>(_spSink.Get())->OnBufferAvailable(spMediaBuffer.Get(), llSampleTime))
+			RETURN_HR(hr)
+	}
 	if (SUCCEEDED(hr)) {
 		for (DWORD nIndex = 0; nIndex < cBuffers; ++nIndex) {
 			ComPtr<IMFMediaBuffer> spMediaBuffer;
@@ -1311,3 +1335,21 @@ void MSWinRTMediaSink::OnSampleAvailable(BYTE *buf, DWORD bufLen, LONGLONG prese
 		_capture->OnSampleAvailable(buf, bufLen, presentationTime);
 	}
 }
+
+bool MSWinRTMediaSink::AcceptSample(LONGLONG presentationTime)
+{
+	if (_capture != nullptr) {
+		return _capture->AcceptSample(presentationTime);
+	}
+	return true;
+}
+
+// Returns true if the capture filter has taken the buffer itself, false if the caller has to pass it its content.
+bool MSWinRTMediaSink::OnBufferAvailable(IMFMediaBuffer *buffer, LONGLONG presentationTime)
+{
+	MSWINRTMEDIASINK_DEBUG("MSWinRTMediaSink::OnBufferAvailable");
+	if (_capture != nullptr) {
+		return _capture->OnBufferAvailable(buffer, presentationTime);
+	}
+	return false;
+}
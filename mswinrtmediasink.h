@@ -16,7 +16,8 @@
 #include <wrl\ftm.h>
 #include <ppltasks.h>
 
-#include "LinkList.h"
+#include "RingBuffer.h"
+#include "WorkItemCoalescer.h"
 
 using namespace Platform;
 using namespace Microsoft::WRL;
@@ -80,6 +81,84 @@ namespace libmswinrtvid {
 	};
 
 
+	// Queue of COM pointers with the InsertBack/RemoveFront/Clear contract of the ComPtrList of LinkList.h, stored in a ring
+	// so that queuing a sample does not allocate. The queue holds a reference on each item.
+	template <class T>
+	class ComPtrRing
+	{
+	public:
+		ComPtrRing(size_t capacity, RingOverflowPolicy policy) : m_ring(capacity, policy)
+		{
+		}
+
+		~ComPtrRing()
+		{
+			Clear();
+		}
+
+		HRESULT InsertBack(T *item)
+		{
+			if (item == nullptr)
+			{
+				return E_POINTER;
+			}
+			item->AddRef();
+			T *dropped = nullptr;
+			switch (m_ring.insertBack(item, &dropped))
+			{
+			case RingBuffer<T *>::Rejected:
+				item->Release();
+				return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+			case RingBuffer<T *>::InsertedDroppingOldest:
+				dropped->Release();
+				break;
+			default:
+				break;
+			}
+			return S_OK;
+		}
+
+		// The reference held by the queue is handed over to the caller, or released if ppItem is nullptr.
+		HRESULT RemoveFront(T **ppItem)
+		{
+			T *item = nullptr;
+			if (!m_ring.removeFront(&item))
+			{
+				return E_FAIL;
+			}
+			if (ppItem)
+			{
+				*ppItem = item;
+			}
+			else
+			{
+				item->Release();
+			}
+			return S_OK;
+		}
+
+		void Clear()
+		{
+			ReleaseItem release;
+			m_ring.clear(release);
+		}
+
+		DWORD GetCount() const { return (DWORD)m_ring.getCount(); }
+		bool IsEmpty() const { return m_ring.isEmpty(); }
+
+	private:
+		struct ReleaseItem
+		{
+			void operator()(T *item)
+			{
+				item->Release();
+			}
+		};
+
+		RingBuffer<T *> m_ring;
+	};
+
+
 	interface DECLSPEC_UUID("3AC82233-933C-43a9-AF3D-ADC94EABF406") DECLSPEC_NOVTABLE IMarker : public IUnknown
 	{
 		IFACEMETHOD(GetMarkerType) (MFSTREAMSINK_MARKER_TYPE *pType) = 0;
@@ -311,10 +390,12 @@ namespace libmswinrtvid {
 		ComPtr<IMFMediaType>        _spCurrentType;
 		ComPtr<IMFSample>           _spFirstVideoSample;
 
-		ComPtrList<IUnknown>        _SampleQueue;               // Queue to hold samples and markers.
+		ComPtrRing<IUnknown>        _SampleQueue;               // Queue to hold samples and markers.
 																// Applies to: ProcessSample, PlaceMarker
 
 		AsyncCallback<MSWinRTStreamSink>  _WorkQueueCB;              // Callback for the work queue.
+		ComPtr<MSWinRTAsyncOperation> _Operations[Op_Count];  // Posted on the work queue, one per operation as they carry no other state.
+		WorkItemCoalescer           _ProcessSampleCoalescer;    // Keeps a single OpProcessSample pending on the work queue.
 
 		ComPtr<IUnknown>            _spFTM;
 	};
@@ -362,6 +443,8 @@ namespace libmswinrtvid {
 		void ReportEndOfStream();
 		void SetCaptureFilter(MSWinRTCapHelper^ capture) { _capture = capture; }
 		void OnSampleAvailable(BYTE *buf, DWORD bufLen, LONGLONG presentationTime);
+		bool OnBufferAvailable(IMFMediaBuffer *buffer, LONGLONG presentationTime);
+		bool AcceptSample(LONGLONG presentationTime);
 
 	private:
 		void HandleError(HRESULT hr);
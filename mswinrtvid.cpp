@@ -31,7 +31,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "IVideoRenderer.h"
 #endif
 
+#include "FramePool.h"
 #include "Renderer.h"
+#include "VideoWorkerPool.h"
 
 using namespace libmswinrtvid;
 #ifdef MS2_WINDOWS_PHONE
@@ -39,6 +41,54 @@ using namespace Mediastreamer2::WinRTVideo;
 #endif
 
 
+/******************************************************************************
+ * Methods common to all the filters of the plugin                            *
+ *****************************************************************************/
+
+static int ms_winrtvid_set_conversion_threads(MSFilter *f, void *arg) {
+	VideoWorkerPool::get()->setThreadCount(*((int *)arg));
+	return 0;
+}
+
+static int ms_winrtvid_get_conversion_threads(MSFilter *f, void *arg) {
+	*((int *)arg) = VideoWorkerPool::get()->getThreadCount();
+	return 0;
+}
+
+static int ms_winrtvid_set_frame_pool_size(MSFilter *f, void *arg) {
+	FramePool::get()->setMaxIdleBytes((size_t)*((int *)arg));
+	return 0;
+}
+
+static int ms_winrtvid_get_frame_pool_stats(MSFilter *f, void *arg) {
+	FramePool::Stats stats = FramePool::get()->getStats();
+	MSWinRTVidFramePoolStats *poolStats = (MSWinRTVidFramePoolStats *)arg;
+	poolStats->hits = stats.hits;
+	poolStats->misses = stats.misses;
+	poolStats->allocated_bytes = stats.allocatedBytes;
+	poolStats->idle_bytes = stats.idleBytes;
+	return 0;
+}
+
+static void fill_latency(MSWinRTVidLatency *latency, const LatencyHistogram &histogram) {
+	LatencyHistogram::Summary summary = histogram.summarize();
+	latency->count = summary.count;
+	latency->mean_us = (unsigned int)summary.meanUs;
+	latency->p50_us = (unsigned int)summary.p50Us;
+	latency->p90_us = (unsigned int)summary.p90Us;
+	latency->p99_us = (unsigned int)summary.p99Us;
+	latency->max_us = (unsigned int)summary.maxUs;
+}
+
+static void fill_latency_stats(MSWinRTVidLatencyStats *stats, LatencyTracer &tracer) {
+	fill_latency(&stats->handoff, tracer.stage(LatencyTracer::StageHandoff));
+	fill_latency(&stats->queue_wait, tracer.stage(LatencyTracer::StageQueueWait));
+	fill_latency(&stats->conversion, tracer.stage(LatencyTracer::StageConversion));
+	fill_latency(&stats->total, tracer.stage(LatencyTracer::StageTotal));
+	fill_latency(&stats->jitter, tracer.jitter());
+}
+
+
 /******************************************************************************
  * Methods to (de)initialize and run the WinRT video capture filter           *
  *****************************************************************************/
@@ -98,6 +148,12 @@ static int ms_winrtcap_get_pix_fmt(MSFilter *f, void *arg) {
 	return 0;
 }
 
+static int ms_winrtcap_set_pix_fmt(MSFilter *f, void *arg) {
+	MSWinRTCap *r = static_cast<MSWinRTCap *>(f->data);
+	MSPixFmt *fmt = static_cast<MSPixFmt *>(arg);
+	return r->setPixFmt(*fmt);
+}
+
 static int ms_winrtcap_get_vsize(MSFilter *f, void *arg) {
 	MSWinRTCap *r = static_cast<MSWinRTCap *>(f->data);
 	MSVideoSize *vs = static_cast<MSVideoSize *>(arg);
@@ -121,13 +177,81 @@ static int ms_winrtcap_set_device_orientation(MSFilter *f, void *arg) {
 	return 0;
 }
 
+static int ms_winrtcap_enable_downscale(MSFilter *f, void *arg) {
+	MSWinRTCap *r = static_cast<MSWinRTCap *>(f->data);
+	r->enableDownscale(*((bool_t *)arg) == TRUE);
+	return 0;
+}
+
+static int ms_winrtcap_enable_mirror(MSFilter *f, void *arg) {
+	MSWinRTCap *r = static_cast<MSWinRTCap *>(f->data);
+	r->enableMirror(*((bool_t *)arg) == TRUE);
+	return 0;
+}
+
+static int ms_winrtcap_enable_zero_copy(MSFilter *f, void *arg) {
+	MSWinRTCap *r = static_cast<MSWinRTCap *>(f->data);
+	r->enableZeroCopy(*((bool_t *)arg) == TRUE);
+	return 0;
+}
+
+static int ms_winrtcap_enable_pacing(MSFilter *f, void *arg) {
+	MSWinRTCap *r = static_cast<MSWinRTCap *>(f->data);
+	r->enablePacing(*((bool_t *)arg) == TRUE);
+	return 0;
+}
+
+static int ms_winrtcap_enable_decimation(MSFilter *f, void *arg) {
+	MSWinRTCap *r = static_cast<MSWinRTCap *>(f->data);
+	r->enableDecimation(*((bool_t *)arg) == TRUE);
+	return 0;
+}
+
+static int ms_winrtcap_set_queue_policy(MSFilter *f, void *arg) {
+	MSWinRTCap *r = static_cast<MSWinRTCap *>(f->data);
+	r->setQueuePolicy((MSWinRTCapQueuePolicy)*((int *)arg));
+	return 0;
+}
+
+static int ms_winrtcap_set_queue_depth(MSFilter *f, void *arg) {
+	MSWinRTCap *r = static_cast<MSWinRTCap *>(f->data);
+	r->setQueueDepth(*((int *)arg));
+	return 0;
+}
+
+static int ms_winrtcap_get_dropped_frames(MSFilter *f, void *arg) {
+	MSWinRTCap *r = static_cast<MSWinRTCap *>(f->data);
+	*((int *)arg) = r->getDroppedFrames();
+	return 0;
+}
+
+static int ms_winrtcap_get_latency_stats(MSFilter *f, void *arg) {
+	MSWinRTCap *r = static_cast<MSWinRTCap *>(f->data);
+	fill_latency_stats((MSWinRTVidLatencyStats *)arg, r->getLatencyTracer());
+	return 0;
+}
+
 static MSFilterMethod ms_winrtcap_read_methods[] = {
 	{ MS_FILTER_GET_FPS,                           ms_winrtcap_get_fps                    },
 	{ MS_FILTER_SET_FPS,                           ms_winrtcap_set_fps                    },
 	{ MS_FILTER_GET_PIX_FMT,                       ms_winrtcap_get_pix_fmt                },
+	{ MS_FILTER_SET_PIX_FMT,                       ms_winrtcap_set_pix_fmt                },
 	{ MS_FILTER_GET_VIDEO_SIZE,                    ms_winrtcap_get_vsize                  },
 	{ MS_FILTER_SET_VIDEO_SIZE,                    ms_winrtcap_set_vsize                  },
 	{ MS_VIDEO_CAPTURE_SET_DEVICE_ORIENTATION,     ms_winrtcap_set_device_orientation     },
+	{ MS_WINRTCAP_ENABLE_DOWNSCALE,                ms_winrtcap_enable_downscale           },
+	{ MS_WINRTCAP_ENABLE_MIRROR,                   ms_winrtcap_enable_mirror              },
+	{ MS_WINRTCAP_ENABLE_ZERO_COPY,                ms_winrtcap_enable_zero_copy           },
+	{ MS_WINRTCAP_SET_QUEUE_POLICY,                ms_winrtcap_set_queue_policy           },
+	{ MS_WINRTCAP_SET_QUEUE_DEPTH,                 ms_winrtcap_set_queue_depth            },
+	{ MS_WINRTCAP_GET_DROPPED_FRAMES,              ms_winrtcap_get_dropped_frames         },
+	{ MS_WINRTCAP_ENABLE_PACING,                   ms_winrtcap_enable_pacing              },
+	{ MS_WINRTCAP_ENABLE_DECIMATION,               ms_winrtcap_enable_decimation          },
+	{ MS_WINRTVID_GET_LATENCY_STATS,               ms_winrtcap_get_latency_stats          },
+	{ MS_WINRTVID_SET_CONVERSION_THREADS,          ms_winrtvid_set_conversion_threads     },
+	{ MS_WINRTVID_GET_CONVERSION_THREADS,          ms_winrtvid_get_conversion_threads     },
+	{ MS_WINRTVID_SET_FRAME_POOL_SIZE,             ms_winrtvid_set_frame_pool_size        },
+	{ MS_WINRTVID_GET_FRAME_POOL_STATS,            ms_winrtvid_get_frame_pool_stats       },
 	{ 0,                                           NULL                                   }
 };
 
@@ -251,10 +375,81 @@ static int ms_winrtdis_set_native_window_id(MSFilter *f, void *arg) {
 	return 0;
 }
 
+static int ms_winrtdis_set_fit_mode(MSFilter *f, void *arg) {
+	MSWinRTDis *w = static_cast<MSWinRTDis *>(f->data);
+	int mode = *((int *)arg);
+	if ((mode < MSWinRTDisFitRestart) || (mode > MSWinRTDisFitCrop)) {
+		ms_error("[MSWinRTDis] Unsupported fit mode %i", mode);
+		return -1;
+	}
+	w->setFitMode((MSWinRTDisFitMode)mode);
+	return 0;
+}
+
+static int ms_winrtdis_set_duplicate_detection(MSFilter *f, void *arg) {
+	MSWinRTDis *w = static_cast<MSWinRTDis *>(f->data);
+	int detection = *((int *)arg);
+	if ((detection < MSWinRTDisDuplicateDetectionDisabled) || (detection > MSWinRTDisDuplicateDetectionFull)) {
+		ms_error("[MSWinRTDis] Unsupported duplicate detection mode %i", detection);
+		return -1;
+	}
+	w->setDuplicateDetection((MSWinRTDisDuplicateDetection)detection);
+	return 0;
+}
+
+static int ms_winrtdis_get_skipped_frames(MSFilter *f, void *arg) {
+	MSWinRTDis *w = static_cast<MSWinRTDis *>(f->data);
+	*((int *)arg) = w->getSkippedFrames();
+	return 0;
+}
+
+static int ms_winrtdis_enable_async_conversion(MSFilter *f, void *arg) {
+	MSWinRTDis *w = static_cast<MSWinRTDis *>(f->data);
+	w->enableAsyncConversion(*((bool_t *)arg) == TRUE);
+	return 0;
+}
+
+static int ms_winrtdis_get_conversion_stats(MSFilter *f, void *arg) {
+	MSWinRTDis *w = static_cast<MSWinRTDis *>(f->data);
+	ConversionPipeline::Stats stats = w->getConversionStats();
+	VideoWorkerPool::TaskStats taskStats = VideoWorkerPool::get()->getTaskStats();
+	MSWinRTDisConversionStats *conversionStats = (MSWinRTDisConversionStats *)arg;
+	conversionStats->submitted = stats.submitted;
+	conversionStats->overruns = stats.overruns;
+	conversionStats->queue_depth = taskStats.queueDepth;
+	conversionStats->max_queue_depth = taskStats.maxQueueDepth;
+	return 0;
+}
+
+static int ms_winrtdis_get_dropped_frames(MSFilter *f, void *arg) {
+	MSWinRTDis *w = static_cast<MSWinRTDis *>(f->data);
+	MSWinRTDisDroppedFrames *droppedFrames = (MSWinRTDisDroppedFrames *)arg;
+	droppedFrames->superseded = w->getSupersededFrames();
+	droppedFrames->late = w->getLateFrames();
+	return 0;
+}
+
+static int ms_winrtdis_get_latency_stats(MSFilter *f, void *arg) {
+	MSWinRTDis *w = static_cast<MSWinRTDis *>(f->data);
+	fill_latency_stats((MSWinRTVidLatencyStats *)arg, w->getLatencyTracer());
+	return 0;
+}
+
 static MSFilterMethod ms_winrtdis_methods[] = {
-	{ MS_FILTER_GET_VIDEO_SIZE,              ms_winrtdis_get_vsize            },
-	{ MS_VIDEO_DISPLAY_SET_NATIVE_WINDOW_ID, ms_winrtdis_set_native_window_id },
-	{ 0,                                     NULL                             }
+	{ MS_FILTER_GET_VIDEO_SIZE,              ms_winrtdis_get_vsize               },
+	{ MS_VIDEO_DISPLAY_SET_NATIVE_WINDOW_ID, ms_winrtdis_set_native_window_id    },
+	{ MS_WINRTDIS_SET_FIT_MODE,              ms_winrtdis_set_fit_mode            },
+	{ MS_WINRTDIS_SET_DUPLICATE_DETECTION,   ms_winrtdis_set_duplicate_detection },
+	{ MS_WINRTDIS_GET_SKIPPED_FRAMES,        ms_winrtdis_get_skipped_frames      },
+	{ MS_WINRTDIS_ENABLE_ASYNC_CONVERSION,   ms_winrtdis_enable_async_conversion },
+	{ MS_WINRTDIS_GET_CONVERSION_STATS,      ms_winrtdis_get_conversion_stats    },
+	{ MS_WINRTDIS_GET_DROPPED_FRAMES,        ms_winrtdis_get_dropped_frames      },
+	{ MS_WINRTVID_GET_LATENCY_STATS,         ms_winrtdis_get_latency_stats       },
+	{ MS_WINRTVID_SET_CONVERSION_THREADS,    ms_winrtvid_set_conversion_threads  },
+	{ MS_WINRTVID_GET_CONVERSION_THREADS,    ms_winrtvid_get_conversion_threads  },
+	{ MS_WINRTVID_SET_FRAME_POOL_SIZE,       ms_winrtvid_set_frame_pool_size     },
+	{ MS_WINRTVID_GET_FRAME_POOL_STATS,      ms_winrtvid_get_frame_pool_stats    },
+	{ 0,                                     NULL                                }
 };
 
 
@@ -344,9 +539,32 @@ static int ms_winrtbackgrounddis_set_native_window_id(MSFilter *f, void *arg) {
 	return 0;
 }
 
+static int ms_winrtbackgrounddis_set_duplicate_detection(MSFilter *f, void *arg) {
+	MSWinRTBackgroundDis *w = static_cast<MSWinRTBackgroundDis *>(f->data);
+	int detection = *((int *)arg);
+	if ((detection < MSWinRTDisDuplicateDetectionDisabled) || (detection > MSWinRTDisDuplicateDetectionFull)) {
+		ms_error("[MSWinRTBackgroundDis] Unsupported duplicate detection mode %i", detection);
+		return -1;
+	}
+	w->setDuplicateDetection((MSWinRTDisDuplicateDetection)detection);
+	return 0;
+}
+
+static int ms_winrtbackgrounddis_get_skipped_frames(MSFilter *f, void *arg) {
+	MSWinRTBackgroundDis *w = static_cast<MSWinRTBackgroundDis *>(f->data);
+	*((int *)arg) = w->getSkippedFrames();
+	return 0;
+}
+
 static MSFilterMethod ms_winrtbackgrounddis_methods[] = {
 	{ MS_FILTER_GET_VIDEO_SIZE,              ms_winrtbackgrounddis_get_vsize },
 	{ MS_VIDEO_DISPLAY_SET_NATIVE_WINDOW_ID, ms_winrtbackgrounddis_set_native_window_id },
+	{ MS_WINRTDIS_SET_DUPLICATE_DETECTION,   ms_winrtbackgrounddis_set_duplicate_detection },
+	{ MS_WINRTDIS_GET_SKIPPED_FRAMES,        ms_winrtbackgrounddis_get_skipped_frames },
+	{ MS_WINRTVID_SET_CONVERSION_THREADS,    ms_winrtvid_set_conversion_threads },
+	{ MS_WINRTVID_GET_CONVERSION_THREADS,    ms_winrtvid_get_conversion_threads },
+	{ MS_WINRTVID_SET_FRAME_POOL_SIZE,       ms_winrtvid_set_frame_pool_size },
+	{ MS_WINRTVID_GET_FRAME_POOL_STATS,      ms_winrtvid_get_frame_pool_stats },
 	{ 0,                                     NULL }
 };
 
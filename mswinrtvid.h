@@ -33,6 +33,133 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include <agile.h>
 
+
+/* Methods understood by all the filters of the plugin. */
+
+/* Number of threads converting large frames, including the filter's own thread. 0 selects one per processor. Shared by all the filters. */
+#define MS_WINRTVID_SET_CONVERSION_THREADS	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 0, int)
+#define MS_WINRTVID_GET_CONVERSION_THREADS	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 1, int)
+
+typedef struct _MSWinRTVidFramePoolStats {
+	uint64_t hits;	/* Frames taken from the pool. */
+	uint64_t misses;	/* Frames that had to be allocated. */
+	size_t allocated_bytes;	/* Memory of all the frames, in use or idle. */
+	size_t idle_bytes;	/* Memory of the frames waiting in the pool. */
+} MSWinRTVidFramePoolStats;
+
+/* Maximum amount of memory kept by the pool of frames shared by all the filters, in bytes. */
+#define MS_WINRTVID_SET_FRAME_POOL_SIZE	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 7, int)
+#define MS_WINRTVID_GET_FRAME_POOL_STATS	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 8, MSWinRTVidFramePoolStats)
+
+/* Methods of the capture filter. */
+
+/* When the camera has no mode of the requested size, capture in the nearest larger mode and downscale the frames to the requested size.
+ * Takes effect at the next MS_FILTER_SET_VIDEO_SIZE. */
+#define MS_WINRTCAP_ENABLE_DOWNSCALE	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 2, bool_t)
+
+/* Mirror the captured frames horizontally, for a self-view. This is done while converting them, without any extra pass
+ * in I420. In NV12 the mirrored chroma planes are interleaved again, the output format does not change. */
+#define MS_WINRTCAP_ENABLE_MIRROR	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 4, bool_t)
+
+/* Pass the NV12 camera frames downstream without copying them when they need no rotation, mirroring nor downscaling.
+ * At most two frames are held this way, the next ones are copied until they are freed. The mblk of such a frame only
+ * holds the mediastreamer2 video header, the camera buffer follows it in b_cont as ms_yuv_buf_init_from_mblk() expects. */
+#define MS_WINRTCAP_ENABLE_ZERO_COPY	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 9, bool_t)
+
+typedef enum _MSWinRTCapQueuePolicy {
+	MSWinRTCapQueueDropOldest,	/* When the queue is full, the oldest frame is dropped to make room for the new one (default). */
+	MSWinRTCapQueueKeepLatest	/* Same, and only the newest queued frame is sent at each tick, the older ones are dropped. */
+} MSWinRTCapQueuePolicy;
+
+/* How the captured frames waiting for the ticker are dropped when it does not keep up, one of MSWinRTCapQueuePolicy. */
+#define MS_WINRTCAP_SET_QUEUE_POLICY	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 10, int)
+
+/* Maximum number of captured frames waiting for the ticker, from 1 to 32. Defaults to 8. */
+#define MS_WINRTCAP_SET_QUEUE_DEPTH	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 11, int)
+
+/* Number of captured frames dropped because the ticker did not keep up. */
+#define MS_WINRTCAP_GET_DROPPED_FRAMES	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 12, int)
+
+/* Release at most one frame per frame interval instead of all the frames queued since the previous one, choosing them by
+ * capture time: the frames captured more than one interval before the newest one are dropped. */
+#define MS_WINRTCAP_ENABLE_PACING	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 13, bool_t)
+
+/* Decimate the camera frames to the frame rate of the filter by their presentation time, before they are copied, instead
+ * of by the time of the ticker. Fractional frame rates (such as 29.97) are supported and the frames are evenly spaced. */
+#define MS_WINRTCAP_ENABLE_DECIMATION	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 16, bool_t)
+
+/* Methods of the display filter. */
+
+typedef enum _MSWinRTDisFitMode {
+	MSWinRTDisFitRestart,	/* Restart the MediaElement with the new dimensions (default). */
+	MSWinRTDisFitStretch,	/* Keep the dimensions of the first frame and scale the next frames to them. */
+	MSWinRTDisFitLetterbox,	/* Same but scale to fit, adding black borders. */
+	MSWinRTDisFitCrop	/* Same but scale to cover, cropping the exceeding part. */
+} MSWinRTDisFitMode;
+
+/* How to handle the frames whose dimensions differ from the ones the MediaElement has been started with. */
+#define MS_WINRTDIS_SET_FIT_MODE	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 3, int)
+
+typedef struct _MSWinRTDisConversionStats {
+	uint64_t submitted;	/* Frames converted by the worker pool to answer a waiting request. */
+	uint64_t overruns;	/* Conversions not finished at the next tick, that the ticker had to wait for. */
+	size_t queue_depth;	/* Conversions of all the filters waiting for a worker. */
+	size_t max_queue_depth;
+} MSWinRTDisConversionStats;
+
+/* The frames are only converted when a sample request of the MediaElement takes them. A request made while a frame is
+ * waiting is answered by the Media Foundation thread, a request waiting for a frame by the ticker when the frame arrives.
+ * Answer the latter on the worker pool shared by all the filters instead of the ticker thread. The answer is collected
+ * at the next tick. */
+#define MS_WINRTDIS_ENABLE_ASYNC_CONVERSION	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 14, bool_t)
+#define MS_WINRTDIS_GET_CONVERSION_STATS	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 15, MSWinRTDisConversionStats)
+
+typedef struct _MSWinRTDisDroppedFrames {
+	unsigned int superseded;	/* Frames replaced by a newer one before a sample request has taken them. */
+	unsigned int late;	/* Frames still waiting for a sample request when the MediaElement has been stopped or restarted. */
+} MSWinRTDisDroppedFrames;
+
+/* Frames dropped by the display without having been converted. */
+#define MS_WINRTDIS_GET_DROPPED_FRAMES	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 17, MSWinRTDisDroppedFrames)
+
+/* Methods of the capture filter and of the display filter. */
+
+typedef struct _MSWinRTVidLatency {
+	uint64_t count;	/* Frames measured. */
+	unsigned int mean_us;
+	unsigned int p50_us;
+	unsigned int p90_us;
+	unsigned int p99_us;
+	unsigned int max_us;
+} MSWinRTVidLatency;
+
+typedef struct _MSWinRTVidLatencyStats {
+	MSWinRTVidLatency handoff;	/* Capture: from the camera callback to the frame queued for the ticker. Display: from the end of the conversion to the sample handed to Media Foundation. */
+	MSWinRTVidLatency queue_wait;	/* Capture: from the frame queued to the ticker sending it. Display: from the ticker to the sample request taking the frame. */
+	MSWinRTVidLatency conversion;
+	MSWinRTVidLatency total;	/* From the camera callback, or from the ticker for the display, to the frame leaving the filter. */
+	MSWinRTVidLatency jitter;	/* Difference between consecutive intervals of the frames leaving the filter. */
+} MSWinRTVidLatencyStats;
+
+/* Latency of the frames going through the filter since it was started. The percentiles are within 1/16 of the measured
+ * durations. The same figures are logged every 10 seconds. */
+#define MS_WINRTVID_GET_LATENCY_STATS	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 18, MSWinRTVidLatencyStats)
+
+/* Methods of both display filters. */
+
+typedef enum _MSWinRTDisDuplicateDetection {
+	MSWinRTDisDuplicateDetectionDisabled,	/* Every frame is converted and displayed (default). */
+	MSWinRTDisDuplicateDetectionSampled,	/* Frames are compared with a fingerprint of one row out of four. */
+	MSWinRTDisDuplicateDetectionFull	/* Frames are compared with a fingerprint of all their samples. */
+} MSWinRTDisDuplicateDetection;
+
+/* Skip the conversion and display of the frames identical to the previous one, one of MSWinRTDisDuplicateDetection. */
+#define MS_WINRTDIS_SET_DUPLICATE_DETECTION	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 5, int)
+
+/* Number of frames skipped because they were identical to the previous one. */
+#define MS_WINRTDIS_GET_SKIPPED_FRAMES	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 6, int)
+
+
 typedef struct WinRTWebcam {
 	std::vector<wchar_t> *id_vector;
 	LPWSTR id;
@@ -0,0 +1,1530 @@
+/*
+mswinrtvid_bench.cpp
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// Benchmark of the pixel kernels used by the capture and display filters.
+// It only depends on the portable kernels library and prints its results as JSON on the standard output.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BufferLender.h"
+#include "FrameDecimator.h"
+#include "FrameMailbox.h"
+#include "FramePacer.h"
+#include "FramePool.h"
+#include "LatencyTracer.h"
+#include "PresentationClock.h"
+#include "RecyclingPool.h"
+#include "RingBuffer.h"
+#include "SpscQueue.h"
+#include "VideoKernels.h"
+#include "VideoWorkerPool.h"
+#include "WorkItemCoalescer.h"
+
+// The List of LinkList.h is benchmarked against the RingBuffer that replaced it in the media sink.
+// On other platforms than Windows, it only needs these few definitions.
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+typedef long HRESULT;
+typedef unsigned long DWORD;
+struct IUnknown {
+	virtual unsigned long AddRef() = 0;
+	virtual unsigned long Release() = 0;
+};
+#define FALSE 0
+#define S_OK ((HRESULT)0)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define E_INVALIDARG ((HRESULT)0x80070057L)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000EL)
+#define E_POINTER ((HRESULT)0x80004003L)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#endif
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdelete-incomplete"
+#endif
+#include "LinkList.h"
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
+using namespace libmswinrtvid;
+
+
+// Allocations made through operator new, counted to check that the steady state of the queues allocates nothing.
+static std::atomic<unsigned long> sAllocations(0);
+
+void * operator new(size_t size)
+{
+	sAllocations++;
+	void *p = malloc((size > 0) ? size : 1);
+	if (p == NULL) throw std::bad_alloc();
+	return p;
+}
+
+// GCC takes the free() of the inlined operator delete for a mismatch with the new expressions.
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 11)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 11)
+#pragma GCC diagnostic pop
+#endif
+
+
+struct BenchResolution {
+	const char *name;
+	int width;
+	int height;
+};
+
+static const BenchResolution kResolutions[] = {
+	{ "QCIF", 176, 144 },
+	{ "CIF", 352, 288 },
+	{ "VGA", 640, 480 },
+	{ "720p", 1280, 720 },
+	{ "1080p", 1920, 1080 },
+	{ "4K", 3840, 2160 }
+};
+
+
+// A picture whose planes are filled with pseudo-random samples, with strides larger than the width like the ones of the decoders.
+class BenchPicture {
+public:
+	BenchPicture(int width, int height, int padding)
+		: mWidth(width), mHeight(height)
+	{
+		int chromaWidth = (width + 1) / 2;
+		int chromaHeight = (height + 1) / 2;
+		strides[0] = width + padding;
+		strides[1] = strides[2] = chromaWidth + padding / 2;
+		uvStride = 2 * chromaWidth + padding;
+		mData.resize(strides[0] * height + 2 * strides[1] * chromaHeight + uvStride * chromaHeight);
+		for (size_t i = 0; i < mData.size(); i++) {
+			mData[i] = (uint8_t)rand();
+		}
+		planes[0] = &mData[0];
+		planes[1] = planes[0] + strides[0] * height;
+		planes[2] = planes[1] + strides[1] * chromaHeight;
+		uv = planes[2] + strides[2] * chromaHeight;
+	}
+
+	uint8_t *planes[3];
+	int strides[3];
+	uint8_t *uv;
+	int uvStride;
+
+private:
+	int mWidth;
+	int mHeight;
+	std::vector<uint8_t> mData;
+};
+
+struct BenchResult {
+	std::string kernel;
+	const BenchResolution *resolution;
+	int iterations;
+	double nsPerFrame;
+	double gbPerSecond;
+	std::string extra;	// Additional JSON fields, for the benchmarks that count more than time.
+};
+
+
+// Runs func until minTimeMs have elapsed (and at least a few times), and computes the time per frame and the throughput
+// given the number of bytes read and written by one call.
+static BenchResult runBench(const std::string &kernel, const BenchResolution *resolution, double bytesPerFrame, double minTimeMs, const std::function<void()> &func)
+{
+	typedef std::chrono::steady_clock Clock;
+	BenchResult result;
+	result.kernel = kernel;
+	result.resolution = resolution;
+
+	func(); // Warm up the caches and the worker threads.
+	int iterations = 0;
+	Clock::time_point start = Clock::now();
+	double elapsedNs = 0;
+	do {
+		func();
+		iterations++;
+		elapsedNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+	} while ((elapsedNs < (minTimeMs * 1e6)) || (iterations < 5));
+
+	result.iterations = iterations;
+	result.nsPerFrame = elapsedNs / iterations;
+	result.gbPerSecond = bytesPerFrame / result.nsPerFrame;
+	return result;
+}
+
+// Cache misses of the calling thread, from the hardware counters of Linux. Unavailable elsewhere, and on the systems or
+// virtual machines that do not expose the counters.
+class CacheMissCounter {
+public:
+	CacheMissCounter()
+		: mFd(-1)
+	{
+#ifdef __linux__
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		mFd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+
+	~CacheMissCounter()
+	{
+#ifdef __linux__
+		if (mFd >= 0) close(mFd);
+#endif
+	}
+
+	// Returns the misses of one call of func, or -1 if they cannot be counted.
+	long long count(const std::function<void()> &func)
+	{
+#ifdef __linux__
+		if (mFd >= 0) {
+			ioctl(mFd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(mFd, PERF_EVENT_IOC_ENABLE, 0);
+			func();
+			ioctl(mFd, PERF_EVENT_IOC_DISABLE, 0);
+			long long misses = 0;
+			if (read(mFd, &misses, sizeof(misses)) == (ssize_t)sizeof(misses)) return misses;
+		}
+#endif
+		func();
+		return -1;
+	}
+
+private:
+	int mFd;
+};
+
+static std::string formatCacheMisses(long long misses)
+{
+	if (misses < 0) return "null";
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%lld", misses);
+	return buffer;
+}
+
+// Port of the per-sample loops of copy_ycbcrbiplanar_to_true_yuv_with_rotation of mediastreamer2, which the capture
+// helper used before rotateNV12ToI420: the destination is written row by row, the quarter turns reading the source
+// down its columns. Rotations are clockwise.
+static void referenceRotateNV12ToI420(const uint8_t *srcY, int srcYStride, const uint8_t *srcUV, int srcUVStride, int width, int height,
+	uint8_t *const dstPlanes[3], const int dstStrides[3], int rotation)
+{
+	int chromaWidth = (width + 1) / 2;
+	int chromaHeight = (height + 1) / 2;
+	bool quarterTurn = (rotation == 90) || (rotation == 270);
+	int dstWidth = quarterTurn ? height : width;
+	int dstHeight = quarterTurn ? width : height;
+	int dstChromaWidth = quarterTurn ? chromaHeight : chromaWidth;
+	int dstChromaHeight = quarterTurn ? chromaWidth : chromaHeight;
+	for (int r = 0; r < dstHeight; r++) {
+		uint8_t *d = dstPlanes[0] + r * dstStrides[0];
+		for (int c = 0; c < dstWidth; c++) {
+			int x, y;
+			switch (rotation) {
+			case 90: x = r; y = height - 1 - c; break;
+			case 180: x = width - 1 - c; y = height - 1 - r; break;
+			case 270: x = width - 1 - r; y = c; break;
+			default: x = c; y = r; break;
+			}
+			d[c] = srcY[y * srcYStride + x];
+		}
+	}
+	for (int r = 0; r < dstChromaHeight; r++) {
+		uint8_t *u = dstPlanes[1] + r * dstStrides[1];
+		uint8_t *v = dstPlanes[2] + r * dstStrides[2];
+		for (int c = 0; c < dstChromaWidth; c++) {
+			int x, y;
+			switch (rotation) {
+			case 90: x = r; y = chromaHeight - 1 - c; break;
+			case 180: x = chromaWidth - 1 - c; y = chromaHeight - 1 - r; break;
+			case 270: x = chromaWidth - 1 - r; y = c; break;
+			default: x = c; y = r; break;
+			}
+			u[c] = srcUV[y * srcUVStride + 2 * x];
+			v[c] = srcUV[y * srcUVStride + 2 * x + 1];
+		}
+	}
+}
+
+static bool samePlanes(const BenchPicture &a, const BenchPicture &b, int width, int height)
+{
+	int chromaWidth = (width + 1) / 2;
+	int chromaHeight = (height + 1) / 2;
+	for (int y = 0; y < height; y++) {
+		if (memcmp(a.planes[0] + y * a.strides[0], b.planes[0] + y * b.strides[0], width) != 0) return false;
+	}
+	for (int p = 1; p < 3; p++) {
+		for (int y = 0; y < chromaHeight; y++) {
+			if (memcmp(a.planes[p] + y * a.strides[p], b.planes[p] + y * b.strides[p], chromaWidth) != 0) return false;
+		}
+	}
+	return true;
+}
+
+// Stands for the Media Foundation backend of the sample pool: each sample owns a frame-sized buffer.
+class MockSampleBackend : public RecyclingPoolBackend<std::vector<uint8_t> > {
+public:
+	std::vector<uint8_t> * create(int width, int height)
+	{
+		return new std::vector<uint8_t>(FramePool::frameSize(width, height, FramePool::FormatNV12));
+	}
+
+	void destroy(std::vector<uint8_t> *sample)
+	{
+		delete sample;
+	}
+};
+
+// Writes one byte per page, as the first conversion into a newly allocated frame does: with malloc, large frames get
+// fresh pages from the system each time and the page faults are part of the cost.
+// The stores are volatile so that the compiler does not elide them before the free.
+static void touchFrame(volatile uint8_t *frame, size_t size)
+{
+	for (size_t i = 0; i < size; i += 4096) {
+		frame[i] = (uint8_t)i;
+	}
+}
+
+static void benchResolution(const BenchResolution *resolution, double minTimeMs, std::vector<BenchResult> &results)
+{
+	int w = resolution->width;
+	int h = resolution->height;
+	int chromaWidth = (w + 1) / 2;
+	int chromaHeight = (h + 1) / 2;
+	double lumaBytes = (double)w * h;
+	double chromaBytes = 2.0 * chromaWidth * chromaHeight;
+	double frameBytes = lumaBytes + chromaBytes;
+	BenchPicture src(w, h, 32);
+	BenchPicture dst(w, h, 32);
+	// Rotated destination, its planes being height x width.
+	BenchPicture rotated(h, w, 32);
+	BenchPicture reference(w, h, 32);
+	BenchPicture rotatedReference(h, w, 32);
+	CacheMissCounter cacheMisses;
+
+	results.push_back(runBench("copyPlane", resolution, 2 * lumaBytes, minTimeMs, [&]() {
+		copyPlane(dst.planes[0], dst.strides[0], src.planes[0], src.strides[0], w, h);
+	}));
+	results.push_back(runBench("interleaveUVPlanes", resolution, 2 * chromaBytes, minTimeMs, [&]() {
+		interleaveUVPlanes(dst.uv, dst.uvStride, src.planes[1], src.strides[1], src.planes[2], src.strides[2], chromaWidth, chromaHeight);
+	}));
+	// The byte-per-byte loop of the display filters that interleaveUVRow replaced, and the kernel of each instruction set.
+	results.push_back(runBench("interleaveUVPlanes_loop", resolution, 2 * chromaBytes, minTimeMs, [&]() {
+		for (int y = 0; y < chromaHeight; y++) {
+			uint8_t *d = dst.uv + y * dst.uvStride;
+			const uint8_t *u = src.planes[1] + y * src.strides[1];
+			const uint8_t *v = src.planes[2] + y * src.strides[2];
+			for (int x = 0; x < chromaWidth; x++) {
+				d[2 * x] = u[x];
+				d[2 * x + 1] = v[x];
+			}
+		}
+	}));
+	VideoKernelsIsa detected = videoKernelsIsa();
+	static const VideoKernelsIsa kIsas[] = { VideoKernelsIsaScalar, VideoKernelsIsaSSE2, VideoKernelsIsaAVX2, VideoKernelsIsaNEON };
+	for (size_t i = 0; i < sizeof(kIsas) / sizeof(kIsas[0]); i++) {
+		if (!setVideoKernelsIsa(kIsas[i])) continue;
+		results.push_back(runBench(std::string("interleaveUVPlanes_") + videoKernelsIsaName(kIsas[i]), resolution, 2 * chromaBytes, minTimeMs, [&]() {
+			interleaveUVPlanes(dst.uv, dst.uvStride, src.planes[1], src.strides[1], src.planes[2], src.strides[2], chromaWidth, chromaHeight);
+		}));
+	}
+	setVideoKernelsIsa(detected);
+	results.push_back(runBench("convertI420ToNV12", resolution, 2 * frameBytes, minTimeMs, [&]() {
+		convertI420ToNV12(src.planes, src.strides, w, h, dst.planes[0], dst.strides[0], dst.uv, dst.uvStride);
+	}));
+	results.push_back(runBench("parallelConvertI420ToNV12", resolution, 2 * frameBytes, minTimeMs, [&]() {
+		parallelConvertI420ToNV12(src.planes, src.strides, w, h, dst.planes[0], dst.strides[0], dst.uv, dst.uvStride);
+	}));
+	// To be compared with convertI420ToNV12, the conversion they save when a frame is a duplicate.
+	results.push_back(runBench("fingerprintI420_full", resolution, frameBytes, minTimeMs, [&]() {
+		fingerprintI420(src.planes, src.strides, w, h, 1);
+	}));
+	results.push_back(runBench("fingerprintI420_sampled", resolution, frameBytes / 4, minTimeMs, [&]() {
+		fingerprintI420(src.planes, src.strides, w, h, 4);
+	}));
+	// The per-frame allocation of the display filter before it used the frame pool, against the pool itself.
+	size_t nv12Size = FramePool::frameSize(w, h, FramePool::FormatNV12);
+	results.push_back(runBench("mallocFrame", resolution, (double)nv12Size, minTimeMs, [&]() {
+		uint8_t *frame = (uint8_t *)malloc(nv12Size);
+		touchFrame(frame, nv12Size);
+		free(frame);
+	}));
+	FramePool framePool(FramePool::kDefaultMaxIdleBytes);
+	results.push_back(runBench("framePoolFrame", resolution, (double)nv12Size, minTimeMs, [&]() {
+		uint8_t *frame = framePool.acquire(w, h, FramePool::FormatNV12);
+		touchFrame(frame, nv12Size);
+		FramePool::release(frame);
+	}));
+	// A sample created and destroyed for each frame, against one taken from the pool and given back.
+	MockSampleBackend sampleBackend;
+	results.push_back(runBench("createSample", resolution, (double)nv12Size, minTimeMs, [&]() {
+		std::vector<uint8_t> *sample = sampleBackend.create(w, h);
+		touchFrame(&(*sample)[0], sample->size());
+		sampleBackend.destroy(sample);
+	}));
+	RecyclingPool<std::vector<uint8_t> > samplePool(&sampleBackend, 4);
+	results.push_back(runBench("recyclingPoolSample", resolution, (double)nv12Size, minTimeMs, [&]() {
+		std::vector<uint8_t> *sample = samplePool.acquire(w, h);
+		touchFrame(&(*sample)[0], sample->size());
+		samplePool.recycle(sample, w, h);
+	}));
+	for (int rotation = 0; rotation < 360; rotation += 90) {
+		BenchPicture &out = ((rotation % 180) == 90) ? rotated : dst;
+		char name[64];
+		snprintf(name, sizeof(name), "rotateNV12ToI420_%i", rotation);
+		results.push_back(runBench(name, resolution, 2 * frameBytes, minTimeMs, [&]() {
+			rotateNV12ToI420(src.planes[0], src.strides[0], src.uv, src.uvStride, w, h, out.planes, out.strides, rotation, false);
+		}));
+		// The mediastreamer2 loops the kernel replaced: both must give the same picture.
+		BenchPicture &expected = ((rotation % 180) == 90) ? rotatedReference : reference;
+		int outWidth = ((rotation % 180) == 90) ? h : w;
+		int outHeight = ((rotation % 180) == 90) ? w : h;
+		std::function<void()> kernel = [&]() {
+			rotateNV12ToI420(src.planes[0], src.strides[0], src.uv, src.uvStride, w, h, out.planes, out.strides, rotation, false);
+		};
+		std::function<void()> referenceKernel = [&]() {
+			referenceRotateNV12ToI420(src.planes[0], src.strides[0], src.uv, src.uvStride, w, h, expected.planes, expected.strides, rotation);
+		};
+		long long kernelMisses = cacheMisses.count(kernel);
+		long long referenceMisses = cacheMisses.count(referenceKernel);
+		results.back().extra = ", \"cache_misses\": " + formatCacheMisses(kernelMisses) + ", \"identical_to_reference\": "
+			+ (samePlanes(out, expected, outWidth, outHeight) ? "true" : "false");
+		snprintf(name, sizeof(name), "referenceRotateNV12ToI420_%i", rotation);
+		results.push_back(runBench(name, resolution, 2 * frameBytes, minTimeMs, referenceKernel));
+		results.back().extra = ", \"cache_misses\": " + formatCacheMisses(referenceMisses);
+		snprintf(name, sizeof(name), "parallelRotateNV12ToI420_%i", rotation);
+		results.push_back(runBench(name, resolution, 2 * frameBytes, minTimeMs, [&]() {
+			parallelRotateNV12ToI420(src.planes[0], src.strides[0], src.uv, src.uvStride, w, h, out.planes, out.strides, rotation, false);
+		}));
+	}
+}
+
+struct BenchScaling {
+	const char *name;
+	int srcWidth;
+	int srcHeight;
+	int dstWidth;
+	int dstHeight;
+};
+
+// The scalings of the capture filter when the camera does not offer the negotiated size, and an upscale.
+static const BenchScaling kScalings[] = {
+	{ "1080p_to_720p", 1920, 1080, 1280, 720 },
+	{ "720p_to_360p", 1280, 720, 640, 360 },
+	{ "720p_to_CIF", 1280, 720, 352, 288 },
+	{ "VGA_to_QVGA", 640, 480, 320, 240 },
+	{ "VGA_to_720p", 640, 480, 1280, 720 }
+};
+
+// Smooth picture of the plane p, a function of the position normalized to [0, 1] so that it describes the same
+// picture at any size. Its frequencies stay below half the sampling rate of the smallest destination.
+static double scalingPattern(int p, double x, double y)
+{
+	static const double kCycles[3][2] = { { 13, 7 }, { 5, 9 }, { 8, 3 } };
+	const double pi = 3.14159265358979323846;
+	return 128 + 70 * sin(2 * pi * kCycles[p][0] * x) * cos(2 * pi * kCycles[p][1] * y) + 40 * (x - y);
+}
+
+// Samples the pattern at the centers of the samples of a width x height plane, pixelStep samples apart.
+static void drawScalingPattern(uint8_t *dst, int dstStride, int width, int height, int pixelStep, int p)
+{
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			dst[y * dstStride + x * pixelStep] = (uint8_t)lround(scalingPattern(p, (x + 0.5) / width, (y + 0.5) / height));
+		}
+	}
+}
+
+// Peak signal-to-noise ratio of a plane against the pattern sampled at the destination size, in dB.
+static double scalingPsnr(const uint8_t *plane, int stride, int width, int height, int p)
+{
+	double squaredError = 0;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			double error = plane[y * stride + x] - scalingPattern(p, (x + 0.5) / width, (y + 0.5) / height);
+			squaredError += error * error;
+		}
+	}
+	double mse = squaredError / ((double)width * height);
+	return (mse > 0) ? 10 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+// Quality and throughput of the bilinear scaler of the capture filter. The source is a smooth pattern, so the ideal
+// scaled picture is the pattern sampled at the destination size: the PSNR against it measures the loss of the
+// scaler, the bilinear filter and its fixed-point arithmetic together. The throughput is given for each instruction
+// set, scalePlane being the luma half of scaleNV12ToI420.
+static void benchScaling(double minTimeMs, std::vector<BenchResult> &results)
+{
+	VideoKernelsIsa detected = videoKernelsIsa();
+	static const VideoKernelsIsa kIsas[] = { VideoKernelsIsaScalar, VideoKernelsIsaSSE2, VideoKernelsIsaAVX2, VideoKernelsIsaNEON };
+	for (size_t n = 0; n < sizeof(kScalings) / sizeof(kScalings[0]); n++) {
+		const BenchScaling &scaling = kScalings[n];
+		BenchPicture src(scaling.srcWidth, scaling.srcHeight, 32);
+		BenchPicture dst(scaling.dstWidth, scaling.dstHeight, 32);
+		int srcChromaWidth = (scaling.srcWidth + 1) / 2;
+		int srcChromaHeight = (scaling.srcHeight + 1) / 2;
+		int dstChromaWidth = (scaling.dstWidth + 1) / 2;
+		int dstChromaHeight = (scaling.dstHeight + 1) / 2;
+		drawScalingPattern(src.planes[0], src.strides[0], scaling.srcWidth, scaling.srcHeight, 1, 0);
+		drawScalingPattern(src.uv, src.uvStride, srcChromaWidth, srcChromaHeight, 2, 1);
+		drawScalingPattern(src.uv + 1, src.uvStride, srcChromaWidth, srcChromaHeight, 2, 2);
+		double lumaBytes = (double)scaling.srcWidth * scaling.srcHeight + (double)scaling.dstWidth * scaling.dstHeight;
+		double frameBytes = lumaBytes + 2.0 * srcChromaWidth * srcChromaHeight + 2.0 * dstChromaWidth * dstChromaHeight;
+
+		char extra[160];
+		scaleNV12ToI420(src.planes[0], src.strides[0], src.uv, src.uvStride, scaling.srcWidth, scaling.srcHeight,
+			dst.planes, dst.strides, scaling.dstWidth, scaling.dstHeight);
+		snprintf(extra, sizeof(extra), ", \"psnr_y_db\": %.2f, \"psnr_u_db\": %.2f, \"psnr_v_db\": %.2f",
+			scalingPsnr(dst.planes[0], dst.strides[0], scaling.dstWidth, scaling.dstHeight, 0),
+			scalingPsnr(dst.planes[1], dst.strides[1], dstChromaWidth, dstChromaHeight, 1),
+			scalingPsnr(dst.planes[2], dst.strides[2], dstChromaWidth, dstChromaHeight, 2));
+		std::string quality = extra;
+
+		for (size_t i = 0; i < sizeof(kIsas) / sizeof(kIsas[0]); i++) {
+			if (!setVideoKernelsIsa(kIsas[i])) continue;
+			BenchResult result = runBench(std::string("scalePlane_") + scaling.name + "_" + videoKernelsIsaName(kIsas[i]), NULL, lumaBytes, minTimeMs, [&]() {
+				scalePlane(dst.planes[0], dst.strides[0], scaling.dstWidth, scaling.dstHeight, src.planes[0], src.strides[0], scaling.srcWidth, scaling.srcHeight, 1);
+			});
+			snprintf(extra, sizeof(extra), ", \"gb_per_s\": %.3f", result.gbPerSecond);
+			result.extra = extra;
+			results.push_back(result);
+			result = runBench(std::string("scaleNV12ToI420_") + scaling.name + "_" + videoKernelsIsaName(kIsas[i]), NULL, frameBytes, minTimeMs, [&]() {
+				scaleNV12ToI420(src.planes[0], src.strides[0], src.uv, src.uvStride, scaling.srcWidth, scaling.srcHeight,
+					dst.planes, dst.strides, scaling.dstWidth, scaling.dstHeight);
+			});
+			snprintf(extra, sizeof(extra), ", \"gb_per_s\": %.3f", result.gbPerSecond);
+			result.extra = extra + quality;
+			results.push_back(result);
+		}
+		setVideoKernelsIsa(detected);
+	}
+}
+
+// Fills the queue up to depth then empties it, as the media sink does with the samples waiting for the work queue.
+// The time is given per sample queued and dequeued.
+static void benchQueues(double minTimeMs, std::vector<BenchResult> &results)
+{
+	static const int kDepths[] = { 1, 4, 16 };
+	static int items[16];
+	for (size_t d = 0; d < sizeof(kDepths) / sizeof(kDepths[0]); d++) {
+		int depth = kDepths[d];
+		char name[64];
+		List<int *> list;
+		snprintf(name, sizeof(name), "linkListQueue_depth%i", depth);
+		BenchResult result = runBench(name, NULL, 0, minTimeMs, [&]() {
+			int *item;
+			for (int i = 0; i < depth; i++) list.InsertBack(&items[i]);
+			for (int i = 0; i < depth; i++) list.RemoveFront(&item);
+		});
+		result.nsPerFrame /= depth;
+		results.push_back(result);
+		RingBuffer<int *> ring(16, RingOverflowGrow);
+		snprintf(name, sizeof(name), "ringBufferQueue_depth%i", depth);
+		result = runBench(name, NULL, 0, minTimeMs, [&]() {
+			int *item;
+			for (int i = 0; i < depth; i++) ring.insertBack(&items[i]);
+			for (int i = 0; i < depth; i++) ring.removeFront(&item);
+		});
+		result.nsPerFrame /= depth;
+		results.push_back(result);
+	}
+}
+
+// Stress of the media sink work queue: 10000 samples are queued while the work queue runs the posted items with a random
+// delay. Before, each sample posted its own newly allocated operation. Now the operations are preallocated, nothing is
+// allocated per sample, and a single OpProcessSample is pending at a time: work_items counts the items actually posted.
+// requested_samples must match samples, each sample still leads to a request for the next one. The queue lives as long
+// as the sink: allocations counts the allocations of the last 10000 samples, once the queue has reached its capacity.
+static void benchSinkWorkQueue(double minTimeMs, std::vector<BenchResult> &results)
+{
+	static const int kSamples = 10000;
+	unsigned long posts = 0;
+	unsigned long requestedSamples = 0;
+	unsigned long allocations = 0;
+	WorkItemCoalescer coalescer;
+	RingBuffer<int> workQueue(4, RingOverflowGrow);
+	BenchResult result = runBench("sinkWorkQueue_10k", NULL, 0, minTimeMs, [&]() {
+		unsigned long allocationsBefore = sAllocations;
+		unsigned long postsBefore = coalescer.getPosts();
+		requestedSamples = 0;
+		for (int i = 0; i < kSamples; i++) {
+			if (coalescer.request()) workQueue.insertBack(i);
+			// The work queue thread gets to run after one to three samples.
+			if ((rand() % 3) == 0) {
+				while (workQueue.removeFront(NULL)) requestedSamples += coalescer.take();
+			}
+		}
+		while (workQueue.removeFront(NULL)) requestedSamples += coalescer.take();
+		posts = coalescer.getPosts() - postsBefore;
+		allocations = sAllocations - allocationsBefore;
+	});
+	result.nsPerFrame /= kSamples;
+	char extra[200];
+	snprintf(extra, sizeof(extra), ", \"samples\": %i, \"work_items\": %lu, \"requested_samples\": %lu, \"allocations\": %lu",
+		kSamples, posts, requestedSamples, allocations);
+	result.extra = extra;
+	results.push_back(result);
+}
+
+// Mock of the camera buffers lent downstream: counts its references and locks.
+struct MockCameraBuffer {
+	int refs;
+	int locks;
+	uint8_t data[64];
+};
+
+static const BorrowedBufferOps kMockCameraBufferOps = {
+	[](void *buffer) { static_cast<MockCameraBuffer *>(buffer)->refs++; },
+	[](void *buffer) { static_cast<MockCameraBuffer *>(buffer)->refs--; },
+	[](void *buffer, uint8_t **data, size_t *length) {
+		MockCameraBuffer *mock = static_cast<MockCameraBuffer *>(buffer);
+		mock->locks++;
+		*data = mock->data;
+		*length = sizeof(mock->data);
+		return true;
+	},
+	[](void *buffer) { static_cast<MockCameraBuffer *>(buffer)->locks--; }
+};
+
+// Cost of lending a camera buffer and giving it back, the zero-copy path replacing the copy of the frame.
+// A third frame is refused while two are lent; the references and locks must be back to their initial values.
+static void benchBufferLender(double minTimeMs, std::vector<BenchResult> &results)
+{
+	BufferLender lender(2);
+	MockCameraBuffer buffers[3] = {};
+	int refused = 0;
+	BenchResult result = runBench("bufferLender", NULL, 0, minTimeMs, [&]() {
+		size_t length;
+		uint8_t *first = lender.lend(&buffers[0], &kMockCameraBufferOps, &length);
+		uint8_t *second = lender.lend(&buffers[1], &kMockCameraBufferOps, &length);
+		if (lender.lend(&buffers[2], &kMockCameraBufferOps, &length) == NULL) refused++;
+		lender.giveBack(first);
+		lender.giveBack(second);
+	});
+	result.nsPerFrame /= 2;
+	bool balanced = true;
+	for (int i = 0; i < 3; i++) {
+		if ((buffers[i].refs != 0) || (buffers[i].locks != 0)) balanced = false;
+	}
+	char extra[128];
+	snprintf(extra, sizeof(extra), ", \"refused_over_cap\": %s, \"balanced\": %s",
+		(refused == result.iterations + 1) ? "true" : "false", balanced ? "true" : "false");
+	result.extra = extra;
+	results.push_back(result);
+}
+
+// Queue of captured frames as it was before the lock-free one: a mutex around a bounded ring.
+class MutexFrameQueue {
+public:
+	MutexFrameQueue(size_t capacity) : mRing(capacity, RingOverflowReject) {}
+
+	bool push(uint64_t item)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mRing.insertBack(item) != RingBuffer<uint64_t>::Rejected;
+	}
+
+	template <typename FN> size_t drain(FN func)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		size_t count = 0;
+		uint64_t item;
+		while (mRing.removeFront(&item)) {
+			func(item);
+			count++;
+		}
+		return count;
+	}
+
+private:
+	std::mutex mMutex;
+	RingBuffer<uint64_t> mRing;
+};
+
+static uint64_t nowNs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double percentile(std::vector<uint64_t> &values, double p)
+{
+	if (values.empty()) return 0;
+	size_t index = (size_t)(p * (values.size() - 1));
+	std::nth_element(values.begin(), values.begin() + index, values.end());
+	return (double)values[index];
+}
+
+// Contention between the capture thread pushing frames and the ticker draining them, with a queue of 8 frames as in
+// the capture filter. The producer retries when the queue is full so that every frame gets through. Reports the
+// percentiles of the time spent in each push and in each non-empty drain, and of the time frames wait in the queue.
+template <typename Q> static void benchCaptureQueue(const char *name, std::vector<BenchResult> &results)
+{
+	static const int kFrames = 100000;
+	static const size_t kCapacity = 8;
+	Q queue(kCapacity);
+	std::vector<uint64_t> pushNs, drainNs, waitNs;
+	pushNs.reserve(kFrames);
+	drainNs.reserve(kFrames);
+	waitNs.reserve(kFrames);
+
+	uint64_t start = nowNs();
+	std::thread producer([&]() {
+		for (int i = 0; i < kFrames; i++) {
+			uint64_t before = nowNs();
+			while (!queue.push(before)) {
+				std::this_thread::yield();
+				before = nowNs();
+			}
+			pushNs.push_back(nowNs() - before);
+		}
+	});
+	size_t received = 0;
+	while (received < (size_t)kFrames) {
+		uint64_t before = nowNs();
+		size_t count = queue.drain([&](uint64_t pushed) { waitNs.push_back(before - std::min(before, pushed)); });
+		if (count == 0) {
+			std::this_thread::yield();
+			continue;
+		}
+		drainNs.push_back(nowNs() - before);
+		received += count;
+	}
+	producer.join();
+
+	BenchResult result;
+	result.kernel = name;
+	result.resolution = NULL;
+	result.iterations = 1;
+	result.nsPerFrame = (double)(nowNs() - start) / kFrames;
+	result.gbPerSecond = 0;
+	char extra[256];
+	snprintf(extra, sizeof(extra), ", \"push_p50_ns\": %.0f, \"push_p99_ns\": %.0f, \"drain_p50_ns\": %.0f, \"drain_p99_ns\": %.0f, \"wait_p50_ns\": %.0f, \"wait_p99_ns\": %.0f",
+		percentile(pushNs, 0.5), percentile(pushNs, 0.99), percentile(drainNs, 0.5), percentile(drainNs, 0.99),
+		percentile(waitNs, 0.5), percentile(waitNs, 0.99));
+	result.extra = extra;
+	results.push_back(result);
+}
+
+// Capture queue of depth 8 whose consumer sleeps for 20ms every 1000 frames while a producer thread pushes frames.
+// Reports the frames received and dropped and the largest batch drained; stalledCaptureQueue of mswinrtvid_test checks
+// that each frame is either received, in order, or evicted.
+static void benchStalledCaptureQueue(std::vector<BenchResult> &results)
+{
+	static const int kFrames = 20000;
+	static const size_t kDepth = 8;
+	SpscQueue<uint64_t> queue(32);
+	queue.setLimit(kDepth);
+
+	std::atomic<unsigned int> evictions(0);
+	std::atomic<bool> producing(true);
+	uint64_t start = nowNs();
+	std::thread producer([&]() {
+		uint64_t oldest;
+		for (int i = 0; i < kFrames; i++) {
+			if (queue.pushEvictingOldest(i, &oldest)) evictions++;
+			if ((i % 16) == 0) std::this_thread::yield();
+		}
+		producing = false;
+	});
+	unsigned int received = 0;
+	size_t maxBatch = 0;
+	for (;;) {
+		bool done = !producing;
+		size_t count = queue.drain([&](uint64_t) {
+			if ((received++ % 1000) == 999) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		});
+		if (count > maxBatch) maxBatch = count;
+		if (done && (count == 0)) break;
+		std::this_thread::yield();
+	}
+	producer.join();
+
+	BenchResult result;
+	result.kernel = "stalledCaptureQueue";
+	result.resolution = NULL;
+	result.iterations = 1;
+	result.nsPerFrame = (double)(nowNs() - start) / kFrames;
+	result.gbPerSecond = 0;
+	char extra[256];
+	snprintf(extra, sizeof(extra), ", \"received\": %u, \"dropped\": %u, \"max_batch\": %u",
+		received, evictions.load(), (unsigned int)maxBatch);
+	result.extra = extra;
+	results.push_back(result);
+}
+
+// Replays 30fps capture timings in which the camera delivers frames in bursts of up to 4 frames, through a 10ms ticker
+// feeding the frames as MSWinRTCap::feed does: either all the frames delivered since the previous frame-rate controller
+// tick, or at most one per frame interval with the pacer. Reports the jitter of the output inter-frame intervals and
+// the latency between capture and output.
+static void benchCapturePacing(bool paced, std::vector<BenchResult> &results)
+{
+	static const int kFrames = 3000;
+	static const double kFps = 30;
+	static const uint64_t kTickMs = 10;
+	const double interval = 1000.0 / kFps;
+
+	// Delivery times: most frames arrive 5ms after being captured, some are held back and delivered with the next ones.
+	std::vector<uint64_t> captureTimes(kFrames), deliveryTimes(kFrames);
+	uint32_t seed = 1;
+	uint64_t heldUntil = 0;
+	for (int i = 0; i < kFrames; i++) {
+		captureTimes[i] = (uint64_t)(i * interval);
+		seed = seed * 1103515245 + 12345;
+		if (((seed >> 16) % 10) == 0) heldUntil = captureTimes[i] + (uint64_t)(interval * (1 + (seed >> 8) % 3));
+		deliveryTimes[i] = std::max(captureTimes[i] + 5, heldUntil);
+	}
+
+	FramePacer pacer;
+	pacer.setFps((float)kFps);
+	std::vector<uint64_t> pending, outputTimes, latencies;
+	uint64_t controllerStart = 0;
+	unsigned int controllerTicks = 0;
+	int delivered = 0;
+	uint64_t end = deliveryTimes[kFrames - 1] + 1000;
+	uint64_t start = nowNs();
+	for (uint64_t now = 0; now < end; now += kTickMs) {
+		while ((delivered < kFrames) && (deliveryTimes[delivered] <= now)) pending.push_back(captureTimes[delivered++]);
+		if (paced) {
+			size_t stale = 0;
+			bool release = pending.empty() ? false : pacer.select(now, &pending[0], pending.size(), &stale);
+			pending.erase(pending.begin(), pending.begin() + stale);
+			if (release) {
+				outputTimes.push_back(now);
+				latencies.push_back(now - pending.front());
+				pending.erase(pending.begin());
+			}
+		} else if (((now - controllerStart) * kFps / 1000.0) >= controllerTicks) {
+			// Same as the frame-rate controller of mediastreamer2.
+			controllerTicks++;
+			for (size_t i = 0; i < pending.size(); i++) {
+				outputTimes.push_back(now);
+				latencies.push_back(now - pending[i]);
+			}
+			pending.clear();
+		}
+	}
+	double elapsedNs = (double)(nowNs() - start);
+
+	std::vector<uint64_t> deviations;
+	double sum = 0, sumSquares = 0;
+	for (size_t i = 1; i < outputTimes.size(); i++) {
+		double delta = (double)(outputTimes[i] - outputTimes[i - 1]);
+		sum += delta;
+		sumSquares += delta * delta;
+		deviations.push_back((uint64_t)std::abs(delta - interval));
+	}
+	double count = (double)deviations.size();
+	double mean = sum / count;
+	double stddev = std::sqrt(std::max(0.0, (sumSquares / count) - (mean * mean)));
+	double latencySum = 0;
+	for (size_t i = 0; i < latencies.size(); i++) latencySum += (double)latencies[i];
+
+	BenchResult result;
+	result.kernel = paced ? "pacedCapture" : "unpacedCapture";
+	result.resolution = NULL;
+	result.iterations = 1;
+	result.nsPerFrame = elapsedNs / kFrames;
+	result.gbPerSecond = 0;
+	char extra[256];
+	snprintf(extra, sizeof(extra), ", \"frames_in\": %i, \"frames_out\": %u, \"interval_stddev_ms\": %.1f, \"interval_p99_deviation_ms\": %.0f, \"mean_latency_ms\": %.1f, \"p99_latency_ms\": %.0f",
+		kFrames, (unsigned int)outputTimes.size(), stddev, percentile(deviations, 0.99), latencySum / latencies.size(), percentile(latencies, 0.99));
+	result.extra = extra;
+	results.push_back(result);
+}
+
+// The display filters before the frame mailbox: the latest frame and the deferred requests under a mutex, held while
+// the frame is converted for a request.
+class MutexFrameMailbox {
+public:
+	MutexFrameMailbox() : mFrame(0) {}
+
+	template <typename FN> void publish(uint64_t frame, FN answer)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mFrame = frame;
+		if (!mDeferrals.empty()) {
+			int request = mDeferrals.front();
+			mDeferrals.erase(mDeferrals.begin());
+			answer(request, mFrame);
+			mFrame = 0;
+		}
+	}
+
+	template <typename FN> void request(int request, FN answer)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mFrame == 0) {
+			mDeferrals.push_back(request);
+		} else {
+			answer(request, mFrame);
+			mFrame = 0;
+		}
+	}
+
+private:
+	std::mutex mMutex;
+	uint64_t mFrame;
+	std::vector<int> mDeferrals;
+};
+
+// Same interface over FrameMailbox, the frames are converted without any lock.
+class LockFreeFrameMailbox {
+public:
+	template <typename FN> void publish(uint64_t frame, FN answer)
+	{
+		int request = 0;
+		uint64_t requestFrame = 0;
+		if (mMailbox.publish(frame, &request, &requestFrame)) answer(request, requestFrame);
+	}
+
+	template <typename FN> void request(int request, FN answer)
+	{
+		uint64_t frame = 0;
+		if (mMailbox.take(&frame) || mMailbox.request(request, &frame)) answer(request, frame);
+	}
+
+private:
+	FrameMailbox<uint64_t, int> mMailbox;
+};
+
+// The ticker publishes 20000 frames while the Media Foundation thread requests them one at a time, each answer copying a
+// 640x480 NV12 frame as the conversion does. The display is slower than the ticker: a request is made once two frames
+// have been published since the previous one was answered, so most requests find a frame and are answered by the Media
+// Foundation thread. Reports the percentiles of the time spent by the ticker publishing a frame, and checks that the
+// requests are answered with newer and newer frames.
+template <typename M> static void benchFrameMailbox(const char *name, std::vector<BenchResult> &results)
+{
+	static const int kFrames = 20000;
+	static const size_t kFrameSize = 640 * 480 * 3 / 2;
+	M mailbox;
+	std::vector<uint8_t> source(kFrameSize, 0x80), destination(kFrameSize);
+	std::atomic<int> answered(0);
+	std::atomic<int> published(0);
+	std::atomic<bool> producing(true);
+	uint64_t lastFrame = 0;
+	bool inOrder = true;
+	auto answer = [&](int request, uint64_t frame) {
+		memcpy(&destination[0], &source[0], kFrameSize);
+		if (frame <= lastFrame) inOrder = false;
+		lastFrame = frame;
+		answered.store(request);
+	};
+
+	std::vector<uint64_t> publishNs;
+	publishNs.reserve(kFrames);
+	uint64_t start = nowNs();
+	std::thread producer([&]() {
+		for (int i = 1; i <= kFrames; i++) {
+			uint64_t before = nowNs();
+			mailbox.publish(i, answer);
+			publishNs.push_back(nowNs() - before);
+			published.store(i);
+			std::this_thread::yield();
+		}
+		producing = false;
+	});
+	int requests = 0;
+	int publishedAtAnswer = 0;
+	while (producing) {
+		if ((answered.load() != requests) || (published.load() < (publishedAtAnswer + 2))) {
+			std::this_thread::yield();
+			continue;
+		}
+		mailbox.request(++requests, answer);
+		publishedAtAnswer = published.load();
+	}
+	producer.join();
+
+	BenchResult result;
+	result.kernel = name;
+	result.resolution = NULL;
+	result.iterations = 1;
+	result.nsPerFrame = (double)(nowNs() - start) / kFrames;
+	result.gbPerSecond = 0;
+	char extra[256];
+	snprintf(extra, sizeof(extra), ", \"publish_p50_ns\": %.0f, \"publish_p99_ns\": %.0f, \"publish_max_ns\": %.0f, \"requests\": %i, \"requests_answered\": %i, \"in_order\": %s",
+		percentile(publishNs, 0.5), percentile(publishNs, 0.99), percentile(publishNs, 1.0), requests, answered.load(), inOrder ? "true" : "false");
+	result.extra = extra;
+	results.push_back(result);
+}
+
+// Replays the presentation times of a camera running at sourceFps, with 1ms of jitter, decimated to targetFps either by
+// the frame-rate control of the ticker (10ms ticks, frames delivered 5ms after capture, the latest one being sent) or by
+// FrameDecimator before the frames are copied. Each copied frame costs a 640x480 NV12 copy. Reports the output frame rate,
+// the spacing of the output presentation times and the processing time per delivered frame.
+static void benchFrameDecimation(double sourceFps, double targetFps, bool decimated, std::vector<BenchResult> &results)
+{
+	static const int kSeconds = 20;
+	static const int64_t kUnitsPerMs = 10000;
+	static const int64_t kTickUnits = 10 * kUnitsPerMs;
+	static const int kWidth = 640;
+	static const int kHeight = 480;
+	int frames = (int)(sourceFps * kSeconds);
+	std::vector<int64_t> times(frames);
+	uint32_t seed = 1;
+	for (int i = 0; i < frames; i++) {
+		seed = seed * 1103515245 + 12345;
+		times[i] = (int64_t)(i * 10000000.0 / sourceFps) + (int64_t)((seed >> 16) % (2 * kUnitsPerMs)) - kUnitsPerMs;
+	}
+
+	BenchPicture camera(kWidth, kHeight, 0);
+	FramePool *pool = FramePool::get();
+	FramePool::release(pool->acquire(kWidth, kHeight, FramePool::FormatNV12));
+	auto copyFrame = [&]() {
+		uint8_t *frame = pool->acquire(kWidth, kHeight, FramePool::FormatNV12);
+		copyPlane(frame, kWidth, camera.planes[0], kWidth, kWidth, kHeight);
+		copyPlane(frame + kWidth * kHeight, kWidth, camera.uv, kWidth, kWidth, kHeight / 2);
+		return frame;
+	};
+
+	std::vector<int64_t> output;
+	uint64_t start = nowNs();
+	if (decimated) {
+		FrameDecimator decimator;
+		decimator.setFps(targetFps);
+		for (int i = 0; i < frames; i++) {
+			if (!decimator.accept(times[i])) continue;
+			FramePool::release(copyFrame());
+			output.push_back(times[i]);
+		}
+	} else {
+		uint8_t *latest = NULL;
+		int64_t latestTime = 0;
+		unsigned int controllerTicks = 0;
+		int delivered = 0;
+		for (int64_t now = 0; delivered < frames; now += kTickUnits) {
+			while ((delivered < frames) && ((times[delivered] + 5 * kUnitsPerMs) <= now)) {
+				if (latest != NULL) FramePool::release(latest);
+				latest = copyFrame();
+				latestTime = times[delivered++];
+			}
+			// Same as the frame-rate controller of mediastreamer2.
+			if (((now / kUnitsPerMs) * targetFps / 1000.0) >= controllerTicks) {
+				controllerTicks++;
+				if (latest != NULL) {
+					FramePool::release(latest);
+					latest = NULL;
+					output.push_back(latestTime);
+				}
+			}
+		}
+		if (latest != NULL) FramePool::release(latest);
+	}
+	double elapsedNs = (double)(nowNs() - start);
+
+	double interval = 10000000.0 / targetFps;
+	double sum = 0, sumSquares = 0;
+	std::vector<uint64_t> deviations;
+	for (size_t i = 1; i < output.size(); i++) {
+		double delta = (double)(output[i] - output[i - 1]);
+		sum += delta;
+		sumSquares += delta * delta;
+		deviations.push_back((uint64_t)std::abs(delta - interval));
+	}
+	double count = (double)deviations.size();
+	double mean = sum / count;
+	double stddev = std::sqrt(std::max(0.0, (sumSquares / count) - (mean * mean)));
+
+	BenchResult result;
+	char name[64];
+	snprintf(name, sizeof(name), "%s_%gto%gfps", decimated ? "frameDecimator" : "tickerFrameRateControl", sourceFps, targetFps);
+	result.kernel = name;
+	result.resolution = NULL;
+	result.iterations = frames;
+	result.nsPerFrame = elapsedNs / output.size();
+	result.gbPerSecond = 0;
+	char extra[256];
+	snprintf(extra, sizeof(extra), ", \"output_fps\": %.2f, \"interval_mean_ms\": %.2f, \"interval_stddev_ms\": %.2f, \"interval_max_deviation_ms\": %.1f, \"copies\": %i",
+		(double)output.size() / kSeconds, mean / kUnitsPerMs, stddev / kUnitsPerMs, percentile(deviations, 1.0) / kUnitsPerMs,
+		decimated ? (int)output.size() : frames);
+	result.extra = extra;
+	results.push_back(result);
+}
+
+// A 640x480 camera rotated by 90 degrees, running at cameraFps while the filter sends 15 frames per second with the
+// queue policy keeping the latest frame. Eagerly, each camera frame is rotated to I420 when it is captured, as the capture
+// filter did; lazily, it is copied to a pooled NV12 buffer and only the frames that are sent are rotated. Reports the
+// processing time per second of capture.
+static void benchLazyCaptureConversion(int cameraFps, bool lazy, std::vector<BenchResult> &results)
+{
+	static const int kTargetFps = 15;
+	static const int kSeconds = 4;
+	static const int kWidth = 640;
+	static const int kHeight = 480;
+	BenchPicture camera(kWidth, kHeight, 0);
+	BenchPicture rotated(kHeight, kWidth, 0);
+	FramePool *pool = FramePool::get();
+	// Warm up the pool, it holds the raw frames once the capture runs.
+	FramePool::release(pool->acquire(kWidth, kHeight, FramePool::FormatNV12));
+	FramePool::release(pool->acquire(kWidth, kHeight, FramePool::FormatNV12));
+	uint8_t *latest = NULL;
+	int frames = cameraFps * kSeconds;
+	int sent = 0;
+	int conversions = 0;
+	uint64_t start = nowNs();
+	for (int i = 0; i < frames; i++) {
+		if (lazy) {
+			uint8_t *raw = pool->acquire(kWidth, kHeight, FramePool::FormatNV12);
+			copyPlane(raw, kWidth, camera.planes[0], kWidth, kWidth, kHeight);
+			copyPlane(raw + kWidth * kHeight, kWidth, camera.uv, kWidth, kWidth, kHeight / 2);
+			if (latest != NULL) FramePool::release(latest);
+			latest = raw;
+		} else {
+			rotateNV12ToI420(camera.planes[0], kWidth, camera.uv, kWidth, kWidth, kHeight, rotated.planes, rotated.strides, 90, false);
+			conversions++;
+		}
+		// The frame-rate control of the ticker.
+		if ((((i + 1) * kTargetFps) / cameraFps) > sent) {
+			sent++;
+			if (lazy) {
+				rotateNV12ToI420(latest, kWidth, latest + kWidth * kHeight, kWidth, kWidth, kHeight, rotated.planes, rotated.strides, 90, false);
+				conversions++;
+				FramePool::release(latest);
+				latest = NULL;
+			}
+		}
+	}
+	if (latest != NULL) FramePool::release(latest);
+	double elapsedNs = (double)(nowNs() - start);
+
+	BenchResult result;
+	char name[64];
+	snprintf(name, sizeof(name), "%sCaptureConversion_%ifps", lazy ? "lazy" : "eager", cameraFps);
+	result.kernel = name;
+	result.resolution = NULL;
+	result.iterations = frames;
+	result.nsPerFrame = elapsedNs / frames;
+	result.gbPerSecond = 0;
+	char extra[256];
+	snprintf(extra, sizeof(extra), ", \"frames_sent\": %i, \"conversions\": %i, \"cpu_ms_per_capture_second\": %.2f",
+		sent, conversions, elapsedNs / 1e6 / kSeconds);
+	result.extra = extra;
+	results.push_back(result);
+}
+
+// A 60 fps feed whose samples are requested with 2ms of jitter, stamped as the display filters did with GetTickCount64()
+// (simulated with its 15.625ms resolution), with PresentationClock from the request times only, and with PresentationClock
+// following the 90kHz timestamps of the frames, which wrap around during the run. Reports the error of the sample
+// durations against the frame interval, and checks that the sample times are increasing.
+static void benchPresentationClock(const char *name, bool tickCount, bool timestamps, std::vector<BenchResult> &results)
+{
+	static const int kFrames = 6000;
+	static const int64_t kInterval = PresentationClock::kUnitsPerSecond / 60;
+	static const int64_t kTickCountResolution = 156250;
+	static const int64_t kJitter = 20000;
+	PresentationClock clock;
+	int64_t previousNow = 0;
+	int64_t previousTime = -1;
+	bool increasing = true;
+	std::vector<uint64_t> errors;
+	uint32_t seed = 1;
+	uint64_t start = nowNs();
+	for (int i = 0; i < kFrames; i++) {
+		seed = seed * 1103515245 + 12345;
+		int64_t now = 10000000 + i * kInterval + (int64_t)((seed >> 16) % (2 * kJitter)) - kJitter;
+		uint32_t timestamp = timestamps ? (uint32_t)(0xFFF00000u + (uint32_t)i * 1500u) : 0;
+		int64_t time;
+		int64_t duration;
+		if (tickCount) {
+			now -= now % kTickCountResolution;
+			time = now;
+			duration = (i == 0) ? (PresentationClock::kUnitsPerSecond / 30) : (now - previousNow);
+			previousNow = now;
+		} else {
+			clock.stamp(now, timestamp, &time, &duration);
+		}
+		if (time <= previousTime) increasing = false;
+		previousTime = time;
+		if (i > 0) errors.push_back((uint64_t)std::abs(duration - kInterval));
+	}
+	double elapsedNs = (double)(nowNs() - start);
+	double errorSum = 0;
+	for (size_t i = 0; i < errors.size(); i++) errorSum += (double)errors[i];
+
+	BenchResult result;
+	result.kernel = name;
+	result.resolution = NULL;
+	result.iterations = kFrames;
+	result.nsPerFrame = elapsedNs / kFrames;
+	result.gbPerSecond = 0;
+	char extra[256];
+	snprintf(extra, sizeof(extra), ", \"duration_mean_error_ms\": %.3f, \"duration_p99_error_ms\": %.3f, \"duration_max_error_ms\": %.3f, \"increasing\": %s",
+		errorSum / errors.size() / 10000.0, percentile(errors, 0.99) / 10000.0, percentile(errors, 1.0) / 10000.0, increasing ? "true" : "false");
+	result.extra = extra;
+	results.push_back(result);
+}
+
+// A 720p stream decoded at 60 fps shown by a MediaElement requesting 30 samples per second, the frames going through a
+// FrameMailbox. Eagerly, each frame is converted to NV12 when it is published, as the display filter did; lazily, only
+// the frames taken by a request are. Reports the conversions and the processing time per displayed frame.
+static void benchLazyDisplayConversion(bool lazy, std::vector<BenchResult> &results)
+{
+	static const int kSeconds = 2;
+	static const int kInputFps = 60;
+	static const int kDisplayFps = 30;
+	static const int kWidth = 1280;
+	static const int kHeight = 720;
+	BenchPicture picture(kWidth, kHeight, 32);
+	std::vector<uint8_t> nv12(FramePool::frameSize(kWidth, kHeight, FramePool::FormatNV12));
+	auto convert = [&]() {
+		convertI420ToNV12(picture.planes, picture.strides, kWidth, kHeight, &nv12[0], kWidth, &nv12[kWidth * kHeight], kWidth);
+	};
+
+	FrameMailbox<uint64_t, int> mailbox;
+	int published = 0;
+	int displayed = 0;
+	int conversions = 0;
+	uint64_t start = nowNs();
+	for (int ms = 0; ms < kSeconds * 1000; ms++) {
+		if ((ms * kInputFps / 1000) >= published) {
+			if (!lazy) {
+				convert();
+				conversions++;
+			}
+			int request = 0;
+			uint64_t frame = 0;
+			mailbox.publish(++published, &request, &frame);
+		}
+		if ((ms * kDisplayFps / 1000) >= displayed) {
+			uint64_t frame = 0;
+			if (mailbox.take(&frame)) {
+				if (lazy) {
+					convert();
+					conversions++;
+				}
+				displayed++;
+			}
+		}
+	}
+	double elapsedNs = (double)(nowNs() - start);
+
+	BenchResult result;
+	result.kernel = lazy ? "lazyDisplayConversion" : "eagerDisplayConversion";
+	result.resolution = NULL;
+	result.iterations = published;
+	result.nsPerFrame = elapsedNs / displayed;
+	result.gbPerSecond = 0;
+	char extra[256];
+	snprintf(extra, sizeof(extra), ", \"frames_in\": %i, \"frames_displayed\": %i, \"superseded\": %llu, \"conversions\": %i",
+		published, displayed, (unsigned long long)mailbox.getStats().overwritten, conversions);
+	result.extra = extra;
+	results.push_back(result);
+}
+
+// Simulates display filters attached to one ticker, each converting a 720p I420 frame to NV12 at every 10ms tick, either
+// inline as the display filter does by default or through a ConversionPipeline. Reports the percentiles of the time spent
+// by the ticker in a tick, the ticks over budget, and the overruns of the pipelines. Without workers (a single processor
+// or --threads 1) the posted conversions run inline and the two modes are equivalent.
+static void benchDisplayTicker(int displays, bool pipelined, std::vector<BenchResult> &results)
+{
+	static const int kTicks = 100;
+	static const uint64_t kTickNs = 10000000;
+	static const int kWidth = 1280;
+	static const int kHeight = 720;
+	VideoWorkerPool *pool = VideoWorkerPool::get();
+	pool->retain();
+	VideoWorkerPool::TaskStats statsBefore = pool->getTaskStats();
+	std::vector<std::unique_ptr<BenchPicture> > pictures;
+	std::vector<std::unique_ptr<ConversionPipeline> > pipelines;
+	for (int i = 0; i < displays; i++) {
+		pictures.push_back(std::unique_ptr<BenchPicture>(new BenchPicture(kWidth, kHeight, 32)));
+		pipelines.push_back(std::unique_ptr<ConversionPipeline>(new ConversionPipeline()));
+	}
+
+	std::vector<uint64_t> tickNs;
+	tickNs.reserve(kTicks);
+	int overBudget = 0;
+	uint64_t start = nowNs();
+	for (int tick = 0; tick < kTicks; tick++) {
+		uint64_t before = nowNs();
+		for (int i = 0; i < displays; i++) {
+			BenchPicture *picture = pictures[i].get();
+			auto convert = [picture]() {
+				parallelConvertI420ToNV12(picture->planes, picture->strides, kWidth, kHeight, picture->planes[0], picture->strides[0], picture->uv, picture->uvStride);
+			};
+			if (pipelined) {
+				pipelines[i]->collect();
+				pipelines[i]->submit(convert);
+			} else {
+				convert();
+			}
+		}
+		uint64_t elapsed = nowNs() - before;
+		tickNs.push_back(elapsed);
+		if (elapsed > kTickNs) overBudget++;
+		uint64_t deadline = start + (tick + 1) * kTickNs;
+		uint64_t now = nowNs();
+		if (now < deadline) std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now));
+	}
+	uint64_t overruns = 0;
+	for (int i = 0; i < displays; i++) {
+		pipelines[i]->collect();
+		overruns += pipelines[i]->getStats().overruns;
+	}
+	VideoWorkerPool::TaskStats statsAfter = pool->getTaskStats();
+	pool->release();
+
+	BenchResult result;
+	char name[64];
+	snprintf(name, sizeof(name), "%sDisplayTicker_%i", pipelined ? "pipelined" : "inline", displays);
+	result.kernel = name;
+	result.resolution = NULL;
+	result.iterations = kTicks;
+	result.nsPerFrame = percentile(tickNs, 0.5) / displays;
+	result.gbPerSecond = 0;
+	char extra[256];
+	snprintf(extra, sizeof(extra), ", \"tick_p50_ms\": %.2f, \"tick_p99_ms\": %.2f, \"ticks_over_budget\": %i, \"overruns\": %llu, \"tasks_ran_inline\": %llu, \"max_queue_depth\": %u",
+		percentile(tickNs, 0.5) / 1e6, percentile(tickNs, 0.99) / 1e6, overBudget, (unsigned long long)overruns,
+		(unsigned long long)(statsAfter.ranInline - statsBefore.ranInline), (unsigned int)statsAfter.maxQueueDepth);
+	result.extra = extra;
+	results.push_back(result);
+}
+
+// Durations spread from 1us to 1s on a logarithmic scale, recorded in a LatencyHistogram by 1 or more threads at the same
+// time. Reports the cost of a record and the error of the percentiles of the histogram against the exact ones, which
+// must be under 1/16 (6.25%), and checks that no record is lost.
+static void benchLatencyHistogram(int threads, std::vector<BenchResult> &results)
+{
+	static const int kValues = 400000;
+	std::vector<uint64_t> values(kValues);
+	uint32_t seed = 1;
+	for (int i = 0; i < kValues; i++) {
+		seed = seed * 1103515245 + 12345;
+		values[i] = (uint64_t)std::pow(10.0, 6.0 * (double)(seed >> 8) / (double)(1 << 24));
+	}
+
+	LatencyHistogram histogram;
+	uint64_t start = nowNs();
+	std::vector<std::thread> recorders;
+	for (int t = 0; t < threads; t++) {
+		recorders.push_back(std::thread([&, t]() {
+			for (int i = t; i < kValues; i += threads) {
+				histogram.record(values[i]);
+			}
+		}));
+	}
+	for (size_t t = 0; t < recorders.size(); t++) {
+		recorders[t].join();
+	}
+	double elapsedNs = (double)(nowNs() - start);
+	LatencyHistogram::Summary summary = histogram.summarize();
+
+	const double ps[3] = { 0.5, 0.9, 0.99 };
+	const uint64_t measured[3] = { summary.p50Us, summary.p90Us, summary.p99Us };
+	double maxErrorPct = 0;
+	for (int i = 0; i < 3; i++) {
+		double exact = percentile(values, ps[i]);
+		double error = 100.0 * std::fabs((double)measured[i] - exact) / exact;
+		if (error > maxErrorPct) maxErrorPct = error;
+	}
+	uint64_t exactMax = (uint64_t)percentile(values, 1.0);
+
+	BenchResult result;
+	char name[64];
+	snprintf(name, sizeof(name), "latencyHistogram_%ithreads", threads);
+	result.kernel = name;
+	result.resolution = NULL;
+	result.iterations = kValues;
+	result.nsPerFrame = elapsedNs / kValues;
+	result.gbPerSecond = 0;
+	char extra[256];
+	snprintf(extra, sizeof(extra), ", \"p50_us\": %llu, \"p99_us\": %llu, \"percentile_max_error_pct\": %.2f, \"accurate\": %s, \"all_recorded\": %s, \"max_exact\": %s",
+		(unsigned long long)summary.p50Us, (unsigned long long)summary.p99Us, maxErrorPct, (maxErrorPct < 6.25) ? "true" : "false",
+		(summary.count == (uint64_t)kValues) ? "true" : "false", (summary.maxUs == exactMax) ? "true" : "false");
+	result.extra = extra;
+	results.push_back(result);
+}
+
+// Stamps of 30 fps frames through the stages of the capture filter, in microseconds and starting just before the wrap of
+// the 32-bit stamps: 0.5 to 1.5ms in the camera callback, 0 to 10ms waiting for the ticker, 3ms of conversion, the
+// ticker sending the frames on 10ms ticks. Checks that the percentiles recorded by a LatencyTracer are within 1/16 of the
+// actual durations, across the wrap, and reports the jitter brought by the ticks.
+static void benchLatencyTracer(std::vector<BenchResult> &results)
+{
+	static const int kFrames = 3000;
+	static const uint32_t kOrigin = 0xFFFFFFFFu - 30000000u;
+	LatencyTracer tracer;
+	std::vector<uint64_t> totals;
+	uint32_t seed = 1;
+	uint64_t start = nowNs();
+	for (int i = 0; i < kFrames; i++) {
+		seed = seed * 1103515245 + 12345;
+		uint64_t entered = (uint64_t)i * 1000000 / 30;
+		uint64_t queued = entered + 500 + (seed >> 16) % 1000;
+		uint64_t taken = ((queued / 10000) + 1) * 10000;
+		uint64_t converted = taken + 3000;
+		tracer.record(LatencyTracer::StageHandoff, kOrigin + (uint32_t)entered, kOrigin + (uint32_t)queued);
+		tracer.record(LatencyTracer::StageQueueWait, kOrigin + (uint32_t)queued, kOrigin + (uint32_t)taken);
+		tracer.record(LatencyTracer::StageConversion, kOrigin + (uint32_t)taken, kOrigin + (uint32_t)converted);
+		tracer.record(LatencyTracer::StageTotal, kOrigin + (uint32_t)entered, kOrigin + (uint32_t)converted);
+		tracer.frameDone(kOrigin + (uint32_t)converted);
+		totals.push_back(converted - entered);
+	}
+	double elapsedNs = (double)(nowNs() - start);
+	LatencyHistogram::Summary total = tracer.stage(LatencyTracer::StageTotal).summarize();
+	LatencyHistogram::Summary conversion = tracer.stage(LatencyTracer::StageConversion).summarize();
+	LatencyHistogram::Summary jitter = tracer.jitter().summarize();
+	double exactP50 = percentile(totals, 0.5);
+	double exactP99 = percentile(totals, 0.99);
+	bool accurate = (std::fabs((double)total.p50Us - exactP50) < exactP50 / 16) && (std::fabs((double)total.p99Us - exactP99) < exactP99 / 16)
+		&& (conversion.maxUs == 3000) && (total.maxUs < 15000);
+
+	BenchResult result;
+	result.kernel = "latencyTracer";
+	result.resolution = NULL;
+	result.iterations = kFrames;
+	result.nsPerFrame = elapsedNs / kFrames;
+	result.gbPerSecond = 0;
+	char extra[256];
+	snprintf(extra, sizeof(extra), ", \"total_p50_ms\": %.2f, \"total_p99_ms\": %.2f, \"jitter_p50_ms\": %.2f, \"jitter_p99_ms\": %.2f, \"frames_done\": %llu, \"accurate_across_wrap\": %s",
+		total.p50Us / 1000.0, total.p99Us / 1000.0, jitter.p50Us / 1000.0, jitter.p99Us / 1000.0,
+		(unsigned long long)(jitter.count + 2), accurate ? "true" : "false");
+	result.extra = extra;
+	results.push_back(result);
+}
+
+static void printResults(const std::vector<BenchResult> &results, double minTimeMs)
+{
+	printf("{\n");
+	printf("  \"isa\": \"%s\",\n", videoKernelsIsaName(videoKernelsIsa()));
+	printf("  \"threads\": %i,\n", VideoWorkerPool::get()->getThreadCount());
+	printf("  \"min_time_ms\": %g,\n", minTimeMs);
+	printf("  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult &r = results[i];
+		if (r.resolution == NULL) {
+			// Benchmarks that do not depend on the frame size.
+			printf("    { \"kernel\": \"%s\", \"iterations\": %i, \"ns_per_item\": %.1f%s }%s\n",
+				r.kernel.c_str(), r.iterations, r.nsPerFrame, r.extra.c_str(), (i + 1 < results.size()) ? "," : "");
+			continue;
+		}
+		printf("    { \"kernel\": \"%s\", \"resolution\": \"%s\", \"width\": %i, \"height\": %i, \"iterations\": %i, \"ns_per_frame\": %.0f, \"gb_per_s\": %.3f%s }%s\n",
+			r.kernel.c_str(), r.resolution->name, r.resolution->width, r.resolution->height, r.iterations, r.nsPerFrame, r.gbPerSecond,
+			r.extra.c_str(), (i + 1 < results.size()) ? "," : "");
+	}
+	printf("  ]\n");
+	printf("}\n");
+}
+
+static void usage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [--min-time-ms <ms>] [--threads <count>] [--resolution <name>]\n", program);
+}
+
+int main(int argc, char *argv[])
+{
+	double minTimeMs = 200;
+	int threads = 0;
+	const char *resolutionName = NULL;
+	for (int i = 1; i < argc; i++) {
+		if ((strcmp(argv[i], "--min-time-ms") == 0) && (i + 1 < argc)) {
+			minTimeMs = atof(argv[++i]);
+		} else if ((strcmp(argv[i], "--threads") == 0) && (i + 1 < argc)) {
+			threads = atoi(argv[++i]);
+		} else if ((strcmp(argv[i], "--resolution") == 0) && (i + 1 < argc)) {
+			resolutionName = argv[++i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	srand(1);
+	VideoWorkerPool *pool = VideoWorkerPool::get();
+	pool->setThreadCount(threads);
+	pool->retain();
+	std::vector<BenchResult> results;
+	for (size_t i = 0; i < sizeof(kResolutions) / sizeof(kResolutions[0]); i++) {
+		if ((resolutionName == NULL) || (strcmp(resolutionName, kResolutions[i].name) == 0)) {
+			benchResolution(&kResolutions[i], minTimeMs, results);
+		}
+	}
+	pool->release();
+	if (resolutionName == NULL) {
+		benchScaling(minTimeMs, results);
+		benchQueues(minTimeMs, results);
+		benchSinkWorkQueue(minTimeMs, results);
+		benchBufferLender(minTimeMs, results);
+		benchCaptureQueue<MutexFrameQueue>("mutexCaptureQueue", results);
+		benchCaptureQueue<SpscQueue<uint64_t> >("spscCaptureQueue", results);
+		benchStalledCaptureQueue(results);
+		benchCapturePacing(false, results);
+		benchCapturePacing(true, results);
+		static const double kDecimations[][2] = { { 30, 15 }, { 60, 24 }, { 30, 7.5 }, { 50, 12.5 }, { 30, 29.97 } };
+		for (size_t i = 0; i < sizeof(kDecimations) / sizeof(kDecimations[0]); i++) {
+			benchFrameDecimation(kDecimations[i][0], kDecimations[i][1], false, results);
+			benchFrameDecimation(kDecimations[i][0], kDecimations[i][1], true, results);
+		}
+		for (int cameraFps = 15; cameraFps <= 60; cameraFps *= 2) {
+			benchLazyCaptureConversion(cameraFps, false, results);
+			benchLazyCaptureConversion(cameraFps, true, results);
+		}
+		benchFrameMailbox<MutexFrameMailbox>("mutexFrameMailbox", results);
+		benchFrameMailbox<LockFreeFrameMailbox>("frameMailbox", results);
+		benchPresentationClock("tickCountSampleTimes", true, false, results);
+		benchPresentationClock("presentationClock", false, false, results);
+		benchPresentationClock("presentationClockTimestamps", false, true, results);
+		benchLazyDisplayConversion(false, results);
+		benchLazyDisplayConversion(true, results);
+		for (int displays = 1; displays <= 4; displays *= 2) {
+			benchDisplayTicker(displays, false, results);
+			benchDisplayTicker(displays, true, results);
+		}
+		benchLatencyHistogram(1, results);
+		benchLatencyHistogram(4, results);
+		benchLatencyTracer(results);
+	}
+	printResults(results, minTimeMs);
+	return 0;
+}
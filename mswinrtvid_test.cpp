@@ -0,0 +1,1462 @@
+/*
+mswinrtvid_test.cpp
+
+mediastreamer2 library - modular sound and video processing and streaming
+Windows Audio Session API sound card plugin for mediastreamer2
+Copyright (C) 2010-2016 Belledonne Communications, Grenoble, France
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// Checks of the portable kernels against straightforward references, run by ctest. Each check is a function named on the
+// command line, or all of them when there is none. The kernels having several instruction sets are checked with each
+// one the processor supports.
+
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <memory>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "BufferLender.h"
+#include "FrameDecimator.h"
+#include "FrameMailbox.h"
+#include "FramePool.h"
+#include "LatencyTracer.h"
+#include "PresentationClock.h"
+#include "RecyclingPool.h"
+#include "RingBuffer.h"
+#include "SpscQueue.h"
+#include "VideoKernels.h"
+#include "VideoWorkerPool.h"
+#include "WorkItemCoalescer.h"
+
+using namespace libmswinrtvid;
+
+
+static int sFailures = 0;
+static const char *sCheckContext = "";
+// Allocations made through operator new, for the checks of the steady state of the queues.
+static std::atomic<unsigned long> sAllocations(0);
+
+void * operator new(size_t size)
+{
+	sAllocations++;
+	void *p = malloc((size > 0) ? size : 1);
+	if (p == NULL) throw std::bad_alloc();
+	return p;
+}
+
+// GCC takes the free() of the inlined operator delete for a mismatch with the new expressions.
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 11)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 11)
+#pragma GCC diagnostic pop
+#endif
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+struct TestCase {
+	const char *name;
+	void (*func)();
+};
+
+static bool check(bool ok, const char *condition, const char *file, int line)
+{
+	if (!ok) {
+		if (sFailures < 20) fprintf(stderr, "%s:%i: [%s] %s failed\n", file, line, sCheckContext, condition);
+		sFailures++;
+	}
+	return ok;
+}
+
+// The instruction sets of the kernels supported by the processor, the scalar one first.
+static std::vector<VideoKernelsIsa> supportedIsas()
+{
+	static const VideoKernelsIsa kIsas[] = { VideoKernelsIsaScalar, VideoKernelsIsaSSE2, VideoKernelsIsaAVX2, VideoKernelsIsaNEON };
+	VideoKernelsIsa detected = videoKernelsIsa();
+	std::vector<VideoKernelsIsa> isas;
+	for (size_t i = 0; i < sizeof(kIsas) / sizeof(kIsas[0]); i++) {
+		if (setVideoKernelsIsa(kIsas[i])) isas.push_back(kIsas[i]);
+	}
+	setVideoKernelsIsa(detected);
+	return isas;
+}
+
+static void fillRandom(std::vector<uint8_t> &buffer)
+{
+	for (size_t i = 0; i < buffer.size(); i++) {
+		buffer[i] = (uint8_t)rand();
+	}
+}
+
+// Widths around the sizes of the SIMD registers and of the odd chroma planes.
+static const int kWidths[] = { 0, 1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 88, 95, 161, 320, 641 };
+static const int kGuard = 64;
+static const uint8_t kGuardValue = 0xA5;
+
+
+// The byte-per-byte loop of the display filters that interleaveUVRow replaced, with misaligned pointers and guard bytes
+// after the destination row to catch the SIMD stores overflowing it.
+static void testInterleaveUVRow()
+{
+	std::vector<VideoKernelsIsa> isas = supportedIsas();
+	VideoKernelsIsa detected = videoKernelsIsa();
+	for (size_t k = 0; k < isas.size(); k++) {
+		setVideoKernelsIsa(isas[k]);
+		sCheckContext = videoKernelsIsaName(isas[k]);
+		for (size_t w = 0; w < sizeof(kWidths) / sizeof(kWidths[0]); w++) {
+			int width = kWidths[w];
+			for (int misalignment = 0; misalignment < 4; misalignment++) {
+				std::vector<uint8_t> u(width + 4), v(width + 4);
+				fillRandom(u);
+				fillRandom(v);
+				std::vector<uint8_t> dst(2 * width + 4 + kGuard, kGuardValue);
+				std::vector<uint8_t> expected(dst);
+				const uint8_t *su = &u[misalignment];
+				const uint8_t *sv = &v[(misalignment + 1) % 4];
+				uint8_t *d = &dst[misalignment];
+				for (int i = 0; i < width; i++) {
+					expected[misalignment + 2 * i] = su[i];
+					expected[misalignment + 2 * i + 1] = sv[i];
+				}
+				interleaveUVRow(d, su, sv, width);
+				CHECK(dst == expected);
+			}
+		}
+		// Whole planes with padded strides, the padding of the destination must be left untouched.
+		for (int height = 1; height <= 5; height += 2) {
+			int width = 37;
+			int srcStride = width + 11;
+			int dstStride = 2 * width + 13;
+			std::vector<uint8_t> u(srcStride * height), v(srcStride * height);
+			fillRandom(u);
+			fillRandom(v);
+			std::vector<uint8_t> dst(dstStride * height, kGuardValue);
+			std::vector<uint8_t> expected(dst);
+			for (int y = 0; y < height; y++) {
+				for (int x = 0; x < width; x++) {
+					expected[y * dstStride + 2 * x] = u[y * srcStride + x];
+					expected[y * dstStride + 2 * x + 1] = v[y * srcStride + x];
+				}
+			}
+			interleaveUVPlanes(&dst[0], dstStride, &u[0], srcStride, &v[0], srcStride, width, height);
+			CHECK(dst == expected);
+		}
+	}
+	setVideoKernelsIsa(detected);
+}
+
+// copyPlane and convertI420ToNV12 with padded strides, odd dimensions and planes starting at misaligned addresses, against
+// a per-sample reference. The padding of the destination must be left untouched.
+static void testConvertI420ToNV12()
+{
+	static const int kSizes[][2] = { { 1, 1 }, { 2, 2 }, { 3, 5 }, { 17, 9 }, { 33, 31 }, { 65, 3 }, { 176, 144 }, { 321, 241 } };
+	std::vector<VideoKernelsIsa> isas = supportedIsas();
+	VideoKernelsIsa detected = videoKernelsIsa();
+	for (size_t k = 0; k < isas.size(); k++) {
+		setVideoKernelsIsa(isas[k]);
+		sCheckContext = videoKernelsIsaName(isas[k]);
+		for (size_t n = 0; n < sizeof(kSizes) / sizeof(kSizes[0]); n++) {
+			int width = kSizes[n][0];
+			int height = kSizes[n][1];
+			int chromaWidth = (width + 1) / 2;
+			int chromaHeight = (height + 1) / 2;
+			for (int padding = 0; padding <= 7; padding += 7) {
+				int misalignment = padding % 4 + 1;
+				int strides[3] = { width + padding, chromaWidth + padding + 1, chromaWidth + 2 * padding };
+				std::vector<uint8_t> src(misalignment + strides[0] * height + (strides[1] + strides[2]) * chromaHeight);
+				fillRandom(src);
+				const uint8_t *planes[3];
+				planes[0] = &src[misalignment];
+				planes[1] = planes[0] + strides[0] * height;
+				planes[2] = planes[1] + strides[1] * chromaHeight;
+
+				int dstYStride = width + padding + 3;
+				int dstUVStride = 2 * chromaWidth + padding;
+				std::vector<uint8_t> dstY(misalignment + dstYStride * height, kGuardValue);
+				std::vector<uint8_t> dstUV(misalignment + dstUVStride * chromaHeight, kGuardValue);
+				std::vector<uint8_t> expectedY(dstY), expectedUV(dstUV);
+				for (int y = 0; y < height; y++) {
+					for (int x = 0; x < width; x++) {
+						expectedY[misalignment + y * dstYStride + x] = planes[0][y * strides[0] + x];
+					}
+				}
+				for (int y = 0; y < chromaHeight; y++) {
+					for (int x = 0; x < chromaWidth; x++) {
+						expectedUV[misalignment + y * dstUVStride + 2 * x] = planes[1][y * strides[1] + x];
+						expectedUV[misalignment + y * dstUVStride + 2 * x + 1] = planes[2][y * strides[2] + x];
+					}
+				}
+				convertI420ToNV12(planes, strides, width, height, &dstY[misalignment], dstYStride, &dstUV[misalignment], dstUVStride);
+				CHECK(dstY == expectedY);
+				CHECK(dstUV == expectedUV);
+
+				// A packed copy goes through a single memcpy, a negative stride copies the rows in reverse order.
+				std::vector<uint8_t> packed(width * height), flipped(width * height), expectedFlipped(width * height);
+				copyPlane(&packed[0], width, planes[0], strides[0], width, height);
+				copyPlane(&flipped[0], width, planes[0] + (height - 1) * strides[0], -strides[0], width, height);
+				for (int y = 0; y < height; y++) {
+					CHECK(memcmp(&packed[y * width], planes[0] + y * strides[0], width) == 0);
+					memcpy(&expectedFlipped[y * width], planes[0] + (height - 1 - y) * strides[0], width);
+				}
+				CHECK(flipped == expectedFlipped);
+			}
+		}
+	}
+	setVideoKernelsIsa(detected);
+}
+
+// The copy of the camera frames by the capture filter: a NV12 buffer whose rows may be padded to a pitch, to a packed NV12
+// frame of the pool (Y then the interleaved UV rows), and the 90kHz timestamps computed from their presentation times.
+static void testCaptureNV12()
+{
+	static const int kSizes[][3] = { { 2, 2, 2 }, { 176, 144, 176 }, { 320, 240, 384 }, { 640, 360, 640 }, { 1280, 720, 1344 } };
+	for (size_t n = 0; n < sizeof(kSizes) / sizeof(kSizes[0]); n++) {
+		int width = kSizes[n][0];
+		int height = kSizes[n][1];
+		int pitch = kSizes[n][2];
+		std::vector<uint8_t> camera(pitch * height + pitch * (height / 2));
+		fillRandom(camera);
+		size_t size = FramePool::frameSize(width, height, FramePool::FormatNV12);
+		std::vector<uint8_t> frame(size + kGuard, kGuardValue);
+		copyNV12(&frame[0], &camera[0], pitch, width, height);
+		bool ok = true;
+		for (int y = 0; y < height; y++) {
+			ok = ok && (memcmp(&frame[y * width], &camera[y * pitch], width) == 0);
+		}
+		CHECK(ok);
+		// The chroma rows follow the luma plane without padding, U first.
+		const uint8_t *uv = &frame[width * height];
+		for (int y = 0; y < height / 2; y++) {
+			for (int x = 0; x < width / 2; x++) {
+				ok = ok && (uv[y * width + 2 * x] == camera[pitch * height + y * pitch + 2 * x]);
+				ok = ok && (uv[y * width + 2 * x + 1] == camera[pitch * height + y * pitch + 2 * x + 1]);
+			}
+		}
+		CHECK(ok);
+		CHECK((size_t)(width * height + width * (height / 2)) == size);
+		CHECK(frame[size] == kGuardValue);
+	}
+
+	// The presentation times are in 100ns units, the timestamps have no rounding other than to the 90kHz tick.
+	CHECK(PresentationClock::toTimestamp(0) == 0);
+	CHECK(PresentationClock::toTimestamp(PresentationClock::kUnitsPerSecond) == 90000);
+	CHECK(PresentationClock::toTimestamp(111) == 0);
+	CHECK(PresentationClock::toTimestamp(112) == 1);
+	static const double kFrameRates[] = { 15, 24, 29.97, 30, 60 };
+	for (size_t i = 0; i < sizeof(kFrameRates) / sizeof(kFrameRates[0]); i++) {
+		double ticks = 90000 / kFrameRates[i];
+		bool ok = true;
+		for (int frame = 1; frame < 2000; frame++) {
+			int64_t time = (int64_t)(frame * (PresentationClock::kUnitsPerSecond / kFrameRates[i]));
+			int64_t previous = (int64_t)((frame - 1) * (PresentationClock::kUnitsPerSecond / kFrameRates[i]));
+			uint32_t delta = PresentationClock::toTimestamp(time) - PresentationClock::toTimestamp(previous);
+			ok = ok && ((double)delta >= ticks - 1) && ((double)delta <= ticks + 1);
+		}
+		CHECK(ok);
+	}
+	// 2^32 ticks after 47721.858844s, the timestamps wrap but their differences are still right.
+	int64_t wrap = (int64_t)47721858844LL * 1000;
+	CHECK(PresentationClock::toTimestamp(wrap - 1000000) > 0xFFFE0000u);
+	CHECK(PresentationClock::toTimestamp(wrap + 1000000) < 0x20000u);
+	CHECK((uint32_t)(PresentationClock::toTimestamp(wrap + 1000000) - PresentationClock::toTimestamp(wrap - 1000000)) == 18000);
+	// A camera running for years does not overflow the computation.
+	int64_t years = (int64_t)10 * 365 * 24 * 3600 * PresentationClock::kUnitsPerSecond;
+	CHECK(PresentationClock::toTimestamp(years + PresentationClock::kUnitsPerSecond) - PresentationClock::toTimestamp(years) == 90000);
+}
+
+// Bilinear sample of a plane of pixelStep interleaved samples per pixel, at the position of destination sample (x, y)
+// with the centers of the samples aligned, as the scaler computes it but in floating point.
+static double bilinearSample(const uint8_t *src, int srcStride, int srcWidth, int srcHeight, int pixelStep, int component,
+	int dstWidth, int dstHeight, int x, int y)
+{
+	double sx = (x + 0.5) * srcWidth / dstWidth - 0.5;
+	double sy = (y + 0.5) * srcHeight / dstHeight - 0.5;
+	if (sx < 0) sx = 0;
+	if (sy < 0) sy = 0;
+	if (sx > srcWidth - 1) sx = srcWidth - 1;
+	if (sy > srcHeight - 1) sy = srcHeight - 1;
+	int x0 = (int)sx;
+	int y0 = (int)sy;
+	int x1 = (x0 + 1 < srcWidth) ? x0 + 1 : x0;
+	int y1 = (y0 + 1 < srcHeight) ? y0 + 1 : y0;
+	double fx = sx - x0;
+	double fy = sy - y0;
+	const uint8_t *r0 = src + y0 * srcStride + component;
+	const uint8_t *r1 = src + y1 * srcStride + component;
+	double top = r0[x0 * pixelStep] * (1 - fx) + r0[x1 * pixelStep] * fx;
+	double bottom = r1[x0 * pixelStep] * (1 - fx) + r1[x1 * pixelStep] * fx;
+	return top * (1 - fy) + bottom * fy;
+}
+
+// scaleNV12ToI420 down and up, to odd sizes too: every ISA gives the same samples as the scalar code, which stays close
+// to the floating-point bilinear filter. The scaler truncates the positions to 1/256 of sample and rounds both passes
+// to 8 bits, so on random samples, where neighbours may differ by 255, it may be off by up to 2.
+static void testScaleNV12ToI420()
+{
+	static const int kSizes[][4] = { { 64, 48, 32, 24 }, { 33, 17, 16, 9 }, { 101, 75, 64, 48 }, { 7, 5, 13, 11 }, { 1280, 720, 640, 360 }, { 320, 240, 176, 144 } };
+	std::vector<VideoKernelsIsa> isas = supportedIsas();
+	VideoKernelsIsa detected = videoKernelsIsa();
+	for (size_t n = 0; n < sizeof(kSizes) / sizeof(kSizes[0]); n++) {
+		int srcWidth = kSizes[n][0];
+		int srcHeight = kSizes[n][1];
+		int dstWidth = kSizes[n][2];
+		int dstHeight = kSizes[n][3];
+		int srcChromaWidth = (srcWidth + 1) / 2;
+		int srcChromaHeight = (srcHeight + 1) / 2;
+		int dstChromaWidth = (dstWidth + 1) / 2;
+		int dstChromaHeight = (dstHeight + 1) / 2;
+		int srcYStride = srcWidth + 5;
+		int srcUVStride = 2 * srcChromaWidth + 3;
+		std::vector<uint8_t> y(srcYStride * srcHeight), uv(srcUVStride * srcChromaHeight);
+		fillRandom(y);
+		fillRandom(uv);
+		int strides[3] = { dstWidth + 3, dstChromaWidth + 1, dstChromaWidth + 2 };
+		size_t size = strides[0] * dstHeight + (strides[1] + strides[2]) * dstChromaHeight;
+		std::vector<uint8_t> reference;
+		for (size_t k = 0; k < isas.size(); k++) {
+			setVideoKernelsIsa(isas[k]);
+			sCheckContext = videoKernelsIsaName(isas[k]);
+			std::vector<uint8_t> dst(size);
+			uint8_t *planes[3] = { &dst[0], &dst[strides[0] * dstHeight], &dst[strides[0] * dstHeight + strides[1] * dstChromaHeight] };
+			scaleNV12ToI420(&y[0], srcYStride, &uv[0], srcUVStride, srcWidth, srcHeight, planes, strides, dstWidth, dstHeight);
+			if (!reference.empty()) {
+				CHECK(dst == reference);
+				continue;
+			}
+			reference = dst;
+
+			double maxError = 0;
+			for (int j = 0; j < dstHeight; j++) {
+				for (int i = 0; i < dstWidth; i++) {
+					double expected = bilinearSample(&y[0], srcYStride, srcWidth, srcHeight, 1, 0, dstWidth, dstHeight, i, j);
+					maxError = fmax(maxError, fabs(planes[0][j * strides[0] + i] - expected));
+				}
+			}
+			for (int j = 0; j < dstChromaHeight; j++) {
+				for (int i = 0; i < dstChromaWidth; i++) {
+					for (int c = 0; c < 2; c++) {
+						double expected = bilinearSample(&uv[0], srcUVStride, srcChromaWidth, srcChromaHeight, 2, c, dstChromaWidth, dstChromaHeight, i, j);
+						maxError = fmax(maxError, fabs(planes[1 + c][j * strides[1 + c] + i] - expected));
+					}
+				}
+			}
+			CHECK(maxError <= 2);
+		}
+	}
+	setVideoKernelsIsa(detected);
+}
+
+// Sizes of the fit tests: the common ones, odd ones, and ones that leave 1-pixel bars against their neighbours.
+static const int kFitSizes[] = { 1, 2, 3, 5, 16, 17, 100, 101, 144, 176, 288, 352, 480, 640, 720, 1080, 1280, 1920 };
+
+static bool rectInside(const VideoRect &rect, int width, int height)
+{
+	return (rect.x >= 0) && (rect.y >= 0) && (rect.width >= 0) && (rect.height >= 0)
+		&& (rect.x + rect.width <= width) && (rect.y + rect.height <= height);
+}
+
+// Checks the kept side of the picture along one axis, cut from size to the even cut: it starts at an even offset,
+// keeps the aspect ratio as far as the rounding down to an even size allows (full * num / den - cut < 2),
+// and is centered, the extra sample of an odd margin and the one lost to the even offset going after it.
+static void checkFitAxis(int offset, int cut, int size, int64_t num, int64_t den)
+{
+	CHECK((offset % 2) == 0);
+	CHECK((cut % 2) == 0);
+	CHECK((num - (int64_t)cut * den >= 0) && (num - (int64_t)cut * den < 2 * den));
+	int after = size - offset - cut;
+	CHECK((after >= offset) && (after - offset <= 3));
+}
+
+static void testComputeFitRects()
+{
+	static const int kCount = sizeof(kFitSizes) / sizeof(kFitSizes[0]);
+	for (int a = 0; a < kCount; a++) for (int b = 0; b < kCount; b++) for (int c = 0; c < kCount; c++) for (int d = 0; d < kCount; d++) {
+		int srcWidth = kFitSizes[a];
+		int srcHeight = kFitSizes[b];
+		int dstWidth = kFitSizes[c];
+		int dstHeight = kFitSizes[d];
+		int64_t srcAspect = (int64_t)srcWidth * dstHeight;
+		int64_t dstAspect = (int64_t)dstWidth * srcHeight;
+		VideoRect srcRect, dstRect;
+
+		computeFitRects(srcWidth, srcHeight, dstWidth, dstHeight, VideoFitStretch, srcRect, dstRect);
+		CHECK((srcRect.x == 0) && (srcRect.y == 0) && (srcRect.width == srcWidth) && (srcRect.height == srcHeight));
+		CHECK((dstRect.x == 0) && (dstRect.y == 0) && (dstRect.width == dstWidth) && (dstRect.height == dstHeight));
+
+		computeFitRects(srcWidth, srcHeight, dstWidth, dstHeight, VideoFitLetterbox, srcRect, dstRect);
+		CHECK((srcRect.x == 0) && (srcRect.y == 0) && (srcRect.width == srcWidth) && (srcRect.height == srcHeight));
+		CHECK(rectInside(dstRect, dstWidth, dstHeight));
+		if (srcAspect > dstAspect) {
+			// Letterbox: bars above and below.
+			CHECK((dstRect.x == 0) && (dstRect.width == dstWidth));
+			checkFitAxis(dstRect.y, dstRect.height, dstHeight, (int64_t)srcHeight * dstWidth, srcWidth);
+		} else if (srcAspect < dstAspect) {
+			// Pillarbox: bars on the left and on the right.
+			CHECK((dstRect.y == 0) && (dstRect.height == dstHeight));
+			checkFitAxis(dstRect.x, dstRect.width, dstWidth, (int64_t)srcWidth * dstHeight, srcHeight);
+		} else {
+			CHECK((dstRect.x == 0) && (dstRect.y == 0) && (dstRect.width == dstWidth) && (dstRect.height == dstHeight));
+		}
+
+		computeFitRects(srcWidth, srcHeight, dstWidth, dstHeight, VideoFitCrop, srcRect, dstRect);
+		CHECK((dstRect.x == 0) && (dstRect.y == 0) && (dstRect.width == dstWidth) && (dstRect.height == dstHeight));
+		CHECK(rectInside(srcRect, srcWidth, srcHeight));
+		if (srcAspect > dstAspect) {
+			CHECK((srcRect.y == 0) && (srcRect.height == srcHeight));
+			checkFitAxis(srcRect.x, srcRect.width, srcWidth, (int64_t)dstWidth * srcHeight, dstHeight);
+		} else if (srcAspect < dstAspect) {
+			CHECK((srcRect.x == 0) && (srcRect.width == srcWidth));
+			checkFitAxis(srcRect.y, srcRect.height, srcHeight, (int64_t)dstHeight * srcWidth, dstWidth);
+		} else {
+			CHECK((srcRect.x == 0) && (srcRect.y == 0) && (srcRect.width == srcWidth) && (srcRect.height == srcHeight));
+		}
+	}
+
+	// 1-pixel bars: the picture keeps its size and the odd sample goes to the bar on the right or at the bottom.
+	VideoRect srcRect, dstRect;
+	computeFitRects(100, 50, 101, 50, VideoFitLetterbox, srcRect, dstRect);
+	CHECK((dstRect.x == 0) && (dstRect.y == 0) && (dstRect.width == 100) && (dstRect.height == 50));
+	computeFitRects(100, 50, 100, 51, VideoFitLetterbox, srcRect, dstRect);
+	CHECK((dstRect.x == 0) && (dstRect.y == 0) && (dstRect.width == 100) && (dstRect.height == 50));
+	// 4:3 in 16:9, and 16:9 in 4:3.
+	computeFitRects(640, 480, 1280, 720, VideoFitLetterbox, srcRect, dstRect);
+	CHECK((dstRect.x == 160) && (dstRect.y == 0) && (dstRect.width == 960) && (dstRect.height == 720));
+	computeFitRects(1280, 720, 640, 480, VideoFitLetterbox, srcRect, dstRect);
+	CHECK((dstRect.x == 0) && (dstRect.y == 60) && (dstRect.width == 640) && (dstRect.height == 360));
+	computeFitRects(1280, 720, 640, 480, VideoFitCrop, srcRect, dstRect);
+	CHECK((srcRect.x == 160) && (srcRect.y == 0) && (srcRect.width == 960) && (srcRect.height == 720));
+}
+
+// fitI420ToNV12 of a uniform picture: the samples of the rectangle given by computeFitRects have the color of the picture,
+// all the others are black, and the padding of the rows is left untouched.
+static void testFitI420ToNV12()
+{
+	static const int kSrcSizes[] = { 2, 3, 17, 64, 101 };
+	static const int kDstSizes[] = { 1, 2, 3, 17, 33, 100, 101 };
+	static const uint8_t kColor[3] = { 200, 60, 190 };
+	static const VideoFitMode kModes[] = { VideoFitStretch, VideoFitLetterbox, VideoFitCrop };
+	std::vector<VideoKernelsIsa> isas = supportedIsas();
+	VideoKernelsIsa detected = videoKernelsIsa();
+	for (size_t k = 0; k < isas.size(); k++) {
+		setVideoKernelsIsa(isas[k]);
+		sCheckContext = videoKernelsIsaName(isas[k]);
+		for (int a = 0; a < 5; a++) for (int b = 0; b < 5; b++) for (int c = 0; c < 7; c++) for (int d = 0; d < 7; d++) for (int m = 0; m < 3; m++) {
+			int srcWidth = kSrcSizes[a];
+			int srcHeight = kSrcSizes[b];
+			int dstWidth = kDstSizes[c];
+			int dstHeight = kDstSizes[d];
+			int srcChromaWidth = (srcWidth + 1) / 2;
+			int srcChromaHeight = (srcHeight + 1) / 2;
+			int strides[3] = { srcWidth + 3, srcChromaWidth + 1, srcChromaWidth + 2 };
+			std::vector<uint8_t> y(strides[0] * srcHeight, kColor[0]), u(strides[1] * srcChromaHeight, kColor[1]), v(strides[2] * srcChromaHeight, kColor[2]);
+			const uint8_t *planes[3] = { &y[0], &u[0], &v[0] };
+			int dstChromaWidth = (dstWidth + 1) / 2;
+			int dstChromaHeight = (dstHeight + 1) / 2;
+			int dstYStride = dstWidth + kGuard;
+			int dstUVStride = 2 * dstChromaWidth + kGuard;
+			std::vector<uint8_t> dstY(dstYStride * dstHeight, kGuardValue), dstUV(dstUVStride * dstChromaHeight, kGuardValue);
+			fitI420ToNV12(planes, strides, srcWidth, srcHeight, &dstY[0], dstYStride, &dstUV[0], dstUVStride, dstWidth, dstHeight, kModes[m]);
+
+			VideoRect srcRect, dstRect;
+			computeFitRects(srcWidth, srcHeight, dstWidth, dstHeight, kModes[m], srcRect, dstRect);
+			bool empty = (dstRect.width <= 0) || (dstRect.height <= 0) || (srcRect.width <= 0) || (srcRect.height <= 0);
+			int lumaErrors = 0;
+			int chromaErrors = 0;
+			int guardErrors = 0;
+			for (int j = 0; j < dstHeight; j++) {
+				for (int i = 0; i < dstYStride; i++) {
+					uint8_t sample = dstY[j * dstYStride + i];
+					if (i >= dstWidth) {
+						guardErrors += (sample != kGuardValue);
+						continue;
+					}
+					bool inside = !empty && (i >= dstRect.x) && (i < dstRect.x + dstRect.width) && (j >= dstRect.y) && (j < dstRect.y + dstRect.height);
+					lumaErrors += (sample != (inside ? kColor[0] : 16));
+				}
+			}
+			int rectChromaX = dstRect.x / 2;
+			int rectChromaY = dstRect.y / 2;
+			for (int j = 0; j < dstChromaHeight; j++) {
+				for (int i = 0; i < dstUVStride; i++) {
+					uint8_t sample = dstUV[j * dstUVStride + i];
+					if (i >= 2 * dstChromaWidth) {
+						guardErrors += (sample != kGuardValue);
+						continue;
+					}
+					bool inside = !empty && (i / 2 >= rectChromaX) && (i / 2 < rectChromaX + (dstRect.width + 1) / 2)
+						&& (j >= rectChromaY) && (j < rectChromaY + (dstRect.height + 1) / 2);
+					chromaErrors += (sample != (inside ? kColor[1 + (i % 2)] : 128));
+				}
+			}
+			CHECK(lumaErrors == 0);
+			CHECK(chromaErrors == 0);
+			CHECK(guardErrors == 0);
+		}
+	}
+	setVideoKernelsIsa(detected);
+}
+
+// Position in a width x height source plane of the sample at (x, y) in the destination, once turned clockwise by
+// rotation degrees and then mirrored horizontally.
+static void rotatedSource(int x, int y, int width, int height, int rotation, bool mirror, int &srcX, int &srcY)
+{
+	bool quarterTurn = (rotation == 90) || (rotation == 270);
+	if (mirror) x = (quarterTurn ? height : width) - 1 - x;
+	switch (rotation) {
+	case 90: srcX = y; srcY = height - 1 - x; break;
+	case 180: srcX = width - 1 - x; srcY = height - 1 - y; break;
+	case 270: srcX = width - 1 - y; srcY = x; break;
+	default: srcX = x; srcY = y; break;
+	}
+}
+
+// Rotates a random NV12 picture into guarded I420 planes and checks every sample against its source position.
+// nv12 checks parallelRotateNV12ToNV12, the chroma of its output being split into the U and V planes to be compared.
+static void checkRotation(int width, int height, int rotation, bool mirror, bool parallel, bool nv12)
+{
+	int chromaWidth = (width + 1) / 2;
+	int chromaHeight = (height + 1) / 2;
+	int srcYStride = width + 3;
+	int srcUVStride = 2 * chromaWidth + 5;
+	std::vector<uint8_t> y(srcYStride * height), uv(srcUVStride * chromaHeight);
+	fillRandom(y);
+	fillRandom(uv);
+	bool quarterTurn = (rotation == 90) || (rotation == 270);
+	int dstWidth = quarterTurn ? height : width;
+	int dstHeight = quarterTurn ? width : height;
+	int dstChromaWidth = quarterTurn ? chromaHeight : chromaWidth;
+	int dstChromaHeight = quarterTurn ? chromaWidth : chromaHeight;
+	int strides[3] = { dstWidth + kGuard, dstChromaWidth + kGuard, dstChromaWidth + kGuard };
+	std::vector<uint8_t> dstY(strides[0] * dstHeight, kGuardValue), dstU(strides[1] * dstChromaHeight, kGuardValue), dstV(strides[2] * dstChromaHeight, kGuardValue);
+	uint8_t *planes[3] = { &dstY[0], &dstU[0], &dstV[0] };
+	int errors = 0;
+	int guardErrors = 0;
+	if (nv12) {
+		int uvStride = 2 * dstChromaWidth + kGuard;
+		std::vector<uint8_t> dstUV(uvStride * dstChromaHeight, kGuardValue);
+		std::vector<uint8_t> scratch(2 * dstChromaWidth * dstChromaHeight);
+		parallelRotateNV12ToNV12(&y[0], srcYStride, &uv[0], srcUVStride, width, height, &dstY[0], strides[0], &dstUV[0], uvStride,
+			rotation, mirror, &scratch[0]);
+		for (int j = 0; j < dstChromaHeight; j++) {
+			for (int i = 2 * dstChromaWidth; i < uvStride; i++) {
+				guardErrors += (dstUV[j * uvStride + i] != kGuardValue);
+			}
+			deinterleaveUVRow(&dstU[j * strides[1]], &dstV[j * strides[2]], &dstUV[j * uvStride], dstChromaWidth);
+		}
+	} else if (parallel) {
+		parallelRotateNV12ToI420(&y[0], srcYStride, &uv[0], srcUVStride, width, height, planes, strides, rotation, mirror);
+	} else {
+		rotateNV12ToI420(&y[0], srcYStride, &uv[0], srcUVStride, width, height, planes, strides, rotation, mirror);
+	}
+
+	for (int j = 0; j < dstHeight; j++) {
+		for (int i = 0; i < strides[0]; i++) {
+			uint8_t sample = dstY[j * strides[0] + i];
+			if (i >= dstWidth) {
+				guardErrors += (sample != kGuardValue);
+				continue;
+			}
+			int sx, sy;
+			rotatedSource(i, j, width, height, rotation, mirror, sx, sy);
+			errors += (sample != y[sy * srcYStride + sx]);
+		}
+	}
+	for (int j = 0; j < dstChromaHeight; j++) {
+		for (int i = 0; i < strides[1]; i++) {
+			uint8_t u = dstU[j * strides[1] + i];
+			uint8_t v = dstV[j * strides[2] + i];
+			if (i >= dstChromaWidth) {
+				guardErrors += (u != kGuardValue) + (v != kGuardValue);
+				continue;
+			}
+			int sx, sy;
+			rotatedSource(i, j, chromaWidth, chromaHeight, rotation, mirror, sx, sy);
+			errors += (u != uv[sy * srcUVStride + 2 * sx]) + (v != uv[sy * srcUVStride + 2 * sx + 1]);
+		}
+	}
+	CHECK(errors == 0);
+	CHECK(guardErrors == 0);
+}
+
+// The four orientations, mirrored or not, for every instruction set: sizes around the 8x8 blocks and the 64x64 tiles
+// of the quarter turns, odd ones included. parallelRotateNV12ToI420 is checked on frames large enough to be split in
+// bands, with an odd height so that the last band is odd. parallelRotateNV12ToNV12, used when the capture filter outputs
+// NV12, must place the samples the same way.
+static void testRotateNV12ToI420()
+{
+	static const int kSizes[] = { 1, 2, 3, 7, 8, 9, 16, 17, 63, 64, 65, 130 };
+	static const int kSizeCount = sizeof(kSizes) / sizeof(kSizes[0]);
+	std::vector<VideoKernelsIsa> isas = supportedIsas();
+	VideoKernelsIsa detected = videoKernelsIsa();
+	VideoWorkerPool *pool = VideoWorkerPool::get();
+	pool->setThreadCount(4);
+	pool->retain();
+	for (size_t k = 0; k < isas.size(); k++) {
+		setVideoKernelsIsa(isas[k]);
+		sCheckContext = videoKernelsIsaName(isas[k]);
+		for (int rotation = 0; rotation < 360; rotation += 90) {
+			for (int mirror = 0; mirror < 2; mirror++) {
+				for (int w = 0; w < kSizeCount; w++) {
+					for (int h = 0; h < kSizeCount; h++) {
+						checkRotation(kSizes[w], kSizes[h], rotation, mirror != 0, false, false);
+						checkRotation(kSizes[w], kSizes[h], rotation, mirror != 0, false, true);
+					}
+				}
+				checkRotation(1280, 720, rotation, mirror != 0, true, false);
+				checkRotation(1283, 723, rotation, mirror != 0, true, false);
+				checkRotation(1283, 723, rotation, mirror != 0, true, true);
+			}
+		}
+	}
+	pool->release();
+	pool->setThreadCount(0);
+	setVideoKernelsIsa(detected);
+}
+
+// Stands for a Media Foundation buffer of the camera: counts its references and locks, and the buffers held at a time.
+struct MockBuffer {
+	uint8_t data[64];
+	std::atomic<int> refs;
+	std::atomic<int> locks;
+	bool failLock;
+	bool unlockedBeforeRelease;
+};
+
+static std::atomic<int> sHeldBuffers(0);
+static std::atomic<int> sMaxHeldBuffers(0);
+
+static void addRefMockBuffer(void *buffer)
+{
+	static_cast<MockBuffer *>(buffer)->refs++;
+}
+
+static void releaseMockBuffer(void *buffer)
+{
+	MockBuffer *b = static_cast<MockBuffer *>(buffer);
+	// The buffer may be lent several times, each lend holding a reference and a lock: the one being released must
+	// already be unlocked.
+	if (b->locks > b->refs - 2) b->unlockedBeforeRelease = false;
+	b->refs--;
+}
+
+static bool lockMockBuffer(void *buffer, uint8_t **data, size_t *length)
+{
+	MockBuffer *b = static_cast<MockBuffer *>(buffer);
+	if (b->failLock) return false;
+	b->locks++;
+	int held = ++sHeldBuffers;
+	int max = sMaxHeldBuffers;
+	while ((held > max) && !sMaxHeldBuffers.compare_exchange_weak(max, held));
+	*data = b->data;
+	*length = sizeof(b->data);
+	return true;
+}
+
+static void unlockMockBuffer(void *buffer)
+{
+	static_cast<MockBuffer *>(buffer)->locks--;
+	sHeldBuffers--;
+}
+
+static const BorrowedBufferOps kMockBufferOps = { addRefMockBuffer, releaseMockBuffer, lockMockBuffer, unlockMockBuffer };
+
+static void initMockBuffers(MockBuffer *buffers, int count)
+{
+	for (int i = 0; i < count; i++) {
+		buffers[i].refs = 1;	// The reference of the camera.
+		buffers[i].locks = 0;
+		buffers[i].failLock = false;
+		buffers[i].unlockedBeforeRelease = true;
+	}
+}
+
+// Every buffer is back to the sole reference of its owner, unlocked before being released.
+static bool mockBuffersBalanced(const MockBuffer *buffers, int count)
+{
+	for (int i = 0; i < count; i++) {
+		if ((buffers[i].refs != 1) || (buffers[i].locks != 0) || !buffers[i].unlockedBeforeRelease) return false;
+	}
+	return true;
+}
+
+// A lent buffer stays referenced and locked until it is given back, in any order, and no more than the limit are lent
+// at a time, as the capture filter relies on to leave the camera enough buffers. Then the same from several threads,
+// the buffers being given back by another thread than the one that lent them as the downstream filters do.
+static void testBufferLender()
+{
+	MockBuffer buffers[4];
+	initMockBuffers(buffers, 4);
+	BufferLender lender(2);
+	size_t length = 0;
+	uint8_t *first = lender.lend(&buffers[0], &kMockBufferOps, &length);
+	CHECK((first == buffers[0].data) && (length == sizeof(buffers[0].data)));
+	uint8_t *second = lender.lend(&buffers[1], &kMockBufferOps, &length);
+	CHECK(second == buffers[1].data);
+	CHECK((buffers[0].refs == 2) && (buffers[0].locks == 1) && (buffers[1].refs == 2) && (buffers[1].locks == 1));
+	// The limit is reached: the third buffer is left alone and will be copied.
+	CHECK(lender.lend(&buffers[2], &kMockBufferOps, &length) == NULL);
+	CHECK((buffers[2].refs == 1) && (buffers[2].locks == 0));
+	CHECK(lender.getOutstanding() == 2);
+	// Given back out of order, the freed slot is lent again.
+	CHECK(lender.giveBack(second));
+	CHECK((buffers[1].refs == 1) && (buffers[1].locks == 0) && buffers[1].unlockedBeforeRelease);
+	CHECK((buffers[0].refs == 2) && (buffers[0].locks == 1));
+	uint8_t *third = lender.lend(&buffers[2], &kMockBufferOps, &length);
+	CHECK(third == buffers[2].data);
+	// Data that is not lent, or already given back, is refused.
+	CHECK(!lender.giveBack(buffers[3].data));
+	CHECK(!lender.giveBack(second));
+	CHECK(lender.getOutstanding() == 2);
+	// Lowering the limit keeps the lent buffers valid but lends no more until enough are given back.
+	lender.setMaxOutstanding(1);
+	CHECK(lender.lend(&buffers[3], &kMockBufferOps, &length) == NULL);
+	CHECK(lender.giveBack(first));
+	CHECK(lender.lend(&buffers[3], &kMockBufferOps, &length) == NULL);
+	CHECK(lender.giveBack(third));
+	CHECK(lender.getOutstanding() == 0);
+	// A buffer that cannot be locked is released right away and takes no slot.
+	buffers[3].failLock = true;
+	CHECK(lender.lend(&buffers[3], &kMockBufferOps, &length) == NULL);
+	CHECK(lender.getOutstanding() == 0);
+	buffers[3].failLock = false;
+	CHECK(mockBuffersBalanced(buffers, 4));
+	// A limit of 0 disables the lending.
+	lender.setMaxOutstanding(0);
+	CHECK(lender.lend(&buffers[0], &kMockBufferOps, &length) == NULL);
+	CHECK(mockBuffersBalanced(buffers, 4));
+
+	static const int kThreads = 4;
+	static const int kBuffersPerThread = 4;
+	static const int kLends = 20000;
+	static const int kMaxOutstanding = 3;
+	MockBuffer shared[kThreads * kBuffersPerThread];
+	initMockBuffers(shared, kThreads * kBuffersPerThread);
+	BufferLender sharedLender(kMaxOutstanding);
+	sHeldBuffers = 0;
+	sMaxHeldBuffers = 0;
+	std::atomic<const uint8_t *> handoff[kThreads];
+	for (int t = 0; t < kThreads; t++) {
+		handoff[t] = NULL;
+	}
+	std::vector<std::thread> threads;
+	for (int t = 0; t < kThreads; t++) {
+		threads.push_back(std::thread([&, t]() {
+			// Each thread lends its buffers and hands them to the next thread, which gives them back.
+			size_t lentLength;
+			for (int i = 0; i < kLends; i++) {
+				const uint8_t *data = sharedLender.lend(&shared[t * kBuffersPerThread + (i % kBuffersPerThread)], &kMockBufferOps, &lentLength);
+				if (data != NULL) {
+					const uint8_t *expected = NULL;
+					if (!handoff[(t + 1) % kThreads].compare_exchange_strong(expected, data)) sharedLender.giveBack(data);
+				}
+				const uint8_t *received = handoff[t].exchange(NULL);
+				if (received != NULL) sharedLender.giveBack(received);
+			}
+		}));
+	}
+	for (int t = 0; t < kThreads; t++) {
+		threads[t].join();
+	}
+	for (int t = 0; t < kThreads; t++) {
+		const uint8_t *left = handoff[t].exchange(NULL);
+		if (left != NULL) CHECK(sharedLender.giveBack(left));
+	}
+	CHECK(sharedLender.getOutstanding() == 0);
+	CHECK(sMaxHeldBuffers <= kMaxOutstanding);
+	CHECK(mockBuffersBalanced(shared, kThreads * kBuffersPerThread));
+}
+
+// The tasks still queued when the workers are stopped by release() or setThreadCount() are run once each by the thread
+// stopping them, and may use the pool: they used to be run with its mutex locked, which parallelFor() tried to lock
+// again and getThreadCount() deadlocks on. The tasks run by the workers only use parallelFor(), as the filters do,
+// since stopping the workers waits for them with the mutex locked.
+static void testVideoWorkerPoolDrain()
+{
+	static const int kTasks = 64;
+	static const int kCount = 1000;
+	VideoWorkerPool *pool = VideoWorkerPool::get();
+	std::thread::id stopper = std::this_thread::get_id();
+	for (int round = 0; round < 2; round++) {
+		pool->setThreadCount(4);
+		pool->retain();
+		std::atomic<int> ran(0);
+		std::atomic<int> covered(0);
+		for (int i = 0; i < kTasks; i++) {
+			pool->post([&]() {
+				std::atomic<int> rows(0);
+				pool->parallelFor(kCount, 2, [&](int first, int last) {
+					rows += last - first;
+				});
+				if (rows == kCount) covered++;
+				if (std::this_thread::get_id() == stopper) pool->getThreadCount();
+				ran++;
+			});
+		}
+		if (round == 1) pool->setThreadCount(2);
+		pool->release();
+		CHECK(ran == kTasks);
+		CHECK(covered == kTasks);
+		CHECK(pool->getTaskStats().queueDepth == 0);
+	}
+	pool->setThreadCount(0);
+}
+
+// A reset requested by another thread while the samples are stamped is never lost: the next sample starts again from 0.
+static void testPresentationClockReset()
+{
+	static const int kRounds = 200;
+	PresentationClock clock;
+	std::atomic<int> restarts(0);
+	std::atomic<bool> stop(false);
+	std::thread stamper([&]() {
+		int64_t now = 0;
+		uint32_t timestamp = 0;
+		while (!stop) {
+			int64_t time;
+			int64_t duration;
+			now += PresentationClock::kUnitsPerSecond / 30;
+			timestamp += 3000;
+			clock.stamp(now, timestamp, &time, &duration);
+			if (time == 0) restarts++;
+		}
+	});
+	bool ok = true;
+	for (int round = 0; round < kRounds; round++) {
+		int before = restarts;
+		clock.reset();
+		// The stamper must restart the times, bounded so that a lost reset fails rather than hangs.
+		int64_t deadline = PresentationClock::now() + 10 * PresentationClock::kUnitsPerSecond;
+		while ((restarts == before) && (PresentationClock::now() < deadline)) {
+			std::this_thread::yield();
+		}
+		ok = ok && (restarts > before);
+	}
+	stop = true;
+	stamper.join();
+	CHECK(ok);
+}
+
+// Stands for the Media Foundation backend of the sample pool: counts the resources alive and can fail their creation.
+class MockRecyclingBackend : public RecyclingPoolBackend<int> {
+public:
+	MockRecyclingBackend() : created(0), destroyed(0), failCreate(false) {}
+
+	int * create(int width, int height)
+	{
+		if (failCreate) return NULL;
+		created++;
+		return new int(width * height);
+	}
+
+	void destroy(int *resource)
+	{
+		destroyed++;
+		delete resource;
+	}
+
+	int alive() const { return created - destroyed; }
+
+	int created;
+	int destroyed;
+	bool failCreate;
+};
+
+// The resources are reused at the same size, at most maxIdle are kept, and a size change destroys the stale ones,
+// both the idle ones and those coming back afterwards. Nothing is left alive once the pool is gone.
+static void testRecyclingPool()
+{
+	MockRecyclingBackend backend;
+	{
+		RecyclingPool<int> pool(&backend, 2);
+		int *a = pool.acquire(320, 240);
+		int *b = pool.acquire(320, 240);
+		int *c = pool.acquire(320, 240);
+		CHECK((a != NULL) && (b != NULL) && (c != NULL));
+		CHECK(backend.created == 3);
+		pool.recycle(a, 320, 240);
+		pool.recycle(b, 320, 240);
+		pool.recycle(c, 320, 240);
+		RecyclingPool<int>::Stats stats = pool.getStats();
+		CHECK(stats.idle == 2);
+		CHECK(stats.destroyed == 1);
+		CHECK(backend.alive() == 2);
+
+		// In the steady state, the same resources go round without the backend being called.
+		for (int i = 0; i < 1000; i++) {
+			int *x = pool.acquire(320, 240);
+			int *y = pool.acquire(320, 240);
+			CHECK((*x == 320 * 240) && (*y == 320 * 240));
+			pool.recycle(x, 320, 240);
+			pool.recycle(y, 320, 240);
+		}
+		stats = pool.getStats();
+		CHECK(backend.created == 3);
+		CHECK(stats.hits == 2000);
+		CHECK(stats.misses == 3);
+
+		// A resolution change destroys the idle resources of the previous size, and the ones in flight when they return.
+		int *old = pool.acquire(320, 240);
+		int *d = pool.acquire(640, 480);
+		CHECK(*d == 640 * 480);
+		CHECK(backend.alive() == 2);
+		pool.recycle(old, 320, 240);
+		CHECK(backend.alive() == 1);
+		pool.recycle(d, 640, 480);
+		CHECK(pool.getStats().idle == 1);
+
+		// A failing backend makes acquire() return NULL without counting a resource.
+		backend.failCreate = true;
+		int *e = pool.acquire(640, 480);
+		CHECK(e != NULL);
+		CHECK(pool.acquire(640, 480) == NULL);
+		backend.failCreate = false;
+		pool.recycle(e, 640, 480);
+	}
+	CHECK(backend.alive() == 0);
+	CHECK(backend.created == backend.destroyed);
+}
+
+// Model of the media sink work queue: the samples are queued while the work queue runs the posted OpProcessSample after
+// one to three samples. A single item is pending at a time and serves all the samples queued meanwhile. Once the queue
+// has reached its capacity, 10000 samples allocate nothing.
+static void testSinkWorkQueue()
+{
+	static const int kSamples = 10000;
+	WorkItemCoalescer coalescer;
+	RingBuffer<int> workQueue(4, RingOverflowGrow);
+	for (int round = 0; round < 2; round++) {
+		unsigned long allocationsBefore = sAllocations;
+		unsigned long postsBefore = coalescer.getPosts();
+		unsigned long requestedSamples = 0;
+		size_t maxPending = 0;
+		for (int i = 0; i < kSamples; i++) {
+			if (coalescer.request()) workQueue.insertBack(i);
+			if (workQueue.getCount() > maxPending) maxPending = workQueue.getCount();
+			if ((rand() % 3) == 0) {
+				while (workQueue.removeFront(NULL)) requestedSamples += coalescer.take();
+			}
+		}
+		while (workQueue.removeFront(NULL)) requestedSamples += coalescer.take();
+		unsigned long allocations = sAllocations - allocationsBefore;
+		CHECK(requestedSamples == kSamples);
+		CHECK(maxPending == 1);
+		CHECK((coalescer.getPosts() - postsBefore) < (unsigned long)kSamples / 2);
+		// The ring never holds more than the pending item, so it never grows.
+		CHECK(allocations == 0);
+	}
+}
+
+// Capture queue of depth 8 whose consumer stalls: first entirely, while 300 frames are pushed, which must leave the 8
+// newest ones queued. Then a producer thread pushes frames while the consumer sleeps for 20ms every 1000 frames: each
+// frame must be either received, in order, or evicted, and no more than 8 frames may be received at once.
+static void testStalledCaptureQueue()
+{
+	static const int kStalledFrames = 300;
+	static const int kFrames = 20000;
+	static const size_t kDepth = 8;
+	SpscQueue<uint64_t> queue(32);
+	queue.setLimit(kDepth);
+
+	uint64_t evicted = 0;
+	unsigned int dropped = 0;
+	for (int i = 0; i < kStalledFrames; i++) {
+		if (queue.pushEvictingOldest(i, &evicted)) {
+			CHECK(evicted == (uint64_t)(i - kDepth));
+			dropped++;
+		}
+	}
+	std::vector<uint64_t> kept;
+	queue.drain([&](uint64_t frame) { kept.push_back(frame); });
+	CHECK(dropped == kStalledFrames - kDepth);
+	CHECK(kept.size() == kDepth);
+	bool newestKept = true;
+	for (size_t i = 0; i < kept.size(); i++) {
+		newestKept = newestKept && (kept[i] == kStalledFrames - kDepth + i);
+	}
+	CHECK(newestKept);
+	// Without eviction, a full queue rejects the new frame.
+	for (size_t i = 0; i < kDepth; i++) queue.push(i);
+	CHECK(!queue.push(kDepth));
+	queue.drain([](uint64_t) {});
+
+	std::atomic<unsigned int> evictions(0);
+	std::atomic<bool> producing(true);
+	std::thread producer([&]() {
+		uint64_t oldest;
+		for (int i = 0; i < kFrames; i++) {
+			if (queue.pushEvictingOldest(i, &oldest)) evictions++;
+			if ((i % 16) == 0) std::this_thread::yield();
+		}
+		producing = false;
+	});
+	unsigned int received = 0;
+	size_t maxBatch = 0;
+	bool inOrder = true;
+	int64_t last = -1;
+	for (;;) {
+		bool done = !producing;
+		size_t count = queue.drain([&](uint64_t frame) {
+			inOrder = inOrder && ((int64_t)frame > last);
+			last = (int64_t)frame;
+			if ((received++ % 1000) == 999) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		});
+		if (count > maxBatch) maxBatch = count;
+		if (done && (count == 0)) break;
+		std::this_thread::yield();
+	}
+	producer.join();
+	CHECK(inOrder);
+	CHECK((received + evictions) == kFrames);
+	CHECK(maxBatch <= kDepth);
+	// The consumer stalled, so frames must have been evicted, and the last one is never lost.
+	CHECK(evictions > 0);
+	CHECK(last == kFrames - 1);
+}
+
+// The requests of Media Foundation are answered with the newest frame, by the request itself or by the next publish,
+// and the frames that are not taken are released as soon as a newer one replaces them.
+static void testFrameMailbox()
+{
+	{
+		FrameMailbox<int, int> mailbox;
+		int frame = 0;
+		int request = 0;
+		CHECK(!mailbox.take(&frame));
+		CHECK(!mailbox.request(1, &frame));
+		CHECK(mailbox.publish(10, &request, &frame));
+		CHECK((request == 1) && (frame == 10));
+		CHECK(!mailbox.hasFreshFrame());
+		CHECK(!mailbox.publish(11, &request, &frame));
+		CHECK(!mailbox.publish(12, &request, &frame));
+		CHECK(mailbox.request(2, &frame) && (frame == 12));
+		CHECK(!mailbox.request(3, &frame));
+		CHECK(mailbox.cancelRequest(&request) && (request == 3));
+		CHECK(!mailbox.cancelRequest(&request));
+		// The cancelled request is not answered by the next frame.
+		CHECK(!mailbox.publish(13, &request, &frame));
+		FrameMailbox<int, int>::Stats stats = mailbox.getStats();
+		CHECK(stats.published == 4);
+		CHECK(stats.overwritten == 1);
+		CHECK(stats.deferred == 2);
+	}
+
+	// The ticker publishes the frames while the Media Foundation thread makes a new request as soon as the previous one is
+	// answered. The answers are serialized by answered, so that they can be checked without a lock.
+	static const int kFrames = 20000;
+	typedef std::shared_ptr<uint64_t> Frame;
+	std::vector<std::weak_ptr<uint64_t> > frames(kFrames + 1);
+	int alive = 0;
+	int left = 0;
+	int requests = 0;
+	int cancelled = 0;
+	std::atomic<int> answered(0);
+	std::atomic<int> answeredByPublish(0);
+	std::atomic<bool> producing(true);
+	int delivered = 0;
+	uint64_t lastFrame = 0;
+	bool ok = true;
+	FrameMailbox<Frame, int>::Stats stats;
+	{
+		FrameMailbox<Frame, int> mailbox;
+		auto answer = [&](int request, const Frame &frame) {
+			// Each request is answered once, in order, with a newer frame than the previous answer.
+			ok = ok && (request == answered.load() + 1) && frame && (*frame > lastFrame);
+			lastFrame = frame ? *frame : lastFrame;
+			delivered++;
+			answered.store(request);
+		};
+		std::thread producer([&]() {
+			for (int i = 1; i <= kFrames; i++) {
+				Frame frame = std::make_shared<uint64_t>(i);
+				frames[i] = frame;
+				int request = 0;
+				Frame requestFrame;
+				if (mailbox.publish(frame, &request, &requestFrame)) {
+					answeredByPublish++;
+					answer(request, requestFrame);
+				}
+				if ((i % 4) == 0) std::this_thread::yield();
+			}
+			producing = false;
+		});
+		while (producing) {
+			if (answered.load() != requests) {
+				std::this_thread::yield();
+				continue;
+			}
+			Frame frame;
+			if (mailbox.request(++requests, &frame)) answer(requests, frame);
+		}
+		producer.join();
+		int request = 0;
+		if (mailbox.cancelRequest(&request)) {
+			ok = ok && (request == requests);
+			cancelled++;
+		}
+		stats = mailbox.getStats();
+		// At most the latest frame, not taken, is still held by the mailbox.
+		for (int i = 1; i <= kFrames; i++) alive += !frames[i].expired();
+		left = mailbox.hasFreshFrame() ? 1 : 0;
+		ok = ok && (alive == left);
+	}
+	CHECK(ok);
+	CHECK(answered + cancelled == requests);
+	CHECK(stats.published == kFrames);
+	// No frame is lost: each one has been delivered, replaced by a newer one or is the one left.
+	CHECK(delivered + stats.overwritten + left == kFrames);
+	CHECK(answeredByPublish > 0);
+	CHECK(lastFrame <= kFrames);
+	bool released = true;
+	for (int i = 1; i <= kFrames; i++) released = released && frames[i].expired();
+	CHECK(released);
+}
+
+// Decimates seconds of presentation times of a camera at sourceFps to targetFps, with up to jitterUnits of jitter.
+// Returns the number of frames kept, and the shortest and longest spacing of the kept frames, in source frames.
+static int decimateCamera(double sourceFps, double targetFps, int seconds, int64_t jitterUnits, double &minGap, double &maxGap)
+{
+	FrameDecimator decimator;
+	decimator.setFps(targetFps);
+	int frames = (int)(sourceFps * seconds);
+	double sourceInterval = PresentationClock::kUnitsPerSecond / sourceFps;
+	uint32_t seed = 1;
+	int kept = 0;
+	int64_t previous = 0;
+	minGap = 1e9;
+	maxGap = 0;
+	for (int i = 0; i < frames; i++) {
+		seed = seed * 1103515245 + 12345;
+		int64_t jitter = (jitterUnits > 0) ? ((int64_t)((seed >> 16) % (2 * jitterUnits)) - jitterUnits) : 0;
+		int64_t time = (int64_t)(i * sourceInterval) + jitter;
+		if (!decimator.accept(time)) continue;
+		if (kept > 0) {
+			double gap = (time - previous) / sourceInterval;
+			if (gap < minGap) minGap = gap;
+			if (gap > maxGap) maxGap = gap;
+		}
+		previous = time;
+		kept++;
+	}
+	if (decimator.getDroppedFrames() != (unsigned int)(frames - kept)) kept = -1;
+	return kept;
+}
+
+// The frames closest to the grid of the target interval are kept: 30 to 15 fps keeps every other frame, 60 to 24 fps
+// alternates 2 and 3 camera intervals. The jitter of the presentation times may only delay a choice by one frame.
+static void testFrameDecimator()
+{
+	static const int64_t kMs = PresentationClock::kUnitsPerSecond / 1000;
+	double minGap, maxGap;
+	CHECK(decimateCamera(30, 15, 20, 0, minGap, maxGap) == 300);
+	CHECK((fabs(minGap - 2) < 0.01) && (fabs(maxGap - 2) < 0.01));
+	CHECK(decimateCamera(60, 24, 20, 0, minGap, maxGap) == 480);
+	CHECK((fabs(minGap - 2) < 0.01) && (fabs(maxGap - 3) < 0.01));
+	CHECK(decimateCamera(30, 15, 20, kMs, minGap, maxGap) == 300);
+	CHECK((minGap > 1.9) && (maxGap < 2.1));
+	CHECK(decimateCamera(60, 24, 20, kMs, minGap, maxGap) == 480);
+	CHECK((minGap > 1.8) && (maxGap < 3.2));
+	// 29.97 fps to 15 fps, the fractional rates of the cameras.
+	CHECK(decimateCamera(29.97, 15, 20, 0, minGap, maxGap) == 300);
+	// A target at or above the camera rate, or no target, lets all the frames through.
+	CHECK(decimateCamera(15, 30, 20, 0, minGap, maxGap) == 300);
+	CHECK(decimateCamera(30, 0, 20, 0, minGap, maxGap) == 600);
+
+	// A gap of more than a second restarts the grid from the next frame, which is kept.
+	FrameDecimator decimator;
+	decimator.setFps(15);
+	int64_t interval = PresentationClock::kUnitsPerSecond / 30;
+	CHECK(decimator.accept(0));
+	CHECK(!decimator.accept(interval));
+	CHECK(decimator.accept(2 * interval));
+	CHECK(decimator.accept(2 * interval + 2 * PresentationClock::kUnitsPerSecond));
+	CHECK(!decimator.accept(3 * interval + 2 * PresentationClock::kUnitsPerSecond));
+	// So does a time going backwards.
+	CHECK(decimator.accept(interval));
+	CHECK(decimator.getDroppedFrames() == 2);
+}
+
+// When the display is stopped, the cancellation of the request leaves the frame waiting in the mailbox: the producer
+// discards it, which releases it at once. Discarding while the consumer takes and requests frames never answers a
+// request with an empty frame nor loses a request.
+static void testFrameMailboxDiscard()
+{
+	{
+		typedef std::shared_ptr<int> Frame;
+		FrameMailbox<Frame, int> mailbox;
+		Frame frame;
+		int request = 0;
+		std::weak_ptr<int> waiting;
+		{
+			Frame published = std::make_shared<int>(1);
+			waiting = published;
+			CHECK(!mailbox.publish(published, &request, &frame));
+		}
+		// The display is stopped with a frame waiting and no request.
+		CHECK(!mailbox.cancelRequest(&request));
+		CHECK(mailbox.discardLatest());
+		CHECK(waiting.expired());
+		CHECK(!mailbox.hasFreshFrame());
+		CHECK(!mailbox.take(&frame));
+		CHECK(!mailbox.discardLatest());
+		// A waiting request is kept for the next frame.
+		CHECK(!mailbox.request(2, &frame));
+		CHECK(!mailbox.discardLatest());
+		CHECK(mailbox.publish(std::make_shared<int>(3), &request, &frame));
+		CHECK((request == 2) && frame && (*frame == 3));
+		// A frame already taken is not discarded.
+		CHECK(!mailbox.publish(std::make_shared<int>(4), &request, &frame));
+		CHECK(mailbox.take(&frame) && (*frame == 4));
+		CHECK(!mailbox.discardLatest());
+	}
+
+	static const int kFrames = 20000;
+	FrameMailbox<int, int> mailbox;
+	std::atomic<int> answered(0);
+	std::atomic<bool> producing(true);
+	int requests = 0;
+	int delivered = 0;
+	int lastFrame = 0;
+	int discarded = 0;
+	bool ok = true;
+	auto answer = [&](int request, int frame) {
+		ok = ok && (request == answered.load() + 1) && (frame > lastFrame);
+		lastFrame = frame;
+		delivered++;
+		answered.store(request);
+	};
+	std::thread producer([&]() {
+		for (int i = 1; i <= kFrames; i++) {
+			int request = 0;
+			int requestFrame = 0;
+			if (mailbox.publish(i, &request, &requestFrame)) answer(request, requestFrame);
+			if (((i % 3) == 0) && mailbox.discardLatest()) discarded++;
+			if ((i % 4) == 0) std::this_thread::yield();
+		}
+		producing = false;
+	});
+	while (producing) {
+		if (answered.load() != requests) {
+			std::this_thread::yield();
+			continue;
+		}
+		int frame = 0;
+		if (mailbox.request(++requests, &frame)) answer(requests, frame);
+	}
+	producer.join();
+	int request = 0;
+	int cancelled = mailbox.cancelRequest(&request) ? 1 : 0;
+	int left = mailbox.hasFreshFrame() ? 1 : 0;
+	CHECK(ok);
+	CHECK(answered + cancelled == requests);
+	CHECK(discarded > 0);
+	CHECK(delivered + discarded + (int)mailbox.getStats().overwritten + left == kFrames);
+}
+
+// Stamps 10 minutes of a 60 fps stream, whose 90kHz timestamps advance by 1500 and wrap after 30 seconds. The durations
+// must follow the timestamps within a 100ns unit, without drifting from the clock, and a gap must not stretch the
+// duration of the sample following it.
+static void testPresentationClockDurations()
+{
+	static const int kFrames = 60 * 600;
+	static const int64_t kFrameDuration = 166667;
+	uint32_t base = (uint32_t)(0 - 30 * 90000);
+	PresentationClock clock;
+	int64_t time;
+	int64_t duration;
+	bool durationsOk = true;
+	bool timesOk = true;
+	for (int i = 0; i < kFrames; i++) {
+		int64_t now = (int64_t)i * PresentationClock::kUnitsPerSecond / 60;
+		clock.stamp(now, base + (uint32_t)i * 1500, &time, &duration);
+		if (i == 0) continue;
+		durationsOk = durationsOk && (duration >= kFrameDuration - 1) && (duration <= kFrameDuration + 1);
+		timesOk = timesOk && (time >= now - 1) && (time <= now + 1);
+	}
+	CHECK(durationsOk);
+	CHECK(timesOk);
+
+	// A 5 seconds gap: the time jumps, the duration stays the one of a frame.
+	int64_t resumed = (int64_t)(kFrames + 300) * PresentationClock::kUnitsPerSecond / 60;
+	clock.stamp(resumed, base + (uint32_t)(kFrames + 300) * 1500, &time, &duration);
+	CHECK((time >= resumed - 1) && (time <= resumed + 1));
+	CHECK((duration >= kFrameDuration - 1) && (duration <= kFrameDuration + 1));
+
+	// Without timestamps, the durations follow the clock.
+	PresentationClock untimed;
+	durationsOk = true;
+	for (int i = 0; i < 600; i++) {
+		int64_t now = (int64_t)i * PresentationClock::kUnitsPerSecond / 60;
+		untimed.stamp(now, 0, &time, &duration);
+		if (i == 0) continue;
+		durationsOk = durationsOk && (duration >= kFrameDuration - 1) && (duration <= kFrameDuration + 1);
+	}
+	CHECK(durationsOk);
+}
+
+// Arrival times laid out like a struct timeval where long is 32 bits, as on Windows.
+struct ArrivalTime32 {
+	int32_t tv_sec;
+	int32_t tv_usec;
+};
+
+struct ArrivalTime {
+	long tv_sec;
+	long tv_usec;
+};
+
+// Checks the bucket boundaries and the percentiles of the latency histograms, the stage durations and the jitter across
+// the wrap of the stamps, and the stamps carried in the arrival time of the frames.
+static void testLatencyTracer()
+{
+	// Each bucket starts right after the previous one, and its value is one that falls in it.
+	bool boundariesOk = true;
+	for (size_t i = 1; i < 400; i++) {
+		uint64_t lowest = (i < 16) ? i : ((uint64_t)(16 + (i - 16) % 16) << ((i - 16) / 16));
+		boundariesOk = boundariesOk && (LatencyHistogram::bucketIndex(lowest) == i) && (LatencyHistogram::bucketIndex(lowest - 1) == i - 1)
+			&& (LatencyHistogram::bucketIndex(LatencyHistogram::bucketValue(i)) == i);
+	}
+	CHECK(boundariesOk);
+	CHECK(LatencyHistogram::bucketIndex(15) == 15);
+	CHECK(LatencyHistogram::bucketIndex(16) == 16);
+	CHECK(LatencyHistogram::bucketIndex(32) == 32);
+	CHECK(LatencyHistogram::bucketIndex(33) == 32);
+	CHECK(LatencyHistogram::bucketIndex(34) == 33);
+	// The values too large for the histogram all fall in the last bucket.
+	CHECK(LatencyHistogram::bucketIndex((uint64_t)1 << 50) == LatencyHistogram::bucketIndex(~(uint64_t)0));
+	CHECK(LatencyHistogram::bucketIndex((uint64_t)1 << 50) > LatencyHistogram::bucketIndex((uint64_t)1 << 40));
+
+	LatencyHistogram histogram;
+	LatencyHistogram::Summary summary = histogram.summarize();
+	CHECK((summary.count == 0) && (summary.p50Us == 0) && (summary.p99Us == 0) && (summary.maxUs == 0));
+	for (uint64_t us = 1; us <= 10000; us++) histogram.record(us);
+	summary = histogram.summarize();
+	CHECK(summary.count == 10000);
+	CHECK(summary.meanUs == 5000);
+	CHECK(summary.maxUs == 10000);
+	CHECK((summary.p50Us >= 5000 - 5000 / 16) && (summary.p50Us <= 5000 + 5000 / 16));
+	CHECK((summary.p90Us >= 9000 - 9000 / 16) && (summary.p90Us <= 9000 + 9000 / 16));
+	CHECK((summary.p99Us >= 9900 - 9900 / 16) && (summary.p99Us <= 10000));
+	// A bucket extending beyond the largest value recorded does not give a percentile above it.
+	histogram.reset();
+	histogram.record(3000);
+	summary = histogram.summarize();
+	CHECK((summary.count == 1) && (summary.p50Us <= 3000) && (summary.p99Us <= 3000) && (summary.maxUs == 3000));
+	CHECK(summary.p50Us >= 3000 - 3000 / 16);
+
+	// The stamps are microseconds modulo 2^32.
+	CHECK(LatencyTracer::stamp(10) == 1);
+	CHECK(LatencyTracer::stamp(((int64_t)1 << 32) * 10 + 50) == 5);
+
+	LatencyTracer tracer;
+	tracer.record(LatencyTracer::StageConversion, 0xFFFFFF00u, 0x100u);
+	summary = tracer.stage(LatencyTracer::StageConversion).summarize();
+	CHECK((summary.count == 1) && (summary.maxUs == 512));
+	// A start stamped after the end counts as 0, not as a duration of 71 minutes.
+	tracer.record(LatencyTracer::StageHandoff, 1000, 999);
+	summary = tracer.stage(LatencyTracer::StageHandoff).summarize();
+	CHECK((summary.count == 1) && (summary.maxUs == 0));
+
+	// Frames at 30 fps across the wrap: the jitter is the change of interval, 1us at most.
+	const uint32_t origin = 0xFFFFFFFFu - 100000u;
+	for (int i = 0; i < 10; i++) tracer.frameDone(origin + (uint32_t)((int64_t)i * 1000000 / 30));
+	summary = tracer.jitter().summarize();
+	CHECK(summary.count == 8);
+	CHECK(summary.maxUs <= 1);
+	// After a reset the interval before it is forgotten: two frames give no jitter.
+	tracer.reset();
+	tracer.frameDone(origin);
+	tracer.frameDone(origin + 50000);
+	CHECK(tracer.jitter().summarize().count == 0);
+	tracer.frameDone(origin + 80000);
+	summary = tracer.jitter().summarize();
+	CHECK((summary.count == 1) && (summary.maxUs == 20000));
+	CHECK(tracer.stage(LatencyTracer::StageConversion).summarize().count == 0);
+
+	// The stamps carried in the arrival time come back unchanged, even above 2^31 with a 32-bit long, and nothing is left
+	// once they are cleared.
+	uint32_t entered;
+	uint32_t queued;
+	ArrivalTime32 arrival32;
+	LatencyTracer::setFrameStamps(arrival32, 0xFFFFFFF0u, 0x10u);
+	LatencyTracer::getFrameStamps(arrival32, &entered, &queued);
+	CHECK((entered == 0xFFFFFFF0u) && (queued == 0x10u));
+	LatencyTracer::clearFrameStamps(arrival32);
+	CHECK((arrival32.tv_sec == 0) && (arrival32.tv_usec == 0));
+	ArrivalTime arrival;
+	LatencyTracer::setFrameStamps(arrival, 0x80000001u, 0xFFFFFFFFu);
+	LatencyTracer::getFrameStamps(arrival, &entered, &queued);
+	CHECK((entered == 0x80000001u) && (queued == 0xFFFFFFFFu));
+	LatencyTracer::clearFrameStamps(arrival);
+	CHECK((arrival.tv_sec == 0) && (arrival.tv_usec == 0));
+	LatencyTracer::getFrameStamps(arrival, &entered, &queued);
+	CHECK((entered == 0) && (queued == 0));
+}
+
+static const TestCase kTests[] = {
+	{ "interleaveUVRow", testInterleaveUVRow },
+	{ "convertI420ToNV12", testConvertI420ToNV12 },
+	{ "captureNV12", testCaptureNV12 },
+	{ "scaleNV12ToI420", testScaleNV12ToI420 },
+	{ "computeFitRects", testComputeFitRects },
+	{ "fitI420ToNV12", testFitI420ToNV12 },
+	{ "rotateNV12ToI420", testRotateNV12ToI420 },
+	{ "bufferLender", testBufferLender },
+	{ "videoWorkerPoolDrain", testVideoWorkerPoolDrain },
+	{ "presentationClockReset", testPresentationClockReset },
+	{ "recyclingPool", testRecyclingPool },
+	{ "sinkWorkQueue", testSinkWorkQueue },
+	{ "stalledCaptureQueue", testStalledCaptureQueue },
+	{ "frameMailbox", testFrameMailbox },
+	{ "frameDecimator", testFrameDecimator },
+	{ "frameMailboxDiscard", testFrameMailboxDiscard },
+	{ "presentationClockDurations", testPresentationClockDurations },
+	{ "latencyTracer", testLatencyTracer }
+};
+
+int main(int argc, char *argv[])
+{
+	srand(1);
+	int run = 0;
+	for (size_t i = 0; i < sizeof(kTests) / sizeof(kTests[0]); i++) {
+		bool selected = (argc < 2);
+		for (int a = 1; a < argc; a++) {
+			if (strcmp(argv[a], kTests[i].name) == 0) selected = true;
+		}
+		if (!selected) continue;
+		int failures = sFailures;
+		sCheckContext = "";
+		kTests[i].func();
+		printf("%s %s\n", (sFailures == failures) ? "PASS" : "FAIL", kTests[i].name);
+		run++;
+	}
+	if (run == 0) {
+		fprintf(stderr, "No such test\n");
+		return 1;
+	}
+	return (sFailures == 0) ? 0 : 1;
+}